@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include "quirks.h"
+
+// analise estatica da rom carregada, feita antes de rodar: segue o fluxo a partir do pc
+// inicial (pulos, chamadas, skips), monta o grafo de blocos, acha onde o FX33/FX55 podem
+// escrever, os lacos e chuta o perfil de quirks
+// a vm usa o resultado pra decodificar o codigo antes de rodar e, quando da pra provar que
+// nenhuma escrita cai em cima de codigo, pra nem invalidar cache nas escritas (useAnalysis)
+
+// o que a analise sabe de cada byte da memoria (RomAnalysis::flags)
+enum : uint8_t {
+    ADDR_INSTR = 1,   // comeca uma instrucao alcancavel
+    ADDR_CODE = 2,    // faz parte de uma instrucao alcancavel (os dois bytes)
+    ADDR_LEADER = 4,  // comeca um bloco basico
+    ADDR_WRITTEN = 8, // FX33/FX55 podem escrever aqui
+    ADDR_LOOP = 16    // cabeca de um laco
+};
+
+// bloco basico: instrucoes em sequencia, so a ultima desvia (ou cai no comeco de outro bloco)
+struct CfgBlock {
+    uint16_t start; // primeira instrucao
+    uint16_t end;   // endereco depois da ultima
+    std::vector<uint16_t> succ; // blocos seguintes (destino, os dois lados do skip, a volta da chamada)
+    bool ret;    // termina num 00EE (volta pra quem chamou)
+    int depth;   // em quantos lacos o bloco ta (0 = fora de laco)
+};
+
+// tipo de laco, pelo que roda dentro dele
+enum LoopKind {
+    LOOP_PLAIN, // laco qualquer
+    LOOP_TIMER, // le o delay timer e pula de volta ate ele mudar (FX07 + skip + 1NNN)
+    LOOP_KEY    // fica testando tecla (EX9E/EXA1) sem desenhar nada
+};
+
+struct CfgLoop {
+    uint16_t head; // bloco de entrada (destino do pulo de volta)
+    uint16_t back; // bloco que pula de volta
+    int instrs;    // instrucoes no corpo
+    int depth;     // lacos em volta dele (0 = mais externo)
+    LoopKind kind;
+};
+
+struct RomAnalysis {
+    uint16_t start = 0;
+    uint8_t flags[4096] = {};
+    std::vector<CfgBlock> blocks; // por endereco
+    std::vector<CfgLoop> loops;   // os mais internos primeiro
+    std::vector<std::pair<uint16_t, uint16_t>> selfmod; // trechos de codigo [de, ate) que podem ser escritos
+    int instructions = 0;         // instrucoes alcancaveis
+    bool unknown_writes = false;  // escrita com I que nao deu pra limitar (pode ser em qualquer lugar)
+    bool computed_jumps = false;  // tem BNNN alcancavel (destino depende do registrador)
+    bool readonly = false;        // provado: nenhuma escrita cai em cima de codigo
+    QuirkProfile quirks = QUIRKS_MODERN; // perfil provavel
+    std::vector<std::string> evidence;   // por que chutou esse perfil
+
+    // bloco que comeca em addr (nullptr se nao tem)
+    const CfgBlock *block(uint16_t addr) const;
+};
+
+// analisa a memoria (4kb, fontes + rom) a partir de start
+RomAnalysis analyzeRom(const uint8_t *memory, uint16_t start);
+
+// mnemonico de um opcode ("LD V1, 0x05", "DRW V0, V1, 5", ...), DW pro que nao eh instrucao
+std::string disassemble(uint16_t opcode);
+
+// relatorio (resumo, escritas, lacos, quirks) e, com listing, o codigo por bloco
+void printAnalysis(std::FILE *out, const RomAnalysis &a, const uint8_t *memory, bool listing);
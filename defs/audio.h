@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <SDL2/SDL.h>
+#include "spsc.h"
+#include "defs.h"
+
+// beep do chip8: onda quadrada enquanto o sound timer estiver ligado
+// o loop da emulacao so marca a cada frame se o beep ta ligado e, conforme o dispositivo
+// consome, completa a fila sem lock ate um nivel alvo com amostras do estado atual (pump). o
+// callback do sdl (na thread de audio) so tira da fila e nunca espera nada
+// a fila segue o relogio da placa de som e nao o dos frames, entao a diferenca entre os dois
+// nao vira fila vazia nem amostra jogada fora
+// (gerar do lado da emulacao deixa espaco pro buffer de padrao do XO-CHIP depois)
+class Audio {
+public:
+    Audio();
+    ~Audio(); // fecha o dispositivo
+
+    // abre o dispositivo de audio (o SDL_INIT_AUDIO ja tem que ter rodado)
+    // se falhar o emulador segue mudo
+    bool init();
+
+    // estado do beep no frame (1/60 s) que acabou de rodar, vale pras proximas amostras
+    // chamado uma vez por frame emulado, inclusive quando a vm nao roda (rewind)
+    void frame(bool beeping);
+
+    // completa a fila ate o alvo (AUDIO_TARGET_MS) com o estado atual do beep (mesma thread
+    // do frame(), pelo menos a cada AUDIO_PUMP_MS)
+    void pump();
+
+    // fecha o dispositivo
+    void shutdown();
+
+    bool isOpen() const { return device != 0; }
+
+    // vezes que o dispositivo pediu amostra e a fila estava vazia
+    uint64_t underruns() const { return underrun_count.load(std::memory_order_relaxed); }
+
+private:
+    // fila com folga, o atraso de verdade eh o alvo do pump()
+    using SampleRing = SpscRing<int16_t, 4096>;
+
+    static void callback(void *userdata, Uint8 *stream, int len);
+
+    SDL_AudioDeviceID device; // dispositivo aberto (0 = sem som)
+    int rate;                 // taxa que o dispositivo aceitou
+    int target;               // amostras na fila depois do pump (fila + dispositivo <= AUDIO_MAX_LATENCY_MS)
+    bool beeping;             // estado do beep no ultimo frame
+    uint32_t phase, step;     // fase da onda quadrada (volta completa = 2^32)
+    std::vector<int16_t> scratch; // amostras geradas antes de ir pra fila
+
+    SampleRing ring;
+    std::atomic<bool> started;  // o primeiro frame ja chegou (antes disso fila vazia nao conta)
+    std::atomic<uint64_t> underrun_count;
+};
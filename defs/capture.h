@@ -0,0 +1,138 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chip8.h"
+#include "spsc.h"
+#include "defs.h"
+
+// gravacao da tela (pra QA, sem precisar filmar a janela): a cada frame de 1/60s a emulacao
+// entrega a tela pro Capture, ele guarda so quando mudou e uma thread separada codifica
+//
+// a emulacao so copia as linhas de bits da tela (Chip8::videoRows, 1kb) numa fila sem lock e
+// nunca espera: se o codificador ficou pra tras e a fila ta cheia, o frame eh descartado e o
+// tempo dele vai pro proximo (o video fica com a duracao certa, so perde aquela imagem)
+//
+// a tela gravada tem sempre 128x64 (lores com os pixels dobrados) vezes a escala, assim o
+// tamanho nao muda quando a rom troca de resolucao. formatos (pela extensao do arquivo):
+//   .gif          gif animado, cada frame so com o retangulo que mudou
+//   .png / .apng  apng, idem (o arquivo precisa dar seek: o numero de frames vai no fim)
+//   - (ou outro)  frames crus rgb24, um por frame de 1/60s, pro ffmpeg:
+//                 ffmpeg -f rawvideo -pix_fmt rgb24 -s 512x256 -r 60 -i - video.mp4
+
+// escala padrao (128x64 -> 512x256)
+#define CAPTURE_DEFAULT_SCALE 4
+
+// frames que cabem na fila entre a emulacao e o codificador (potencia de 2, 1kb cada)
+#define CAPTURE_QUEUE_FRAMES 1024
+
+// maior duracao de um frame em 1/60s (o gif guarda o tempo em 16 bits de centesimos):
+// uma tela parada mais que isso vira mais de um frame
+#define CAPTURE_MAX_TICKS 30000
+
+enum CaptureFormat {
+    CAPTURE_RAW,
+    CAPTURE_GIF,
+    CAPTURE_APNG
+};
+
+// uma tela na fila: as linhas do jeito do videoRows (em lores so as 32 primeiras, palavra 0)
+struct CaptureFrame {
+    uint64_t rows[SCHIP_HEIGHT][2];
+    bool hires;
+    uint32_t ticks; // quantos frames de 1/60s ela ficou na tela
+};
+
+class Capture {
+public:
+    Capture() = default;
+    ~Capture();
+
+    Capture(const Capture &) = delete;
+    Capture &operator=(const Capture &) = delete;
+
+    // abre o arquivo ("-" = stdout, sempre cru) e sobe a thread do codificador
+    // r, g, b = cor dos pixels acesos (o fundo eh preto)
+    bool open(const std::string &path, int scale = CAPTURE_DEFAULT_SCALE, uint8_t r = 255, uint8_t g = 255,
+              uint8_t b = 255);
+    bool isOpen() const { return started; }
+    CaptureFormat format() const { return fmt; }
+    // largura e altura do video
+    int width() const { return SCHIP_WIDTH * scale; }
+    int height() const { return SCHIP_HEIGHT * scale; }
+
+    // lado da emulacao: a tela que ficou no frame que acabou de rodar (nao bloqueia)
+    void frame(const Chip8 &vm);
+
+    // manda o ultimo frame, espera o codificador terminar e fecha o arquivo
+    // (false se alguma escrita falhou)
+    bool close();
+
+    // frames que foram pra fila, os descartados por fila cheia e os gravados
+    uint64_t queued() const { return queued_count; }
+    uint64_t dropped() const { return dropped_count; }
+    uint64_t encoded() const { return encoded_count.load(std::memory_order_relaxed); }
+
+private:
+    CaptureFormat fmt = CAPTURE_RAW;
+    int scale = CAPTURE_DEFAULT_SCALE;
+    uint8_t color[3] = {255, 255, 255};
+    std::FILE *out = nullptr;
+    bool to_stdout = false;
+    bool started = false;
+
+    // lado da emulacao: a tela atual fica aqui ate mudar (ai vai pra fila com a duracao certa)
+    CaptureFrame pending;
+    bool has_pending = false;
+    uint64_t queued_count = 0;
+    uint64_t dropped_count = 0;
+    // manda o pending pra fila, false se ela tava cheia (ai ele eh descartado)
+    bool flushPending();
+
+    // fila e a thread do codificador (dorme no wake quando a fila ta vazia)
+    std::unique_ptr<SpscRing<CaptureFrame, CAPTURE_QUEUE_FRAMES>> queue;
+    std::thread worker;
+    std::atomic<bool> closing{false};
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::atomic<uint64_t> encoded_count{0};
+    void encodeLoop();
+
+    // lado do codificador: a tela anterior e a atual em 128x64, um byte por pixel
+    uint8_t canvas[SCHIP_WIDTH * SCHIP_HEIGHT] = {};
+    uint8_t previous[SCHIP_WIDTH * SCHIP_HEIGHT] = {};
+    bool first = true;
+    bool owed = false; // a tela do canvas ainda nao foi gravada (gif, frame curto)
+    bool write_ok = true;
+    uint64_t elapsed = 0; // duracao ja gravada, em 1/60s
+    uint64_t gif_cs = 0;  // e em centesimos (o que o gif ja usou de delay)
+    // onde o relogio do gif devia estar, em centesimos
+    uint64_t gifTarget() const { return (elapsed * 100 + 30) / 60; }
+    uint32_t apng_frames = 0;
+    uint32_t apng_seq = 0;
+    long apng_actl = 0; // onde ta o acTL no arquivo (o numero de frames vai depois)
+    std::vector<uint8_t> pixels; // retangulo escalado que vai pro codificador
+    std::vector<uint8_t> bytes;  // saida do codificador antes do fwrite
+
+    void encode(const CaptureFrame &f);
+    void writeHeader();
+    void writeTrailer();
+    void writeBytes(const uint8_t *data, size_t n);
+    // retangulo escalado [x0, x1) x [y0, y1) da tela em 128x64, um byte por pixel (0 ou 1)
+    void scaleRect(int x0, int y0, int x1, int y1);
+    // grava o que mudou do previous pro canvas como um frame de ticks/60 s
+    void writeChange(uint32_t ticks);
+    void gifFrame(int x0, int y0, int w, int h);
+    void apngFrame(int x0, int y0, int w, int h, uint32_t ticks);
+    void apngChunk(const char *type, const uint8_t *data, size_t n);
+    void rawFrame(uint32_t ticks);
+};
+
+// formato pela extensao do arquivo
+CaptureFormat captureFormat(const std::string &path);
@@ -1,11 +1,108 @@
 #pragma once
 #include <cstdint>
 #include <string>
+#include <deque>
+#include <memory>
+#include <vector>
 #include "defs.h"
+#include "perf.h"
+#include "quirks.h"
 
-// declaracoes das classes que vao ser usadas aqui
-class Keyboard;
-class Display;
+struct RomAnalysis;
+class Debugger;
+
+// identificador de cada instrucao depois de decodificada (um por handler)
+enum Op : uint8_t {
+    OP_NONE = 0, // entrada vazia no cache (ainda nao decodificada ou invalidada)
+    OP_00E0,
+    OP_00EE,
+    OP_1NNN,
+    OP_2NNN,
+    OP_3XNN,
+    OP_4XNN,
+    OP_5XY0,
+    OP_6XNN,
+    OP_7XNN,
+    OP_8XY0,
+    OP_8XY1,
+    OP_8XY2,
+    OP_8XY3,
+    OP_8XY4,
+    OP_8XY5,
+    OP_8XY6,
+    OP_8XY7,
+    OP_8XYE,
+    OP_9XY0,
+    OP_ANNN,
+    OP_BNNN,
+    OP_CXNN,
+    OP_DXYN,
+    OP_EX9E,
+    OP_EXA1,
+    OP_FX07,
+    OP_FX0A,
+    OP_FX15,
+    OP_FX18,
+    OP_FX1E,
+    OP_FX29,
+    OP_FX33,
+    OP_FX55,
+    OP_FX65,
+    // SUPER-CHIP
+    OP_00CN,
+    OP_00FB,
+    OP_00FC,
+    OP_00FD,
+    OP_00FE,
+    OP_00FF,
+    OP_DXY0,
+    OP_FX30,
+    OP_FX75,
+    OP_FX85,
+    OP_UNKNOWN,
+    OP_COUNT
+};
+
+static_assert(OP_COUNT <= PERF_MAX_OPS, "PERF_MAX_OPS pequeno demais pro enum Op");
+
+// instrucao ja decodificada: qual handler e os campos que ele usa ja separados
+// assim o handler nao precisa ficar fazendo mascara toda vez que executa
+// (8 bytes: cabe 8 por linha de cache e o cache inteiro tem 32kb por vm)
+struct Instr {
+    uint8_t op; // qual instrucao (enum Op)
+    uint8_t x; // registrador x
+    uint8_t y; // registrador y
+    uint8_t n; // nibble mais baixo
+    uint8_t nn; // byte mais baixo
+    uint16_t nnn; // endereco de 12 bits
+};
+
+// motor de execucao usado pelo run()
+enum Engine {
+    ENGINE_SWITCH, // interpretador: uma instrucao por vez pelo cache de decodificacao
+    ENGINE_BLOCK   // blocos basicos compilados em codigo encadeado (threaded code)
+};
+
+// bloco basico: sequencia de instrucoes sem desvio, a ultima pode ser um desvio
+// (1NNN, 2NNN, 00EE, BNNN), uma escrita na memoria (FX33, FX55) ou uma parada (FX0A, 00FD)
+// skip no meio do bloco vira uma saida lateral quando pula
+struct Block {
+    uint16_t start; // endereco da primeira instrucao
+    uint8_t len; // quantas instrucoes tem o bloco
+    bool self_loop; // bloco eh so um 1NNN pra ele mesmo (a rom ficou parada ali)
+    Instr ops[BLOCK_MAX_LEN + 1]; // instrucoes + uma sentinela OP_NONE no final
+};
+
+// container do cache de blocos: a copia da vm comeca com ele vazio (os Block * apontam pra
+// dentro do deque da vm original), o motor de blocos remonta o que precisar
+template <class T> struct BlockCache : T {
+    BlockCache() = default;
+    BlockCache(const BlockCache &) : T() {}
+    BlockCache &operator=(const BlockCache &) {
+        T::clear();
+        return *this;
+    }
+};
 
 class Chip8 {
 public:
@@ -17,16 +114,131 @@ public:
     // carrega o rom pra memoria a partir de um endereco
     bool loadROM(const std::string &path, uint16_t load_addr = DEFAULT_PC_START);
 
+    // mesma coisa, mas a rom ja ta num buffer (pra carregar o mesmo arquivo em varias vms)
+    bool loadROM(const uint8_t *data, size_t size, uint16_t load_addr = DEFAULT_PC_START);
+
     // faz um ciclo da cpu: busca, decodifica e executa uma instrucao
-    void emulateCycle(Keyboard &kb, Display &disp);
+    void emulateCycle();
+
+    // roda varios ciclos seguidos (mesmo que chamar emulateCycle n vezes, so que sem
+    // o custo de chamada por instrucao), retorna quantos rodou
+    // para antes se cair num FX0A: a vm fica esperando tecla e o resto do orcamento volta
+    int run(int cycles);
+
+    // mesmo que o run, mas sempre no interpretador e passando pelos ganchos do depurador
+    // (debugger.h: breakpoints, watchpoints, trace). quem chama eh o Debugger::run
+    // se o depurador parou no meio, o relogio (cycles()) so anda o que rodou e o resto do
+    // orcamento vem no proximo run
+    int runDebug(int cycles, Debugger &dbg);
+
+    // ciclos agendados desde o initialize (soma dos orcamentos passados pro run, inclusive
+    // os que sobraram esperando tecla), eh o relogio usado pra marcar o input nos replays
+    uint64_t cycles() const { return cycle_count; }
+
+    // true enquanto a vm ta parada num FX0A esperando uma tecla
+    bool isWaitingKey() const { return wait_reg >= 0; }
+
+    // true depois do 00FD (SUPER-CHIP: sai do interpretador), a vm nao roda mais
+    bool isHalted() const { return halted; }
+
+    // escolhe o motor usado pelo run(), os dois chegam exatamente no mesmo estado
+    void setEngine(Engine e) { engine = e; }
+    Engine getEngine() const { return engine; }
+
+    // escolhe o perfil de quirks (ver quirks.h), padrao QUIRKS_MODERN
+    void setQuirks(QuirkProfile q) { quirks = q; }
+    QuirkProfile getQuirks() const { return quirks; }
+
+    // liga/desliga o atalho da espera do delay timer (idleLoop), padrao ligado. o estado no fim
+    // eh o mesmo, desligado cada volta do laco passa pelo interpretador (bench do custo real;
+    // vale pro run, o kernel do lockstep tem o atalho dele)
+    void setIdleSkip(bool on) { idle_skip = on; }
+
+    // compara o estado visivel (memoria, registradores, pilha, tela, timers) com outra vm
+    // se for diferente escreve em what o primeiro campo que diferiu
+    bool sameState(const Chip8 &other, std::string *what = nullptr) const;
+
+    // save state: snapshot completo do estado (formato em state.h), out eh sobrescrito
+    void saveState(std::vector<uint8_t> &out) const;
+
+    // snapshot so com o que mudou desde o ultimo saveDelta ou loadState
+    // (paginas de memoria e linhas da tela que foram escritas), barato pra fazer todo frame
+    void saveDelta(std::vector<uint8_t> &out);
+
+    // aplica um snapshot completo ou um delta por cima do estado atual
+    // devolve false e nao mexe na vm se os dados forem invalidos ou de outra versao
+    bool loadState(const uint8_t *data, size_t size);
+    bool loadState(const std::vector<uint8_t> &data) { return loadState(data.data(), data.size()); }
+
+    // guarda a memoria atual (fontes + rom ja carregada) como imagem limpa pro reset()
+    // a imagem eh compartilhada entre as copias da vm (pool, bench), nao custa 4kb em cada
+    void markPristine();
+
+    // volta pro estado do markPristine sem refazer o initialize: zera registradores, tela e
+    // teclado e copia de volta so as paginas de memoria escritas desde a imagem (o cache de
+    // decodificacao e os blocos das outras paginas continuam valendo)
+    // sem imagem cai no initialize. a semente do aleatorio nao muda, igual o initialize
+    void reset();
+
+    // usa a analise estatica da rom (analyzer.h, feita em cima da memoria atual): decodifica
+    // de uma vez todo o codigo alcancavel e, se ela provou que nenhuma escrita cai em cima de
+    // codigo, as escritas param de invalidar cache e o FX33/FX55 nao fecham mais bloco
+    // a prova vale ate o proximo loadROM/initialize/loadState
+    void useAnalysis(const RomAnalysis &a);
+
+    // a memoria inteira (4kb), so pra leitura (analise, depurador)
+    const uint8_t *memoryData() const { return memory; }
+
+    // fixa a semente do gerador aleatorio do CXNN (cada vm tem o seu)
+    void seed(uint32_t s) { rng_state = s ? s : 1; }
+
+    // marca uma tecla do chip8 (0x0 a 0xF) como pressionada ou solta
+    void setKey(uint8_t key, bool pressed);
 
     // atualiza os dois timers (delay e sound) que descem 60 vezes por segundo
     void tickTimers();
 
-    // funcao pra pegar o estado atual da tela
-    const uint8_t *video() const { return DISPLAY; }
+    // o beep toca enquanto o sound timer for maior que zero
+    bool isBeeping() const { return sound_timer > 0; }
+
+    // resolucao atual da tela: 64x32, ou 128x64 no hires do SUPER-CHIP
+    bool isHires() const { return hires; }
+    int width() const { return hires ? SCHIP_WIDTH : CHIP8_WIDTH; }
+    int height() const { return hires ? SCHIP_HEIGHT : CHIP8_HEIGHT; }
+
+    // funcao pra pegar o estado atual da tela, um byte por pixel (0 ou 1), width() x height()
+    // a tela de verdade eh guardada em bits, entao isso desempacota quando mudou algo
+    const uint8_t *video() const;
+
+    // a tela no formato interno: duas palavras de 64 bits por linha (128 colunas),
+    // bit 63 da primeira = coluna 0. em lores so a primeira palavra eh usada
+    const uint64_t *videoRows() const { return &DISPLAY[0][0]; }
+
+    // diz se a tela mudou (00E0 ou DXYN) desde a ultima chamada, e ja limpa a marca
+    // quem desenha usa isso pra nem apresentar frame quando nada mudou
+    bool takeDirty() {
+        bool d = frame_dirty;
+        frame_dirty = false;
+        return d;
+    }
+
+    // hash (fnv-1a) da tela atual, usado pra comparar execucoes
+    uint64_t videoHash() const;
+
+    // contadores de performance (vazios se compilou sem PERF=1)
+    // a vm conta instrucoes, sprites e timers, o loop principal soma o resto
+    PerfCounters &perf() { return perf_counters; }
+    const PerfCounters &perf() const { return perf_counters; }
+
+    // hash (fnv-1a) do estado inteiro (o mesmo que vai no saveState), usado no fim dos replays
+    uint64_t stateHash() const;
 
 private:
+    // o lockstep (lockstep.h) mexe direto nos registradores e chama o interpretador
+    friend class LockstepBatch;
+    // o depurador mostra e vigia os registradores e a pilha
+    friend class Debugger;
+
     // memoria e registradores do chip8
     uint8_t memory[4096]; // memoria total, 4kb
     uint8_t V[16]; // 16 registradores de 8 bits (v0 ate vf)
@@ -36,28 +248,163 @@ private:
     uint16_t stack[16]; // pilha pra chamadas de funcao (ate 16 niveis)
 
     // parte da tela e timers
-    uint8_t DISPLAY[CHIP8_WIDTH * CHIP8_HEIGHT]; // cada posicao eh um pixel (0 ou 1)
+    // uma linha sao 2 palavras (128 pixels, bit 63 da primeira = x 0), cabe o hires inteiro
+    // em lores so as 32 primeiras linhas e a primeira palavra delas sao usadas
+    uint64_t DISPLAY[SCHIP_HEIGHT][2];
+    bool hires; // 128x64 (00FF) ou 64x32 (00FE)
     uint8_t delay_timer; // timer que diminui sozinho (usado em animacoes)
-    uint8_t sound_timer; // timer do som, utilizado para nao dar erro por n ter implementado
+    uint8_t sound_timer; // timer do som, o beep toca enquanto for maior que zero
+
+    // copia desempacotada da tela que o video() devolve, refeita so quando a tela muda
+    mutable uint8_t video_buf[SCHIP_WIDTH * SCHIP_HEIGHT];
+    mutable bool video_stale;
+    bool frame_dirty; // tela mudou desde o ultimo takeDirty()
+
+    // estado do teclado, quem roda a vm (sdl ou headless) que atualiza
+    bool keypad[16];
+    int8_t wait_reg; // registrador que recebe a tecla do FX0A (-1 = nao ta esperando)
+    uint64_t cycle_count; // ciclos agendados desde o initialize (ver cycles())
+    bool halted; // rodou um 00FD
+
+    // flags do RPL do HP-48 (FX75/FX85 guardam e leem os registradores aqui)
+    uint8_t rpl[16];
+
+    // estado do gerador aleatorio (xorshift32), cada vm tem o seu
+    uint32_t rng_state;
+
+    // o que mudou desde o ultimo saveDelta/loadState: um bit por pagina de
+    // STATE_PAGE_SIZE bytes da memoria e um bit por linha da tela
+    uint64_t pages_dirty;
+    uint64_t rows_dirty;
+
+    // imagem limpa do reset(): memoria e pc inicial, e as paginas escritas desde ela
+    struct Pristine {
+        alignas(64) uint8_t memory[4096];
+        uint16_t pc;
+    };
+    std::shared_ptr<const Pristine> pristine;
+    uint64_t pages_touched;
+
+    PerfCounters perf_counters;
+
+    // cache de decodificacao, uma entrada pra cada endereco da memoria
+    // (quase sempre par, mas tem rom que pula pra endereco impar)
+    // escrita na memoria (FX33, FX55, loadROM) invalida as entradas afetadas
+    Instr decoded[4096];
+
+    // motor de execucao e cache de blocos basicos (so usado no ENGINE_BLOCK)
+    Engine engine;
+    QuirkProfile quirks;
+    bool idle_skip;
+    BlockCache<std::deque<Block>> blocks; // blocos compilados (deque pra os ponteiros nao mudarem)
+    // as duas tabelas so sao alocadas quando o motor de blocos roda a primeira vez,
+    // assim vm no interpretador (pool com milhares delas) nao paga esses 36kb
+    BlockCache<std::vector<Block *>> block_at; // endereco -> bloco que comeca nele (nullptr = sem bloco)
+    BlockCache<std::vector<uint8_t>> block_code; // 1 se o byte faz parte de algum bloco
+    bool blocks_dirty; // escreveram em cima de codigo de bloco, limpa antes do proximo
+    bool code_readonly; // analise provou que nenhuma escrita cai em codigo (useAnalysis)
+
+    // interpretador de uma instrucao por vez (ENGINE_SWITCH)
+    // os dois motores sao templates no perfil de quirks (Q = QuirksModern, QuirksVIP, ...)
+    // com Stop (so o lockstep usa) ainda para antes de qualquer instrucao marcada em stop[pc],
+    // menos a primeira, e devolve quantas rodou
+    // com Debug (runDebug) passa cada instrucao pelo dbg e para onde ele mandar
+    template <class Q, bool Stop = false, bool Debug = false>
+    int runSwitch(int cycles, const uint8_t *stop = nullptr, Debugger *dbg = nullptr);
+
+    // gancho do Debug depois de cada instrucao: grava o trace e, com watching, confere os
+    // watchpoints (before = V antes dela, i0 = I antes), true se a vm tem que parar
+    bool debugStep(Debugger &dbg, bool tracing, bool watching, uint16_t at, uint16_t opcode, const uint8_t *before,
+                   uint16_t i0);
+    // a parte dos watchpoints, fora do caminho quente
+    bool debugWatch(Debugger &dbg, uint16_t opcode, const uint8_t *before, uint16_t i0);
+
+    // executa por blocos (ENGINE_BLOCK), cai pro runSwitch quando o bloco nao cabe no que falta
+    template <class Q> int runBlocks(int cycles);
+
+    // chama o motor certo ja com o perfil resolvido
+    template <class Q> int runWith(int cycles);
+
+    // espera do delay timer (FX07, skip no mesmo vx, 1NNN de volta): jump eh o endereco do
+    // 1NNN e target o FX07. se o delay de agora segura a rom ali, gasta as left instrucoes
+    // que faltam de uma vez e devolve o pc onde ela para, senao -1
+    int idleLoop(uint16_t jump, uint16_t target, int left);
+
+    // monta o bloco que comeca em start e devolve ele
+    const Block &buildBlock(uint16_t start);
+
+    // joga fora todos os blocos
+    void flushBlocks();
+
+    // le os 2 bytes no endereco e monta o opcode
+    uint16_t fetch(uint16_t addr) const;
+
+    // transforma o opcode numa instrucao decodificada (escolhe o handler)
+    static Instr decode(uint16_t opcode);
+
+    // escreve um byte na memoria e invalida o cache daquele endereco
+    void writeMemory(uint16_t addr, uint8_t value);
+
+    // joga fora todo o cache de decodificacao
+    void flushDecodeCache();
+
+    // partes do save state (state.cpp): grava os registradores e restaura uma pagina
+    uint8_t *putRegs(uint8_t *p) const;
+    void restorePage(int page, const uint8_t *src);
 
     // funcoes que tratam cada tipo de instrucao
-    void op_00E0(); // limpa a tela
-    void op_00EE(); // retorna de uma subrotina
-    void op_1NNN(uint16_t opcode); // pula pra um endereco
-    void op_2NNN(uint16_t opcode); // chama subrotina
-    void op_3XNN(uint16_t opcode); // pula proxima instrucao se vx == nn
-    void op_4XNN(uint16_t opcode); // pula proxima instrucao se vx != nn
-    void op_5XY0(uint16_t opcode); // compara dois registradores
-    void op_6XNN(uint16_t opcode); // carrega um valor em vx
-    void op_7XNN(uint16_t opcode); // soma um valor em vx
-    void op_8XY_(uint16_t opcode); // varias operacoes logicas/aritmeticas
-    void op_9XY0(uint16_t opcode); // pula se vx != vy
-    void op_ANNN(uint16_t opcode); // seta registrador I
-    void op_BNNN(uint16_t opcode); // pula pra nnn + v0
-    void op_CXNN(uint16_t opcode); // gera numero aleatorio e faz AND
-    void op_DXYN(uint16_t opcode, Display &disp); // desenha sprite na tela
-    void op_EX__(uint16_t opcode, Keyboard &kb); // instrucoes de teclado
-    void op_FX__(uint16_t opcode, Keyboard &kb, Display &disp); // varias instrucoes de memoria e timer
-
-    void unknown(uint16_t opcode) const; // chamada quando pega uma instrucao invalida
-};
+    // as de desvio (pulo, chamada, skip) recebem o pc ja incrementado e devolvem o proximo pc
+    void op_00E0(const Instr &in); // limpa a tela
+    uint16_t op_00EE(const Instr &in, uint16_t pc); // retorna de uma subrotina
+    uint16_t op_1NNN(const Instr &in, uint16_t pc); // pula pra um endereco
+    uint16_t op_2NNN(const Instr &in, uint16_t pc); // chama subrotina
+    uint16_t op_3XNN(const Instr &in, uint16_t pc); // pula proxima instrucao se vx == nn
+    uint16_t op_4XNN(const Instr &in, uint16_t pc); // pula proxima instrucao se vx != nn
+    uint16_t op_5XY0(const Instr &in, uint16_t pc); // pula se vx == vy
+    void op_6XNN(const Instr &in); // carrega um valor em vx
+    void op_7XNN(const Instr &in); // soma um valor em vx
+    void op_8XY0(const Instr &in); // vx = vy
+    template <class Q> void op_8XY1(const Instr &in); // vx |= vy
+    template <class Q> void op_8XY2(const Instr &in); // vx &= vy
+    template <class Q> void op_8XY3(const Instr &in); // vx ^= vy
+    void op_8XY4(const Instr &in); // vx += vy com carry
+    void op_8XY5(const Instr &in); // vx -= vy com borrow
+    template <class Q> void op_8XY6(const Instr &in); // shift right
+    void op_8XY7(const Instr &in); // vx = vy - vx
+    template <class Q> void op_8XYE(const Instr &in); // shift left
+    uint16_t op_9XY0(const Instr &in, uint16_t pc); // pula se vx != vy
+    void op_ANNN(const Instr &in); // seta registrador I
+    template <class Q> uint16_t op_BNNN(const Instr &in, uint16_t pc); // pula pra nnn + v0 (ou xnn + vx)
+    void op_CXNN(const Instr &in); // gera numero aleatorio e faz AND
+    template <class Q> void op_DXYN(const Instr &in); // desenha sprite na tela
+    template <class Q> void op_DXY0(const Instr &in); // sprite 16x16 (SUPER-CHIP)
+    uint16_t op_EX9E(const Instr &in, uint16_t pc); // pula se tecla vx ta pressionada
+    uint16_t op_EXA1(const Instr &in, uint16_t pc); // pula se tecla vx nao ta pressionada
+    void op_FX07(const Instr &in); // le o delay timer
+    uint16_t op_FX0A(const Instr &in, uint16_t pc); // espera tecla
+    void op_FX15(const Instr &in); // seta delay timer
+    void op_FX18(const Instr &in); // seta sound timer
+    void op_FX1E(const Instr &in); // soma vx em I
+    void op_FX29(const Instr &in); // endereco da fonte do digito
+    void op_FX33(const Instr &in); // bcd de vx na memoria
+    template <class Q> void op_FX55(const Instr &in); // salva registradores na memoria
+    template <class Q> void op_FX65(const Instr &in); // carrega registradores da memoria
+    void op_00CN(const Instr &in); // rola a tela n linhas pra baixo
+    void op_00FB(const Instr &in); // rola a tela 4 pixels pra direita
+    void op_00FC(const Instr &in); // rola a tela 4 pixels pra esquerda
+    uint16_t op_00FD(const Instr &in, uint16_t pc); // sai do interpretador
+    void op_00FE(const Instr &in); // volta pro lores (64x32)
+    void op_00FF(const Instr &in); // liga o hires (128x64)
+    void op_FX30(const Instr &in); // endereco da fonte grande do digito
+    void op_FX75(const Instr &in); // salva v0..vx nas flags rpl
+    void op_FX85(const Instr &in); // carrega v0..vx das flags rpl
+    uint16_t op_unknown(const Instr &in, uint16_t pc); // opcode invalido
+
+    // desenha um sprite de 8 (ou 16, Wide) pixels de largura nas linhas da tela
+    template <class Q, bool Wide> void drawSprite(const Instr &in, int rows);
+
+    // a tela inteira mudou (limpou, rolou, trocou de resolucao)
+    void screenChanged();
+
+    void unknown(uint16_t opcode, uint16_t pc) const; // chamada quando pega uma instrucao invalida
+};
\ No newline at end of file
@@ -0,0 +1,182 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+
+class Chip8;
+
+// depurador: breakpoints por pc, watchpoints de memoria e de registrador, passo a passo,
+// visao dos registradores e da pilha e trace binario da execucao
+//
+// a vm so passa pelos ganchos quando roda pelo Debugger::run (Chip8::runDebug, uma copia do
+// interpretador com eles compilados dentro), o run() normal continua igual, sem custo nenhum
+//
+// trace: um registro de 10 bytes por instrucao num buffer circular, gravado no arquivo quando
+// enche. formato do arquivo:
+//   cabecalho: "C8TR", versao (1 byte), tamanho do registro (1), tamanho do snapshot (4),
+//              snapshot completo da vm no comeco do trace (Chip8::saveState)
+//   registros: TraceRecord, do jeito que ficam na memoria (little endian)
+// o registro so tem os valores depois da instrucao do que ela pode mudar (vx, vf, I, SP): o que
+// mudou de fato e o resto (memoria do FX33/FX55, v0..vx do FX65) o dumpTrace refaz a partir do
+// snapshot, assim o gancho nao precisa guardar nada antes de cada instrucao
+
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+
+// registros no buffer do trace (potencia de 2), 10 bytes cada: 1M = 10mb
+#define TRACE_DEFAULT_RECORDS (1u << 20)
+
+// tipo do registro
+enum : uint8_t {
+    TRACE_INSTR = 0, // instrucao executada
+    TRACE_KEY = 1    // a tecla do FX0A chegou entre dois runs (vx = tecla), pc = o FX0A
+};
+
+// uma instrucao executada
+struct TraceRecord {
+    uint16_t pc;     // endereco da instrucao
+    uint16_t opcode; // opcode lido antes de executar
+    uint16_t I;      // I depois da instrucao
+    uint8_t vx;      // Vx (o x do opcode) depois
+    uint8_t vf;      // VF depois
+    uint8_t sp;      // SP depois
+    uint8_t kind;    // TRACE_INSTR ou TRACE_KEY
+};
+
+static_assert(sizeof(TraceRecord) == 10, "TraceRecord vai pro arquivo do jeito que ta na memoria");
+
+// por que o run parou antes de acabar o orcamento
+enum DebugStop {
+    DEBUG_NONE,  // nao parou (rodou tudo, ou a vm parou sozinha no FX0A/00FD)
+    DEBUG_BREAK, // chegou num breakpoint (a instrucao dele ainda nao rodou)
+    DEBUG_WATCH, // a instrucao anterior mexeu num watchpoint
+    DEBUG_STEP,  // terminou os passos pedidos
+    DEBUG_PAUSE  // pausa pedida de fora (pause())
+};
+
+// registrador que da pra vigiar: V0..VF e o I
+#define DEBUG_REG_I 16
+
+class Debugger {
+public:
+    Debugger();
+    ~Debugger();
+
+    Debugger(const Debugger &) = delete;
+    Debugger &operator=(const Debugger &) = delete;
+
+    // breakpoint: para antes de rodar a instrucao em addr
+    void setBreak(uint16_t addr, bool on = true) { breaks[addr & 0x0FFF] = on; }
+    bool hasBreak(uint16_t addr) const { return breaks[addr & 0x0FFF]; }
+
+    // watchpoint de memoria: para depois de uma escrita (FX33/FX55) em addr, mesmo com o mesmo valor
+    void watchMemory(uint16_t addr, bool on = true) {
+        mem_watches += (int) on - (int) watch_mem[addr & 0x0FFF];
+        watch_mem[addr & 0x0FFF] = on;
+    }
+    // watchpoint de registrador (0..15 = Vx, DEBUG_REG_I): para quando o valor muda
+    void watchRegister(int reg, bool on = true);
+
+    // trace: path vazio guarda so na memoria (as ultimas records instrucoes, pro comando t
+    // do console), senao grava tudo no arquivo. records eh arredondado pra potencia de 2
+    bool startTrace(const Chip8 &vm, const std::string &path, size_t records = TRACE_DEFAULT_RECORDS);
+    // grava o que falta e fecha o arquivo (false se alguma escrita falhou)
+    bool stopTrace();
+    bool isTracing() const { return tracing; }
+    // instrucoes gravadas desde o startTrace
+    uint64_t traced() const { return base + (next - ring.data()); }
+
+    // roda cycles na vm igual vm.run(cycles), passando pelos ganchos. quando para
+    // (breakpoint, watchpoint, passos) mostra a parada no out do console e, se tem in,
+    // abre o prompt e segue depois dele. devolve quantas instrucoes rodaram
+    int run(Chip8 &vm, int cycles);
+
+    // console (normalmente stdin/stdout): sem in as paradas so aparecem no out e a vm segue
+    void setConsole(std::FILE *in, std::FILE *out) {
+        con_in = in;
+        con_out = out;
+    }
+    // para antes da proxima instrucao (o --debug comeca assim), pode vir de outra thread
+    void pause() { pause_req.store(true, std::memory_order_relaxed); }
+    // o usuario pediu pra sair no console (q)
+    bool quitRequested() const { return quit; }
+
+    // ultima parada e quantas foram
+    DebugStop lastStop() const { return last_stop; }
+    uint64_t stops() const { return stop_count; }
+
+    // visoes pro console e pra quem quiser mostrar o estado
+    static void printRegisters(std::FILE *out, const Chip8 &vm);
+    static void printStack(std::FILE *out, const Chip8 &vm);
+    static void printMemory(std::FILE *out, const Chip8 &vm, uint16_t addr, int len);
+    // count instrucoes desmontadas a partir de addr (marca o pc e os breakpoints)
+    void printCode(std::FILE *out, const Chip8 &vm, uint16_t addr, int count) const;
+    // as ultimas n instrucoes do buffer do trace
+    void printTrace(std::FILE *out, size_t n) const;
+
+    // le um trace gravado e mostra em texto (endereco, opcode, mnemonico e os valores novos
+    // do que mudou, refeitos a partir do snapshot do comeco), limit = 0 mostra tudo
+    static bool dumpTrace(const std::string &path, std::FILE *out, uint64_t limit = 0);
+
+private:
+    // o interpretador le direto os ganchos
+    friend class Chip8;
+
+    bool breaks[4096] = {};
+    bool watch_mem[4096] = {};
+    uint32_t watch_regs = 0; // bit por registrador (V0..VF, I no bit 16)
+    int mem_watches = 0;     // quantos enderecos tem watchpoint
+    std::atomic<bool> pause_req{false};
+
+    // buffer do trace: o proximo registro vai em next, quando chega em ring_end o buffer ta
+    // cheio (grava no arquivo ou da a volta). o registro n fica em ring[n & mask]
+    bool tracing = false;
+    std::vector<TraceRecord> ring;
+    TraceRecord *next = nullptr;
+    TraceRecord *ring_end = nullptr;
+    uint64_t mask = 0;
+    uint64_t base = 0;  // registros antes dessa volta do buffer
+    size_t written = 0; // ate onde essa volta ja foi pro arquivo
+    std::FILE *file = nullptr;
+    bool file_ok = true;
+    int waiting_reg = -1; // a vm tava no FX0A no fim do ultimo run (pro TRACE_KEY)
+
+    // parada
+    DebugStop stop = DEBUG_NONE;
+    DebugStop last_stop = DEBUG_NONE;
+    uint64_t stop_count = 0;
+    uint32_t watch_hit = 0;  // registradores que dispararam o watchpoint (bits do watch_regs)
+    int watch_addr = -1;     // ou o endereco de memoria que disparou
+    bool resume = false;     // acabou de parar nesse pc: o breakpoint dele nao conta de novo
+
+    // console
+    std::FILE *con_in = nullptr;
+    std::FILE *con_out = nullptr;
+    int steps = 0; // passos pedidos no console (0 = continua)
+    std::string last_cmd = "s"; // linha vazia repete
+    bool quit = false;
+
+    // chamado pela vm quando o buffer enche (fora do caminho quente)
+    void flushTrace();
+    // grava [written, next) do buffer no arquivo
+    void writeTrace();
+    // tem algum watchpoint (so ai a vm guarda os registradores antes de cada instrucao)
+    bool watching() const { return watch_regs || mem_watches; }
+    // poe um registro no buffer (a vm chama a cada instrucao)
+    void record(const TraceRecord &r) {
+        *next = r;
+        if (++next == ring_end) flushTrace();
+    }
+
+    // prompt do console, volta quando o usuario manda continuar, dar passos ou sair
+    void console(Chip8 &vm);
+    void printStop(std::FILE *out, const Chip8 &vm) const;
+    // a vm parou (stop): conta, mostra e abre o console
+    void halt(Chip8 &vm);
+};
+
+// alvo de breakpoint/watchpoint escrito pelo usuario: registrador ("v3", "i": reg = 0..15 ou
+// DEBUG_REG_I) ou endereco em hex ("2a4", "0x2A4": reg = -1 e addr). false se nao for nenhum
+bool parseDebugTarget(const char *s, int &reg, uint16_t &addr);
@@ -4,11 +4,57 @@
 #define CHIP8_WIDTH 64
 #define CHIP8_HEIGHT 32
 
+// modo hires do SUPER-CHIP (00FF liga, 00FE volta pro 64x32)
+#define SCHIP_WIDTH 128
+#define SCHIP_HEIGHT 64
+
+// onde fica a fonte grande (8x10) do SUPER-CHIP, logo depois da fonte normal
+#define BIGFONT_ADDR 0x50
+
 // endereco onde o programa começa na memoria
 #define DEFAULT_PC_START 0x200
 
+// tamanho maximo de um bloco basico no motor de blocos (em instrucoes)
+#define BLOCK_MAX_LEN 32
+
+// quantas vms andam juntas no lockstep (uma por lane de simd: 32 bytes = um registrador avx2)
+#define LOCKSTEP_LANES 32
+// trecho minimo (instrucoes com versao simd seguidas) pra valer sair do interpretador
+#define LOCKSTEP_MIN_RUN 4
+// o batch mede esse tanto de runs com e sem simd e fica no mais rapido; a espera ate a proxima
+// medida dobra enquanto a escolha se mantem, ate LOCKSTEP_PROBE_MAX runs
+#define LOCKSTEP_PROBE_RUNS 2
+#define LOCKSTEP_PROBE_MAX 1024
+
 // clock padrao (instruçoes por segundo)
 #define DEFAULT_CLOCK_HZ 700
 
+// maximo de frames atrasados que o loop principal recupera de uma vez
+// (mais que isso ele desiste do atraso pra nao entrar numa espiral)
+#define MAX_CATCHUP_FRAMES 5
+
 // escala padrao da janela (quantos pixels reais pra cada pixel do chip8)
 #define DEFAULT_SCALE 12
+
+// quantidade de frames que o modo headless roda se nao passar limite
+#define HEADLESS_DEFAULT_FRAMES 600
+
+// tamanho da pagina de memoria usada pra saber o que mudou entre dois snapshots
+// (4096 / 64 = 64 paginas, cabe o mapa inteiro numa palavra de 64 bits)
+#define STATE_PAGE_SIZE 64
+
+// rewind: quantos segundos de historico no maximo, de quantos em quantos frames
+// guarda um snapshot completo e a memoria padrao do buffer (em mb)
+#define REWIND_MAX_SECONDS 60
+#define REWIND_KEYFRAME_INTERVAL 30
+#define REWIND_DEFAULT_MB 2
+
+// audio: taxa de amostragem, tamanho do buffer do dispositivo (em amostras) e a nota do beep
+// o atraso maximo (ms) limita quanto som pode ficar na fila esperando o dispositivo, o loop da
+// emulacao completa a fila ate AUDIO_TARGET_MS (ms) pelo menos a cada AUDIO_PUMP_MS (ms)
+#define AUDIO_SAMPLE_RATE 44100
+#define AUDIO_DEVICE_SAMPLES 256
+#define AUDIO_TONE_HZ 440
+#define AUDIO_MAX_LATENCY_MS 20
+#define AUDIO_TARGET_MS 10
+#define AUDIO_PUMP_MS 4
@@ -13,11 +13,16 @@ public:
     bool init(int scale);
 
     // desenha os pixels na tela baseado no buffer da vm
-    void draw(const uint8_t* framebuffer, int r_color = 255, int g_color = 255, int b_color = 255);
+    // o buffer (width x height, 64x32 ou 128x64 no hires) vai pra textura e o renderer
+    // estica pro tamanho da janela
+    void draw(const uint8_t* framebuffer, int width, int height, int r_color = 255, int g_color = 255, int b_color = 255);
 
     // limpa a tela
     void clear();
 
+    // troca o titulo da janela
+    void setTitle(const char *title);
+
     // fecha a janela e destroi os recursos
     void shutdown();
 
@@ -27,5 +32,6 @@ public:
 private:
     SDL_Window *window; // janela do sdl
     SDL_Renderer *renderer; // renderizador do sdl
+    SDL_Texture *texture; // textura streaming do tamanho da tela hires
     int scale; // escala do tamanho da tela
 };
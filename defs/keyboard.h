@@ -13,9 +13,6 @@ public:
     // verifica se uma tecla do chip8 (0x0 a 0xF) esta pressionada
     bool isPressed(uint8_t chip8_key) const;
 
-    // bloqueia ate alguma tecla valida ser pressionada (usado no opcode fx0a)
-    int waitForKey();
-
 private:
     bool keys[16]; // cada posicao representa uma tecla (true = pressionada)
 };
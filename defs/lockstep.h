@@ -0,0 +1,135 @@
+#pragma once
+#include <cstdint>
+#include "chip8.h"
+
+// execucao em lockstep: ate LOCKSTEP_LANES vms rodando a mesma rom (fuzzing: mesma rom com
+// sementes ou entradas diferentes) andam juntas, uma lane de simd por vm
+// V, I, pc, timers, pilha e o aleatorio ficam numa estrutura de arrays (um registrador de todas
+// as lanes lado a lado), ula, skips, pulos, timers e CXNN rodam pra todas as lanes do grupo de uma
+// vez (sse2/avx2). teclas, chamadas e a espera do delay timer andam lane por lane dentro do kernel,
+// desenho e memoria vao pro handler da vm de cada lane sem separar o grupo (laneOp). o resto cai
+// pro interpretador de cada vm, uma lane por vez
+//
+// o grupo eh o conjunto de lanes com o menor pc: quando um skip separa as lanes, as que ficaram
+// pra tras rodam primeiro e alcancam as outras (reconvergem) no mesmo endereco
+// cada lane roda exatamente as instrucoes que o Chip8::run rodaria, o estado no fim eh o mesmo
+//
+// com as lanes muito separadas o simd perde pro Chip8::run de cada vm, entao o batch mede os
+// dois jeitos de vez em quando e roda no que tiver saido mais rapido (LOCKSTEP_PROBE_RUNS). se
+// o jeito escolhido ficar mais caro que o outro tava (as lanes se separaram no meio do jogo)
+// ele mede de novo antes da hora
+
+// estado das lanes durante o run (so o kernel mexe), linha = registrador, coluna = lane
+struct alignas(32) LockstepLanes {
+    uint8_t V[16][LOCKSTEP_LANES];
+    uint8_t delay[LOCKSTEP_LANES];
+    uint8_t sound[LOCKSTEP_LANES];
+    uint16_t I[LOCKSTEP_LANES];
+    uint16_t PC[LOCKSTEP_LANES];
+    uint16_t done[LOCKSTEP_LANES]; // instrucoes rodadas na rodada atual do run
+    uint16_t stack[16][LOCKSTEP_LANES];
+    uint8_t SP[LOCKSTEP_LANES];
+    uint16_t keys[LOCKSTEP_LANES]; // bit k = tecla k apertada (nao muda dentro do run)
+    uint32_t rng[LOCKSTEP_LANES]; // gerador do CXNN de cada lane
+    uint32_t active; // bit por lane: ainda tem orcamento e nao parou (FX0A, 00FD)
+    uint32_t pressed; // bit por lane: tem alguma tecla apertada
+    bool readonly; // todas com o codigo provado so leitura (useAnalysis): escrita nao muda instrucao
+    uint64_t touched; // paginas escritas em alguma lane (ali o codigo pode ter mudado)
+    uint64_t vector; // instrucoes (somando as lanes) que rodaram no kernel
+};
+
+class LockstepBatch {
+public:
+    // lanes = vms[0..count), count <= LOCKSTEP_LANES. as vms continuam sendo o estado de
+    // verdade, o batch so junta os registradores durante o run e devolve no fim
+    // o lockstep so liga se todas tiverem o mesmo perfil de quirks e a mesma imagem limpa
+    // (markPristine depois do loadROM), senao o run roda cada vm sozinha
+    LockstepBatch(Chip8 *vms, int count);
+
+    // roda cycles instrucoes em cada vm (igual chamar vm.run(cycles) em todas)
+    // devolve quantas instrucoes rodaram somando as lanes
+    uint64_t run(int cycles);
+
+    // roda frames frames seguidos a partir do frame first, igual o worker do VMPool: os ciclos
+    // de cada um vem do Scheduler::frameCycles e os timers andam no fim dele. sem simd cada vm
+    // roda a fatia inteira de uma vez (fica no cache), em simd eh um run por frame
+    uint64_t runFrames(uint64_t first, int frames, int clock_hz);
+
+    // true se as lanes podem rodar em simd (senao eh sempre uma vm por vez)
+    bool isLockstep() const { return lockstep; }
+    // runs (ou fatias do runFrames) que foram em simd e os que foram uma vm por vez (a medida escolheu)
+    uint64_t simdRuns() const { return runs[1]; }
+    uint64_t soloRuns() const { return runs[0]; }
+
+    // conjunto de instrucoes usado nos kernels: "avx2", "sse2" ou "scalar"
+    static const char *isa();
+
+    // instrucoes (somando as lanes) que rodaram no kernel simd e no interpretador
+    uint64_t vectorInstructions() const { return lanes.vector; }
+    uint64_t scalarInstructions() const { return scalar_instrs; }
+
+    // roda a lane no interpretador dela ate o done chegar em cycles ou a lane parar (sai do
+    // active). o kernel chama quando a instrucao nao tem versao simd ou o codigo ali pode ter
+    // mudado, e a lane volta assim que chegar numa que tem. alone eh pra lane sozinha no grupo:
+    // ela so volta quando chegar no pc de outra lane ativa (ai as duas andam juntas de novo)
+    void scalarRun(int lane, int cycles, bool alone);
+
+    // roda na vm da lane uma instrucao que nao mexe no pc (desenho, tela, FX33/FX55/FX65), o
+    // kernel chama pra cada lane do grupo e segue com ele junto. so os registradores que a
+    // instrucao le vao pra vm e so os que ela escreve voltam
+    void laneOp(int lane, const Instr &in, uint16_t pc);
+
+private:
+    Chip8 *vms;
+    int count;
+    bool lockstep;
+    LockstepLanes lanes;
+    uint64_t scalar_instrs = 0;
+
+    // a rom decodificada uma vez a partir da imagem limpa (vale nas paginas nao escritas)
+    // e quantas instrucoes com versao simd seguidas comecam em cada endereco
+    Instr decoded[4096];
+    uint8_t simd_run[4096];
+
+    // onde o interpretador devolve a lane pro kernel: enter = comeco de trecho simd que
+    // compensa, parked = onde tem outra lane parada (montado pelo scalarRun da lane sozinha)
+    uint8_t enter[4096];
+    uint8_t parked[4096];
+
+    // qual jeito o run usa agora (true = simd) e a medida que escolhe, indice 0 = vm por vez
+    bool simd = true;
+    int gate_left = 0;  // runs ate a proxima medida
+    int gate_wait = LOCKSTEP_PROBE_RUNS; // e a espera que ela teve
+    int gate_probe = 0; // runs ja medidos (alternando os dois jeitos)
+    double gate_ns[2] = {};
+    double gate_cost = 0;  // ns por instrucao do jeito atual (media dos ultimos runs)
+    double gate_rival = 0; // e do outro, na ultima medida
+    uint64_t gate_instrs[2] = {};
+    uint64_t runs[2] = {};
+
+    // roda go(true) (simd) ou go(false) (vm por vez), o que a medida escolheu; medindo, alterna
+    template <class F> uint64_t gate(F &&go);
+    // um run em simd (kernel) ou com cada vm no Chip8::run dela
+    uint64_t runLanes(int cycles);
+    uint64_t runSolo(int cycles);
+
+    // copia os registradores da vm pra coluna da lane e de volta
+    void pull(int lane);
+    void push(int lane);
+};
+
+// kernel de um conjunto de instrucoes: roda as lanes do active ate todas chegarem em cycles
+// (um por perfil de quirks, igual o interpretador)
+// nao usa nada inline da Chip8: o kernel avx2 compila com -mavx2 e nao pode deixar
+// copia dessas funcoes com avx2 pro resto do programa
+using LockstepKernel = void (*)(LockstepBatch &b, LockstepLanes &s, const Instr *code, const uint8_t *runs,
+                                int cycles);
+
+struct LockstepKernels {
+    LockstepKernel modern, vip, chip48, schip;
+};
+
+// kernels de cada isa (lockstep.cpp e lockstep_avx2.cpp), nullptr se nao compilou pra essa maquina
+const LockstepKernels *lockstepKernelsAvx2();
+const LockstepKernels *lockstepKernelsSse2();
+const LockstepKernels *lockstepKernelsScalar();
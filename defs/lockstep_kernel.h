@@ -0,0 +1,340 @@
+#pragma once
+#include "lockstep.h"
+
+// corpo do kernel do lockstep, incluido por cada arquivo de isa (lockstep.cpp, lockstep_avx2.cpp)
+// L eh o conjunto de operacoes de lanes daquela isa (LanesSse2, LanesAvx2, LanesScalar):
+//   B = 32 bytes (um registrador de todas as lanes), W = 32 palavras de 16 bits (I, pc, done)
+//   loadB/storeB/set1B, addB/subB/andB/orB/xorB, eqB/geB (0xFF onde vale), shr1B/shl1B/shr7B,
+//   blendB(a, b, m) = m ? b : a, bitsB(bits) = mascara de um bitmap de lanes, moveB = o contrario
+//   loadW/storeW/set1W/addW/blendW/bitsW, widenB (bytes -> palavras), eqW (bitmap das lanes
+//   iguais a v), minW/maxW (valores sempre menores que 0x8000)
+//   randB(rng, bits) = passo do xorshift32 nas lanes do bitmap, devolve o byte de cima de cada uma
+// tudo aqui fica num namespace anonimo: cada arquivo gera a sua copia com as flags dele
+
+namespace {
+
+// paginas onde ficam os dois bytes da instrucao em a
+inline uint64_t lockstepPages(uint16_t a) {
+    return (1ULL << (a / STATE_PAGE_SIZE)) | (1ULL << (((a + 1) & 0x0FFF) / STATE_PAGE_SIZE));
+}
+
+// instrucoes que o handler da vm roda lane por lane sem mexer no pc (LockstepBatch::laneOp)
+inline bool lockstepLaneOp(uint8_t op) {
+    switch (op) {
+        case OP_00E0: case OP_DXYN: case OP_DXY0: case OP_FX33: case OP_FX55: case OP_FX65:
+        case OP_00CN: case OP_00FB: case OP_00FC: case OP_00FE: case OP_00FF:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// instrucoes que o kernel roda com o grupo junto (as mesmas do switch dele), o resto vai pro
+// interpretador
+inline bool lockstepSimd(uint8_t op) {
+    switch (op) {
+        case OP_6XNN: case OP_7XNN: case OP_8XY0: case OP_8XY1: case OP_8XY2: case OP_8XY3:
+        case OP_8XY4: case OP_8XY5: case OP_8XY6: case OP_8XY7: case OP_8XYE:
+        case OP_3XNN: case OP_4XNN: case OP_5XY0: case OP_9XY0: case OP_1NNN: case OP_ANNN:
+        case OP_FX1E: case OP_FX07: case OP_FX15: case OP_FX18: case OP_CXNN: case OP_FX29:
+        case OP_EX9E: case OP_EXA1: case OP_2NNN: case OP_00EE:
+            return true;
+        default:
+            return lockstepLaneOp(op);
+    }
+}
+
+template <class L, class Q>
+void lockstepKernel(LockstepBatch &b, LockstepLanes &s, const Instr *code, const uint8_t *runs, int cycles) {
+    using B = typename L::B;
+    using W = typename L::W;
+    const B one = L::set1B(1);
+
+    while (s.active) {
+        // grupo: as lanes ativas com o menor pc, o orcamento eh o que falta pra mais adiantada
+        W pcs = L::loadW(s.PC);
+        uint16_t pc = L::minW(L::blendW(L::set1W(0x7FFF), pcs, L::bitsW(s.active)));
+        uint32_t group = L::eqW(pcs, pc) & s.active;
+        W gw = L::bitsW(group);
+        int budget = cycles - L::maxW(L::blendW(L::set1W(0), L::loadW(s.done), gw));
+        if ((group & (group - 1)) == 0) {
+            // lane sozinha: nao compensa o simd, segue no interpretador ate encontrar outra
+            b.scalarRun(__builtin_ctz(group), cycles, true);
+            s.active &= ~(L::eqW(L::loadW(s.done), (uint16_t) cycles) & group);
+            continue;
+        }
+        if (runs[pc & 0x0FFF] < LOCKSTEP_MIN_RUN || (!s.readonly && (s.touched & lockstepPages(pc & 0x0FFF)))) {
+            // trecho simd curto demais (ou codigo que pode ter mudado): cada lane no interpretador
+            for (uint32_t g = group; g; g &= g - 1) b.scalarRun(__builtin_ctz(g), cycles, false);
+            s.active &= ~(L::eqW(L::loadW(s.done), (uint16_t) cycles) & group);
+            continue;
+        }
+        const B m = L::bitsB(group);
+
+        int steps = 0;
+        uint32_t split = 0; // lanes do grupo que pularam no ultimo skip (ficam em pc + 2)
+        bool spread = false; // cada lane foi pra um pc (ficou no to)
+        uint16_t to[LOCKSTEP_LANES];
+        bool scalar = false;
+        while (steps < budget) {
+            uint16_t a = pc & 0x0FFF;
+            if (!s.readonly && (s.touched & lockstepPages(a))) {
+                // alguma lane escreveu ali: o codigo pode ser diferente em cada uma
+                scalar = true;
+                break;
+            }
+            const Instr &in = code[a];
+            uint8_t *vx = s.V[in.x];
+            uint8_t *vy = s.V[in.y];
+            uint8_t *vf = s.V[0xF];
+            uint32_t taken = 0;
+            bool skip = false;
+
+            // mesma ordem de leitura e escrita do interpretador (vale quando x ou y eh o vf)
+            switch (in.op) {
+                case OP_6XNN:
+                    L::storeB(vx, L::blendB(L::loadB(vx), L::set1B(in.nn), m));
+                    break;
+                case OP_7XNN:
+                    L::storeB(vx, L::blendB(L::loadB(vx), L::addB(L::loadB(vx), L::set1B(in.nn)), m));
+                    break;
+                case OP_8XY0:
+                    L::storeB(vx, L::blendB(L::loadB(vx), L::loadB(vy), m));
+                    break;
+                case OP_8XY1:
+                    L::storeB(vx, L::blendB(L::loadB(vx), L::orB(L::loadB(vx), L::loadB(vy)), m));
+                    if constexpr (Q::vf_reset) L::storeB(vf, L::blendB(L::loadB(vf), L::set1B(0), m));
+                    break;
+                case OP_8XY2:
+                    L::storeB(vx, L::blendB(L::loadB(vx), L::andB(L::loadB(vx), L::loadB(vy)), m));
+                    if constexpr (Q::vf_reset) L::storeB(vf, L::blendB(L::loadB(vf), L::set1B(0), m));
+                    break;
+                case OP_8XY3:
+                    L::storeB(vx, L::blendB(L::loadB(vx), L::xorB(L::loadB(vx), L::loadB(vy)), m));
+                    if constexpr (Q::vf_reset) L::storeB(vf, L::blendB(L::loadB(vf), L::set1B(0), m));
+                    break;
+                case OP_8XY4: {
+                    B x = L::loadB(vx);
+                    B sum = L::addB(x, L::loadB(vy));
+                    // carry quando a soma deu a volta (ficou menor que o vx)
+                    B carry = L::andB(L::xorB(L::geB(sum, x), L::set1B(0xFF)), one);
+                    L::storeB(vf, L::blendB(L::loadB(vf), carry, m));
+                    L::storeB(vx, L::blendB(L::loadB(vx), sum, m));
+                    break;
+                }
+                case OP_8XY5: {
+                    B flag = L::andB(L::geB(L::loadB(vx), L::loadB(vy)), one);
+                    L::storeB(vf, L::blendB(L::loadB(vf), flag, m));
+                    B x = L::loadB(vx);
+                    L::storeB(vx, L::blendB(x, L::subB(x, L::loadB(vy)), m));
+                    break;
+                }
+                case OP_8XY6: {
+                    if constexpr (Q::shift_vy) L::storeB(vx, L::blendB(L::loadB(vx), L::loadB(vy), m));
+                    L::storeB(vf, L::blendB(L::loadB(vf), L::andB(L::loadB(vx), one), m));
+                    B x = L::loadB(vx);
+                    L::storeB(vx, L::blendB(x, L::shr1B(x), m));
+                    break;
+                }
+                case OP_8XY7: {
+                    B flag = L::andB(L::geB(L::loadB(vy), L::loadB(vx)), one);
+                    L::storeB(vf, L::blendB(L::loadB(vf), flag, m));
+                    B x = L::loadB(vx);
+                    L::storeB(vx, L::blendB(x, L::subB(L::loadB(vy), x), m));
+                    break;
+                }
+                case OP_8XYE: {
+                    if constexpr (Q::shift_vy) L::storeB(vx, L::blendB(L::loadB(vx), L::loadB(vy), m));
+                    L::storeB(vf, L::blendB(L::loadB(vf), L::shr7B(L::loadB(vx)), m));
+                    B x = L::loadB(vx);
+                    L::storeB(vx, L::blendB(x, L::shl1B(x), m));
+                    break;
+                }
+                case OP_3XNN:
+                    taken = L::moveB(L::eqB(L::loadB(vx), L::set1B(in.nn)));
+                    skip = true;
+                    break;
+                case OP_4XNN:
+                    taken = ~L::moveB(L::eqB(L::loadB(vx), L::set1B(in.nn)));
+                    skip = true;
+                    break;
+                case OP_5XY0:
+                    taken = L::moveB(L::eqB(L::loadB(vx), L::loadB(vy)));
+                    skip = true;
+                    break;
+                case OP_9XY0:
+                    taken = ~L::moveB(L::eqB(L::loadB(vx), L::loadB(vy)));
+                    skip = true;
+                    break;
+                case OP_1NNN:
+                    if (in.nnn == a) {
+                        // pulo pra ele mesmo: o grupo inteiro fica parado ate o fim do orcamento
+                        steps = budget;
+                        pc = in.nnn;
+                        continue;
+                    }
+                    if (in.nnn < a && code[in.nnn].op == OP_FX07 && code[(in.nnn + 2) & 0x0FFF].x == code[in.nnn].x &&
+                        (code[(in.nnn + 2) & 0x0FFF].op == OP_3XNN || code[(in.nnn + 2) & 0x0FFF].op == OP_4XNN)) {
+                        // cara de espera do delay timer: igual o Chip8::idleLoop, a lane que nao sai
+                        // do laco com o delay de agora gasta o resto do orcamento de uma vez. so
+                        // quando o grupo todo fica (as que saem separam no skip e o resto volta aqui)
+                        uint16_t t = in.nnn, at = (t + 2) & 0x0FFF;
+                        const Instr &test = code[at];
+                        if (!s.readonly && (s.touched & (lockstepPages(t) | lockstepPages(at)))) {
+                            scalar = true;
+                            break;
+                        }
+                        uint32_t stay = 0;
+                        for (uint32_t g = group; g; g &= g - 1) {
+                            int l = __builtin_ctz(g);
+                            bool skips = (test.op == OP_3XNN) == (s.delay[l] == test.nn);
+                            if (((at + (skips ? 4 : 2)) & 0x0FFF) == a) stay |= 1u << l;
+                        }
+                        if (stay == group) {
+                            ++steps;
+                            for (uint32_t g = group; g; g &= g - 1) {
+                                int l = __builtin_ctz(g);
+                                // as left instrucoes depois desse 1NNN sao FX07, skip, 1NNN, FX07, ...
+                                int left = cycles - s.done[l] - steps;
+                                if (left > 0) s.V[test.x][l] = s.delay[l];
+                                to[l] = left % 3 == 0 ? t : left % 3 == 1 ? at : a;
+                                s.vector += (uint64_t) left;
+                                s.done[l] = (uint16_t) (cycles - steps);
+                            }
+                            spread = true;
+                            break;
+                        }
+                    }
+                    pc = in.nnn;
+                    ++steps;
+                    continue;
+                case OP_2NNN: {
+                    // pilha cheia em alguma lane: o interpretador dela avisa do estouro
+                    bool full = false;
+                    for (uint32_t g = group; g; g &= g - 1) full |= s.SP[__builtin_ctz(g)] >= 16;
+                    if (full) {
+                        scalar = true;
+                        break;
+                    }
+                    for (uint32_t g = group; g; g &= g - 1) {
+                        int l = __builtin_ctz(g);
+                        s.stack[s.SP[l]++][l] = (uint16_t) (a + 2);
+                    }
+                    pc = in.nnn;
+                    ++steps;
+                    continue;
+                }
+                case OP_00EE: {
+                    bool empty = false;
+                    for (uint32_t g = group; g; g &= g - 1) empty |= s.SP[__builtin_ctz(g)] == 0;
+                    if (empty) {
+                        scalar = true;
+                        break;
+                    }
+                    // cada lane volta pro que tem na pilha dela: se der tudo igual o grupo segue
+                    uint16_t back = s.stack[s.SP[__builtin_ctz(group)] - 1][__builtin_ctz(group)];
+                    for (uint32_t g = group; g; g &= g - 1) {
+                        int l = __builtin_ctz(g);
+                        to[l] = s.stack[--s.SP[l]][l];
+                        spread |= to[l] != back;
+                    }
+                    ++steps;
+                    if (spread) break;
+                    pc = back;
+                    continue;
+                }
+                case OP_EX9E: case OP_EXA1: {
+                    // as teclas nao mudam no meio do run: sem tecla apertada no grupo nao precisa olhar
+                    uint32_t down = 0;
+                    for (uint32_t g = group & s.pressed; g; g &= g - 1) {
+                        int l = __builtin_ctz(g);
+                        uint8_t k = s.V[in.x][l];
+                        if (k <= 0xF && ((s.keys[l] >> k) & 1)) down |= 1u << l;
+                    }
+                    taken = in.op == OP_EX9E ? down : ~down;
+                    skip = true;
+                    break;
+                }
+                case OP_FX29: {
+                    W v = L::widenB(L::loadB(vx));
+                    W v2 = L::addW(v, v);
+                    L::storeW(s.I, L::blendW(L::loadW(s.I), L::addW(L::addW(v2, v2), v), gw));
+                    break;
+                }
+                case OP_ANNN:
+                    L::storeW(s.I, L::blendW(L::loadW(s.I), L::set1W(in.nnn), gw));
+                    break;
+                case OP_FX1E: {
+                    W i = L::loadW(s.I);
+                    L::storeW(s.I, L::blendW(i, L::addW(i, L::widenB(L::loadB(vx))), gw));
+                    break;
+                }
+                case OP_CXNN: {
+                    B r = L::andB(L::randB(s.rng, group), L::set1B(in.nn));
+                    L::storeB(vx, L::blendB(L::loadB(vx), r, m));
+                    break;
+                }
+                case OP_FX07:
+                    L::storeB(vx, L::blendB(L::loadB(vx), L::loadB(s.delay), m));
+                    break;
+                case OP_FX15:
+                    L::storeB(s.delay, L::blendB(L::loadB(s.delay), L::loadB(vx), m));
+                    break;
+                case OP_FX18:
+                    L::storeB(s.sound, L::blendB(L::loadB(s.sound), L::loadB(vx), m));
+                    break;
+                default:
+                    if (lockstepLaneOp(in.op)) {
+                        for (uint32_t g = group; g; g &= g - 1) b.laneOp(__builtin_ctz(g), in, a);
+                        break;
+                    }
+                    scalar = true;
+                    break;
+            }
+            if (scalar || spread) break;
+            ++steps;
+            pc = a + 2;
+            if (skip) {
+                taken &= group;
+                if (taken == group) {
+                    pc += 2;
+                } else if (taken) {
+                    // as lanes se separaram: fecha o grupo aqui, as que pularam ficam pra depois
+                    split = taken;
+                    break;
+                }
+            }
+        }
+
+        // devolve o pc e o que o grupo rodou pras lanes
+        s.vector += (uint64_t) steps * (uint64_t) __builtin_popcount(group);
+        W done = L::addW(L::loadW(s.done), L::set1W((uint16_t) steps));
+        L::storeW(s.done, L::blendW(L::loadW(s.done), done, gw));
+        pcs = L::blendW(pcs, L::set1W(pc), gw);
+        if (split) pcs = L::blendW(pcs, L::set1W(pc + 2), L::bitsW(split));
+        L::storeW(s.PC, pcs);
+        if (spread) {
+            for (uint32_t g = group; g; g &= g - 1) s.PC[__builtin_ctz(g)] = to[__builtin_ctz(g)];
+        }
+
+        // instrucao sem versao simd: cada lane do grupo vai no proprio interpretador
+        // ate voltar pra uma que tenha
+        if (scalar && steps < budget) {
+            for (uint32_t g = group; g; g &= g - 1) b.scalarRun(__builtin_ctz(g), cycles, false);
+        }
+        s.active &= ~(L::eqW(L::loadW(s.done), (uint16_t) cycles) & group);
+    }
+}
+
+template <class L>
+const LockstepKernels *lockstepKernels() {
+    static constexpr LockstepKernels k = {
+        &lockstepKernel<L, QuirksModern>,
+        &lockstepKernel<L, QuirksVIP>,
+        &lockstepKernel<L, QuirksChip48>,
+        &lockstepKernel<L, QuirksSChip>,
+    };
+    return &k;
+}
+
+} // namespace
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "quirks.h"
+
+// gravacao de input pra replay (filme)
+// com a mesma rom, a mesma semente do aleatorio, o mesmo clock e as teclas aplicadas
+// no mesmo ciclo, a vm chega exatamente no mesmo estado, entao o filme so precisa disso
+//
+// formato binario (little endian):
+//   cabecalho: "C8MV", versao (1 byte), semente (4), clock (4), hash da rom (8),
+//              perfil de quirks (1, so a partir da versao 2; a versao 1 eh sempre modern)
+//   registros: tipo (1 byte) + dados
+//     MOVIE_KEY: ciclo (8), tecla (1), 1 = apertou / 0 = soltou (1)
+//     MOVIE_END: ciclo final (8), hash do estado final (8)
+// o ciclo eh o Chip8::cycles() na hora que a tecla foi aplicada
+// filme sem MOVIE_END (programa fechou no meio) ainda toca, so nao da pra conferir o final
+
+#define MOVIE_MAGIC "C8MV"
+#define MOVIE_VERSION 2
+
+enum MovieRecord : uint8_t {
+    MOVIE_KEY = 1,
+    MOVIE_END = 2
+};
+
+// tecla apertada ou solta num ciclo
+struct MovieEvent {
+    uint64_t cycle;
+    uint8_t key;
+    bool pressed;
+};
+
+// filme inteiro lido do arquivo
+struct Movie {
+    uint32_t seed = 0;
+    int clock_hz = 0;
+    uint64_t rom_hash = 0;
+    QuirkProfile quirks = QUIRKS_MODERN;
+    std::vector<MovieEvent> events;
+    bool finished = false; // tem o registro de fim
+    uint64_t end_cycle = 0;
+    uint64_t end_hash = 0;
+};
+
+// grava o filme conforme a vm roda
+class MovieWriter {
+public:
+    bool open(const std::string &path, uint32_t seed, int clock_hz, uint64_t rom_hash, QuirkProfile quirks);
+    bool isOpen() const { return out.is_open(); }
+
+    // tecla mudou de estado no ciclo
+    void key(uint64_t cycle, uint8_t key, bool pressed);
+
+    // fecha o filme com o ciclo e o hash do estado no final
+    bool finish(uint64_t cycle, uint64_t state_hash);
+
+private:
+    std::ofstream out;
+};
+
+// le um filme inteiro (false se o arquivo nao existe ou o formato ta errado)
+bool loadMovie(const std::string &path, Movie &movie);
+
+// hash (romHash) dos bytes de uma rom, arquivo ou entrada de zip, usado pra conferir se o filme eh da mesma rom
+bool fileHash(const std::string &path, uint64_t &hash);
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <chrono>
+
+// contadores de performance, ligados so quando compila com make PERF=1 (CHIP8_PERF=1)
+// desligado o PerfCounters vira uma struct vazia com funcoes vazias, entao as chamadas
+// espalhadas pela vm e pelo loop principal somem na compilacao (custo zero)
+#ifndef CHIP8_PERF
+#define CHIP8_PERF 0
+#endif
+
+// arquivo onde os contadores sao gravados (F10 e na saida)
+#define PERF_JSON_PATH "chip8-perf.json"
+
+// maior numero de instrucoes diferentes que da pra contar (o enum Op tem que caber)
+#define PERF_MAX_OPS 64
+
+// onde o tempo do loop principal eh medido
+enum PerfTimer {
+    PERF_EMULATION, // rodando a vm (run + timers), na thread da emulacao
+    PERF_DRAW,      // Display::draw, na thread principal
+    PERF_EVENTS,    // tratando eventos do sdl, na thread principal
+    PERF_TIMERS
+};
+
+template <bool Enabled>
+struct PerfCountersT {
+    static constexpr bool enabled = Enabled;
+
+    uint64_t ops[PERF_MAX_OPS] = {}; // instrucoes executadas por tipo (indice = Op)
+    uint64_t sprites = 0;            // DXYN executados
+    uint64_t pixels = 0;             // pixels alternados pelo DXYN
+    uint64_t collisions = 0;         // DXYN que deram colisao (vf = 1)
+    uint64_t timer_ticks = 0;        // chamadas do tickTimers (frames da vm)
+    uint64_t frames_drawn = 0;       // frames que foram pra tela
+    uint64_t frames_skipped = 0;     // frames em que a tela nao mudou e o draw foi pulado
+    uint64_t ns[PERF_TIMERS] = {};   // tempo gasto em cada parte, em nanossegundos
+
+    void op(uint8_t o, uint64_t n = 1) { ops[o] += n; }
+    void unop(uint8_t o) { --ops[o]; } // contou adiantado uma que acabou nao rodando
+    void sprite(int px, bool collided) {
+        ++sprites;
+        pixels += px;
+        collisions += collided;
+    }
+    void timerTick() { ++timer_ticks; }
+    void frame(bool drawn) { ++(drawn ? frames_drawn : frames_skipped); }
+
+    // begin devolve o instante atual, end soma o tempo desde ele no contador
+    uint64_t begin() const {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    void end(PerfTimer t, uint64_t start) { ns[t] += begin() - start; }
+    void addTime(PerfTimer t, uint64_t nanos) { ns[t] += nanos; }
+
+    // soma os contadores de outro (cada thread conta no seu e junta na hora de gravar)
+    void merge(const PerfCountersT &o) {
+        for (int i = 0; i < PERF_MAX_OPS; ++i) ops[i] += o.ops[i];
+        sprites += o.sprites;
+        pixels += o.pixels;
+        collisions += o.collisions;
+        timer_ticks += o.timer_ticks;
+        frames_drawn += o.frames_drawn;
+        frames_skipped += o.frames_skipped;
+        for (int i = 0; i < PERF_TIMERS; ++i) ns[i] += o.ns[i];
+    }
+
+    void reset() { *this = PerfCountersT(); }
+};
+
+// versao desligada: nada guardado, nada feito
+template <>
+struct PerfCountersT<false> {
+    static constexpr bool enabled = false;
+
+    void op(uint8_t, uint64_t = 1) {}
+    void unop(uint8_t) {}
+    void sprite(int, bool) {}
+    void timerTick() {}
+    void frame(bool) {}
+    uint64_t begin() const { return 0; }
+    void end(PerfTimer, uint64_t) {}
+    void addTime(PerfTimer, uint64_t) {}
+    void merge(const PerfCountersT &) {}
+    void reset() {}
+};
+
+using PerfCounters = PerfCountersT<CHIP8_PERF != 0>;
+
+// grava os contadores em json (desligado grava so {"enabled": false})
+bool writePerfJson(const std::string &path, const PerfCountersT<true> &perf);
+bool writePerfJson(const std::string &path, const PerfCountersT<false> &perf);
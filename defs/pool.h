@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include "chip8.h"
+
+// varias vms independentes no mesmo processo, rodando espalhadas em threads
+// as vms ficam num vector contiguo e cada thread comeca com uma fila so dela, com um pedaco
+// seguido do vector. a thread tira a vm da frente da fila, roda uma fatia de frames e poe de
+// volta no fim (se ainda faltar frame). quando a fila dela esvazia ela rouba do fim da fila
+// de outra thread, assim quem terminou antes ajuda quem ficou com as vms mais pesadas
+class VMPool {
+public:
+    explicit VMPool(size_t count);
+
+    // le a rom uma vez so e carrega em todas as vms (e guarda como imagem do reset)
+    bool loadROM(const std::string &path);
+
+    // volta todas as vms pra rom recem carregada (reset rapido, sem reler nem reinicializar)
+    void reset();
+
+    // semente do aleatorio: a vm i recebe base + i, assim cada uma joga diferente
+    void seed(uint32_t base);
+
+    // motor de execucao de todas as vms
+    void setEngine(Engine e);
+
+    // perfil de quirks de todas as vms
+    void setQuirks(QuirkProfile q);
+
+    // lockstep (lockstep.h): as vms andam em grupos de LOCKSTEP_LANES, cada grupo numa thread
+    // e as instrucoes de ula/skip rodam em simd pro grupo todo. da o mesmo estado no fim
+    void setLockstep(bool on) { lockstep = on; }
+
+    // roda frames em todas as vms (cada frame = ciclos do clock/60 + timers)
+    // threads <= 0 usa todos os nucleos, slice eh quantos frames uma vm roda por vez
+    void run(uint64_t frames, int clock_hz, int threads, int slice);
+
+    size_t size() const { return vms.size(); }
+    Chip8 &vm(size_t i) { return vms[i]; }
+    const Chip8 &vm(size_t i) const { return vms[i]; }
+
+    // instrucoes executadas somando todas as vms na ultima chamada de run
+    uint64_t executed() const;
+
+    // quantas dessas rodaram no kernel simd (so no lockstep)
+    uint64_t vectorExecuted() const { return vector_executed; }
+    // runs de grupo (frames) que a medida do batch mandou pro kernel e pro Chip8::run de cada vm
+    uint64_t simdRuns() const { return simd_runs; }
+    uint64_t soloRuns() const { return solo_runs; }
+
+private:
+    // controle de cada vm (separado das vms e alinhado, pra threads diferentes
+    // mexendo em vms vizinhas nao brigarem pela mesma linha de cache)
+    struct alignas(64) Slot {
+        uint64_t frame = 0; // frames ja rodados (so a thread que tirou a vm da fila mexe)
+        uint64_t executed = 0; // instrucoes executadas
+    };
+
+    // fila de vms de uma thread (a dona tira da frente, quem rouba tira do fim). a vm que ta
+    // rodando nao ta em fila nenhuma, entao ninguem mais pega ela
+    struct alignas(64) Queue {
+        std::mutex lock;
+        std::deque<size_t> vms;
+    };
+
+    std::vector<Chip8> vms;
+    std::vector<Slot> slots;
+    bool lockstep = false;
+    std::atomic<uint64_t> vector_executed{0};
+    std::atomic<uint64_t> simd_runs{0};
+    std::atomic<uint64_t> solo_runs{0};
+
+    // loop da thread self: roda as vms da fila dela e rouba das outras ate todas terminarem
+    void worker(int self, std::vector<Queue> &queues, uint64_t frames, int clock_hz, int slice,
+                std::atomic<size_t> &remaining);
+
+    // run do lockstep: as threads vao pegando grupos e rodam todos os frames de cada um, em
+    // fatias de slice frames (LockstepBatch::runFrames)
+    void runLockstep(uint64_t frames, int clock_hz, int threads, int slice);
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstring>
+
+// comportamentos que mudam entre as implementacoes do chip8 (quirks)
+// cada perfil eh um tipo com constantes, o interpretador eh um template em cima dele,
+// entao cada perfil vira um interpretador proprio sem nenhum if de quirk no caminho quente
+// (o run() escolhe qual instanciacao chamar uma vez por chamada)
+
+// perfis disponiveis (--quirks na linha de comando)
+enum QuirkProfile {
+    QUIRKS_MODERN, // o que a vm sempre fez: shift no vx, I fica parado, BNNN com v0, tela da a volta
+    QUIRKS_VIP,    // COSMAC VIP original
+    QUIRKS_CHIP48, // CHIP-48 (HP-48)
+    QUIRKS_SCHIP   // SUPER-CHIP 1.1
+};
+
+// quanto o FX55/FX65 anda o I depois de copiar
+enum MemoryQuirk {
+    MEMORY_KEEP_I, // I nao muda
+    MEMORY_I_X1,   // I += x + 1 (VIP)
+    MEMORY_I_X     // I += x (bug do CHIP-48)
+};
+
+// campos de um perfil:
+//   vf_reset: 8XY1/8XY2/8XY3 zeram o vf
+//   shift_vy: 8XY6/8XYE deslocam o vy (e guardam no vx) em vez do proprio vx
+//   memory:   o que acontece com o I no FX55/FX65
+//   jump_vx:  BNNN vira BXNN (pula pra xnn + vx em vez de nnn + v0)
+//   clip:     sprite que passa da borda eh cortado em vez de dar a volta
+struct QuirksModern {
+    static constexpr bool vf_reset = false;
+    static constexpr bool shift_vy = false;
+    static constexpr MemoryQuirk memory = MEMORY_KEEP_I;
+    static constexpr bool jump_vx = false;
+    static constexpr bool clip = false;
+};
+
+struct QuirksVIP {
+    static constexpr bool vf_reset = true;
+    static constexpr bool shift_vy = true;
+    static constexpr MemoryQuirk memory = MEMORY_I_X1;
+    static constexpr bool jump_vx = false;
+    static constexpr bool clip = true;
+};
+
+struct QuirksChip48 {
+    static constexpr bool vf_reset = false;
+    static constexpr bool shift_vy = false;
+    static constexpr MemoryQuirk memory = MEMORY_I_X;
+    static constexpr bool jump_vx = true;
+    static constexpr bool clip = true;
+};
+
+struct QuirksSChip {
+    static constexpr bool vf_reset = false;
+    static constexpr bool shift_vy = false;
+    static constexpr MemoryQuirk memory = MEMORY_KEEP_I;
+    static constexpr bool jump_vx = true;
+    static constexpr bool clip = true;
+};
+
+// nome do perfil na linha de comando
+inline bool parseQuirkProfile(const char *name, QuirkProfile &q) {
+    if (std::strcmp(name, "modern") == 0) q = QUIRKS_MODERN;
+    else if (std::strcmp(name, "vip") == 0) q = QUIRKS_VIP;
+    else if (std::strcmp(name, "chip48") == 0) q = QUIRKS_CHIP48;
+    else if (std::strcmp(name, "schip") == 0) q = QUIRKS_SCHIP;
+    else return false;
+    return true;
+}
+
+inline const char *quirkProfileName(QuirkProfile q) {
+    switch (q) {
+        case QUIRKS_VIP: return "vip";
+        case QUIRKS_CHIP48: return "chip48";
+        case QUIRKS_SCHIP: return "schip";
+        default: return "modern";
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "chip8.h"
+
+// historico pra voltar no tempo: um anel de bytes com o estado de cada frame
+// cada frame vira um delta (Chip8::saveDelta) e a cada REWIND_KEYFRAME_INTERVAL
+// frames entra um snapshot completo, entao voltar um frame eh carregar o ultimo
+// completo e reaplicar no maximo N deltas
+// toda a memoria eh alocada no construtor, gravar e voltar nao alocam nada
+// quando o anel enche os frames mais velhos vao sendo jogados fora
+class RewindBuffer {
+public:
+    // budget_bytes eh o tamanho do anel de bytes (0 desliga o rewind)
+    explicit RewindBuffer(size_t budget_bytes);
+
+    bool enabled() const { return !ring.empty(); }
+
+    // guarda o estado da vm no fim do frame atual
+    void push(Chip8 &vm);
+
+    // volta a vm pro frame anterior e esquece o atual
+    // devolve false se nao tem mais pra onde voltar (a vm fica no frame mais velho)
+    bool stepBack(Chip8 &vm);
+
+    // quantos frames tem guardados (o atual incluso)
+    size_t frames() const { return count; }
+
+    // esquece tudo (ex: carregou um save state, o historico nao vale mais)
+    void clear();
+
+private:
+    // um frame guardado: onde ta no anel, tamanho e se eh snapshot completo
+    struct Entry {
+        uint32_t offset;
+        uint32_t size;
+        bool key;
+    };
+
+    std::vector<uint8_t> ring; // bytes dos snapshots
+    size_t tail; // onde o proximo snapshot comeca no anel
+
+    std::vector<Entry> entries; // anel de indices, do mais velho pro mais novo
+    size_t head; // indice do mais velho em entries
+    size_t count; // quantos frames guardados
+    int since_key; // frames desde o ultimo snapshot completo
+
+    std::vector<uint8_t> scratch; // onde o saveDelta/saveState escrevem antes de ir pro anel
+
+    Entry &at(size_t i) { return entries[(head + i) % entries.size()]; } // i = 0 eh o mais velho
+    void dropOldest();
+    void store(bool key);
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// rom dentro de um zip eh aberta como "arquivo.zip:NOME", sem extrair nada pro disco
+#define ROM_ZIP_SEPARATOR ".zip:"
+
+// maior entrada de zip que a gente aceita descompactar (rom de chip8 tem no maximo 3.5 kb,
+// isso so segura zip estranho de estourar a memoria)
+#define ROM_ZIP_MAX_ENTRY (64 * 1024)
+
+// arquivo inteiro mapeado na memoria (mmap), so leitura
+// os bytes vem direto do cache de paginas do sistema, sem ifstream e sem copia
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // falha se nao existir, nao for arquivo regular (pasta) ou o mmap der erro
+    bool open(const std::string &path);
+    void close();
+
+    const uint8_t *data() const { return ptr; }
+    size_t size() const { return len; }
+
+private:
+    const uint8_t *ptr = nullptr;
+    size_t len = 0;
+    bool mapped = false; // arquivo vazio fica aberto sem mapeamento
+};
+
+// leitor de zip em cima do arquivo mapeado: le o diretorio central uma vez e
+// descompacta (deflate, via zlib) so a entrada pedida
+class ZipArchive {
+public:
+    struct Entry {
+        std::string name;
+        uint16_t method;       // 0 = guardado sem compressao, 8 = deflate
+        uint32_t crc;
+        uint32_t packed_size;  // tamanho dentro do zip
+        uint32_t size;         // tamanho de verdade
+        uint32_t local_offset; // onde fica o cabecalho local da entrada
+    };
+
+    bool open(const std::string &path);
+
+    const std::vector<Entry> &entries() const { return list; }
+    const Entry *find(const std::string &name) const;
+
+    // bytes de uma entrada: guardada aponta direto pro mapeamento (out fica vazio),
+    // comprimida eh descompactada em out. confere o crc nos dois casos
+    bool read(const Entry &e, std::vector<uint8_t> &out, const uint8_t *&data, size_t &size) const;
+
+private:
+    MappedFile file;
+    std::vector<Entry> list;
+};
+
+// bytes de uma rom, de um arquivo solto ou de dentro de um zip ("jogos.zip:PONG")
+class RomFile {
+public:
+    bool open(const std::string &path);
+
+    const uint8_t *data() const { return ptr; }
+    size_t size() const { return len; }
+
+private:
+    MappedFile file;
+    ZipArchive zip;
+    std::vector<uint8_t> unpacked; // entrada de zip descompactada
+    const uint8_t *ptr = nullptr;
+    size_t len = 0;
+};
+
+// separa "jogos.zip:PONG" em zip e entrada, devolve false se nao for caminho de zip
+bool splitZipPath(const std::string &path, std::string &zip, std::string &entry);
+
+// hash (fnv-1a 64) dos bytes de uma rom, o mesmo do filme e do indice da biblioteca
+uint64_t romHash(const uint8_t *data, size_t size);
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "quirks.h"
+
+// indice da biblioteca fica do lado da fonte: roms/c8games -> roms/c8games.c8idx
+#define ROM_INDEX_EXT ".c8idx"
+#define ROM_INDEX_MAGIC "C8RL"
+#define ROM_INDEX_VERSION 2
+
+// o que o indice guarda de cada rom
+struct RomInfo {
+    std::string name;    // nome do arquivo (ou da entrada no zip)
+    uint32_t size;       // bytes
+    uint64_t hash;       // romHash, o mesmo que vai no filme
+    QuirkProfile quirks; // perfil provavel, olhando os opcodes
+
+    // nome sem extensao (as roms nao tem titulo dentro)
+    std::string title() const;
+};
+
+// biblioteca de roms de uma pasta ou de um zip
+// cada rom eh lida e hasheada uma vez so: o resultado vai pra um indice binario compacto
+// no disco, e enquanto a fonte nao mudar (mtime e tamanho da pasta ou do zip) abrir a
+// biblioteca eh ler esse arquivo e mais nada, sem listar a pasta nem abrir rom nenhuma
+class RomLibrary {
+public:
+    // abre a biblioteca de source (pasta ou .zip), refazendo o indice se ele nao existir,
+    // estiver velho ou rescan for true
+    bool open(const std::string &source, bool rescan = false);
+
+    const std::vector<RomInfo> &roms() const { return list; }
+
+    // caminho pra abrir a rom com o RomFile / loadROM ("pasta/NOME" ou "jogos.zip:NOME")
+    std::string path(const RomInfo &rom) const;
+
+    // procura pelo nome do arquivo, pelo titulo ou pelo hash em hexa
+    const RomInfo *find(const std::string &key) const;
+
+    // true se o ultimo open so leu o indice do disco
+    bool fromCache() const { return cached; }
+
+private:
+    std::string source;
+    bool is_zip = false;
+    bool cached = false;
+    std::vector<RomInfo> list;
+
+    bool loadIndex(const std::string &index_path, int64_t mtime, uint64_t size);
+    bool writeIndex(const std::string &index_path, int64_t mtime, uint64_t size) const;
+    bool scan();
+};
+
+// chuta o perfil de quirks pelos opcodes alcancaveis (analyzeRom): instrucao que so existe
+// no SUPER-CHIP vira schip, I andando no FX55/FX65 vira vip, o resto modern
+QuirkProfile detectQuirks(const uint8_t *data, size_t size);
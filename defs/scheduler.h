@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+
+// agenda os ciclos da cpu em frames de 60 Hz usando so conta inteira
+// o frame k tem floor(clock*(k+1)/60) - floor(clock*k/60) ciclos, entao a soma
+// de 60 frames da exatamente o clock (700 Hz roda 700 ciclos por segundo, nao 1000)
+// os timers descem 1 vez por frame, entao cpu e timers usam a mesma base de tempo
+class Scheduler {
+public:
+    explicit Scheduler(int clock_hz);
+
+    // quantos ciclos o proximo frame tem, e ja avanca pro frame seguinte
+    int nextFrameCycles();
+
+    // pula direto pro frame f sem rodar os ciclos do meio (usado pra descartar atraso)
+    void skipTo(uint64_t f) {
+        if (f > frame) frame = f;
+    }
+
+    // frames ja agendados
+    uint64_t frames() const { return frame; }
+
+    // ciclos que deviam ter rodado ate o frame atual
+    uint64_t targetCycles() const { return cyclesUntil(frame); }
+
+    int clock() const { return clock_hz; }
+
+    // ciclos do frame f pra um clock, sem precisar de um Scheduler (usado no pool)
+    static int frameCycles(int clock_hz, uint64_t f) {
+        return (int) ((uint64_t) clock_hz * (f + 1) / 60 - (uint64_t) clock_hz * f / 60);
+    }
+
+private:
+    int clock_hz; // ciclos por segundo virtual
+    uint64_t frame; // proximo frame a ser agendado
+
+    uint64_t cyclesUntil(uint64_t f) const { return (uint64_t) clock_hz * f / 60; }
+};
+
+// mede as instrucoes por segundo de verdade pra comparar com o alvo
+class IpsMeter {
+public:
+    IpsMeter();
+
+    // soma instrucoes executadas
+    void add(uint64_t n) { count += n; }
+
+    // instrucoes por segundo desde o ultimo reset (ou desde a criacao)
+    double ips() const;
+
+    // segundos desde o ultimo reset
+    double seconds() const;
+
+    uint64_t executed() const { return count; }
+
+    // zera a contagem e o relogio
+    void reset();
+
+private:
+    uint64_t count;
+    int64_t start_ns; // steady_clock em ns
+};
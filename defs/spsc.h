@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// fila circular de um produtor e um consumidor, sem lock
+// cada lado so escreve o proprio indice (head do produtor, tail do consumidor) e le o do
+// outro com acquire, entao da pra usar dentro do callback de audio sem mutex
+// N tem que ser potencia de 2: os indices crescem sem parar e o & faz a volta
+template <class T, size_t N> class SpscRing {
+    static_assert((N & (N - 1)) == 0, "tamanho da fila tem que ser potencia de 2");
+
+public:
+    // lado do produtor: copia ate n itens, devolve quantos couberam
+    size_t push(const T *src, size_t n) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t free = N - (h - tail.load(std::memory_order_acquire));
+        if (n > free) n = free;
+        for (size_t i = 0; i < n; ++i) buf[(h + i) & (N - 1)] = src[i];
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    // lado do consumidor: tira ate n itens, devolve quantos tinha
+    size_t pop(T *dst, size_t n) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t avail = head.load(std::memory_order_acquire) - t;
+        if (n > avail) n = avail;
+        for (size_t i = 0; i < n; ++i) dst[i] = buf[(t + i) & (N - 1)];
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // quantos itens tem na fila agora (aproximado se o outro lado estiver mexendo)
+    size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+    static constexpr size_t capacity() { return N; }
+
+private:
+    // cada indice na sua linha de cache, senao produtor e consumidor ficam brigando por ela
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) T buf[N];
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// formato binario dos save states (Chip8::saveState / saveDelta / loadState)
+//
+// cabecalho (6 bytes): "C8ST", versao, tipo
+// registradores (78 bytes): V[16], I, PC, SP, stack[16], delay, sound, wait_reg, rng,
+//                           hires, halted, rpl[16]
+// completo: memoria inteira (4096) + tela inteira (64 linhas de 16 bytes)
+// delta: mapa de paginas (8 bytes) + paginas que mudaram (64 bytes cada)
+//        + mapa de linhas (8 bytes) + linhas da tela que mudaram (16 bytes cada)
+// numeros de mais de um byte sao gravados em little endian
+//
+// um delta so faz sentido aplicado em cima do estado de onde ele saiu, entao quem
+// guarda deltas precisa guardar tambem o snapshot completo que serve de base
+
+#define STATE_MAGIC "C8ST"
+#define STATE_VERSION 2 // 2: tela do SUPER-CHIP (128x64) e flags rpl
+
+// teto pra qualquer snapshot (o completo tem ~5.2kb), usado pra reservar buffer
+#define STATE_MAX_SIZE 8192
+
+enum StateKind : uint8_t {
+    STATE_FULL = 0, // snapshot completo
+    STATE_DELTA = 1 // so o que mudou desde o ultimo snapshot
+};
+
+// grava um snapshot num arquivo (sobrescreve)
+bool writeStateFile(const std::string &path, const std::vector<uint8_t> &data);
+
+// le um arquivo de snapshot inteiro pra memoria
+bool readStateFile(const std::string &path, std::vector<uint8_t> &data);
@@ -0,0 +1,36 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// buffer triplo sem lock entre um produtor e um consumidor
+// o produtor sempre tem um slot so dele pra escrever (back), o consumidor um so dele pra
+// ler (front), e o terceiro fica no meio com o ultimo frame completo. publicar e pegar
+// sao um exchange atomico do indice do meio, entao nenhum lado espera o outro: se o
+// consumidor demorar, o produtor so vai sobrescrevendo o do meio com frames mais novos
+template <class T> class TripleBuffer {
+public:
+    // lado do produtor: slot pra escrever o proximo frame
+    T &back() { return slots[back_idx]; }
+
+    // lado do produtor: o back vira o frame mais novo e o antigo do meio vira o back
+    void publish() { back_idx = middle.exchange(back_idx | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+    // lado do consumidor: pega o frame mais novo se tiver um que ainda nao viu
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        front_idx = middle.exchange(front_idx, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    // lado do consumidor: ultimo frame pego pelo update()
+    const T &front() const { return slots[front_idx]; }
+
+private:
+    static const uint8_t INDEX = 3; // bits do indice do slot
+    static const uint8_t FRESH = 4; // o slot do meio tem frame que o consumidor nao viu
+
+    T slots[3] = {};
+    alignas(64) std::atomic<uint8_t> middle{1};
+    alignas(64) uint8_t back_idx = 0; // so o produtor mexe
+    alignas(64) uint8_t front_idx = 2; // so o consumidor mexe
+};
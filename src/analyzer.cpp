@@ -0,0 +1,531 @@
+#include "../defs/analyzer.h"
+#include "../defs/defs.h"
+#include <algorithm>
+#include <cstring>
+
+// intervalo de valores que o I pode ter num ponto do codigo (I tem 16 bits, so os 12 de
+// baixo enderecam a memoria). comeca no ANNN, o FX1E e o FX55/FX65 alargam
+struct IRange {
+    int32_t lo, hi;
+};
+static const IRange I_ANY = {0, 0xFFFF};
+
+static uint16_t opcodeAt(const uint8_t *memory, uint16_t a) {
+    return (memory[a & 0x0FFF] << 8) | memory[(a + 1) & 0x0FFF];
+}
+
+static bool isSkip(uint16_t op) {
+    switch (op >> 12) {
+        case 0x3: case 0x4: return true;
+        case 0x5: case 0x9: return (op & 0xF) == 0;
+        case 0xE: return (op & 0xFF) == 0x9E || (op & 0xFF) == 0xA1;
+        default: return false;
+    }
+}
+
+// instrucoes que so existem no SUPER-CHIP (as mesmas do detectQuirks antigo)
+static bool isSchip(uint16_t op) {
+    if ((op & 0xFFF0) == 0x00C0 || (op >= 0x00FB && op <= 0x00FF)) return true;
+    uint16_t f = op & 0xF0FF;
+    return f == 0xF030 || f == 0xF075 || f == 0xF085;
+}
+
+// ultima instrucao do bloco: desvio, skip, retorno ou parada
+static bool endsBlock(uint16_t op) {
+    switch (op >> 12) {
+        case 0x0: return op == 0x00EE || op == 0x00FD;
+        case 0x1: case 0x2: case 0xB: return true;
+        default: return isSkip(op);
+    }
+}
+
+// o I depois da instrucao (o FX55/FX65 cobre os tres perfis: I parado, I += x, I += x + 1)
+static IRange stepI(uint16_t op, IRange r) {
+    int x = (op >> 8) & 0xF;
+    switch (op >> 12) {
+        case 0xA:
+            return {op & 0x0FFF, op & 0x0FFF};
+        case 0xF:
+            switch (op & 0xFF) {
+                case 0x1E: r.hi += 0xFF; break;
+                case 0x29: return {0, 0xFF * 5};
+                case 0x30: return {BIGFONT_ADDR, BIGFONT_ADDR + 15 * 10};
+                case 0x55: case 0x65: r.hi += x + 1; break;
+                default: break;
+            }
+            break;
+        default:
+            break;
+    }
+    return r.hi > 0xFFFF ? I_ANY : r;
+}
+
+const CfgBlock *RomAnalysis::block(uint16_t addr) const {
+    auto it = std::lower_bound(blocks.begin(), blocks.end(), addr,
+                               [](const CfgBlock &b, uint16_t a) { return b.start < a; });
+    return it != blocks.end() && it->start == addr ? &*it : nullptr;
+}
+
+RomAnalysis analyzeRom(const uint8_t *memory, uint16_t start) {
+    RomAnalysis a;
+    a.start = start & 0x0FFF;
+
+    // ---- alcance + intervalo do I em cada instrucao (ponto fixo com fila) ----
+    // as chamadas nao sao separadas por quem chamou: todo 00EE volta pra todo retorno
+    // (junta mais do que precisa, mas nunca deixa um caminho de fora)
+    struct Node {
+        bool seen = false;
+        uint8_t changes = 0;
+        IRange i = {0, 0};
+    };
+    std::vector<Node> node(4096);
+    std::vector<uint16_t> work;
+    std::vector<uint16_t> ret_sites;
+    std::vector<bool> is_ret_site(4096, false);
+    bool has_ret = false;
+    IRange ret = {0, 0};
+
+    auto flow = [&](uint16_t to, IRange r) {
+        Node &n = node[to & 0x0FFF];
+        if (!n.seen) {
+            n.seen = true;
+            n.i = r;
+            work.push_back(to & 0x0FFF);
+            return;
+        }
+        IRange j = {std::min(n.i.lo, r.lo), std::max(n.i.hi, r.hi)};
+        if (j.lo == n.i.lo && j.hi == n.i.hi) return;
+        // laco que vai somando no I (FX1E) alargaria um pouco por volta: desiste logo
+        if (++n.changes > 8) j = I_ANY;
+        n.i = j;
+        work.push_back(to & 0x0FFF);
+    };
+
+    // com a pilha cheia o 2NNN nao pula e a vm segue no pc + 2 (op_2NNN): quando nao da pra
+    // descartar isso, a volta da chamada fica alcancavel direto, sem esperar um 00EE
+    bool call_falls = false;
+    auto solve = [&]() {
+        while (!work.empty()) {
+            uint16_t at = work.back();
+            work.pop_back();
+            uint16_t op = opcodeAt(memory, at);
+            IRange r = node[at].i;
+            uint16_t next = (at + 2) & 0x0FFF;
+
+            if (op == 0x00EE) {
+                IRange j = has_ret ? IRange{std::min(ret.lo, r.lo), std::max(ret.hi, r.hi)} : r;
+                if (!has_ret || j.lo != ret.lo || j.hi != ret.hi) {
+                    has_ret = true;
+                    ret = j;
+                    for (uint16_t s : ret_sites) flow(s, ret);
+                }
+                continue;
+            }
+            if (op == 0x00FD) continue;
+            switch (op >> 12) {
+                case 0x1:
+                    flow(op & 0x0FFF, r);
+                    break;
+                case 0x2:
+                    flow(op & 0x0FFF, r);
+                    if (call_falls) flow(next, r);
+                    if (!is_ret_site[next]) {
+                        is_ret_site[next] = true;
+                        ret_sites.push_back(next);
+                        if (has_ret) flow(next, ret);
+                    }
+                    break;
+                case 0xB:
+                    a.computed_jumps = true;
+                    break;
+                default:
+                    flow(next, stepI(op, r));
+                    if (isSkip(op)) flow(next + 2, r);
+                    break;
+            }
+        }
+    };
+    flow(a.start, {0, 0});
+    solve();
+
+    // ---- profundidade das chamadas ----
+    // chamadas que cada rotina (e o codigo principal) faz ate o 00EE, seguindo so o que ja eh
+    // alcancavel. a pilha estoura se alguma cadeia passa de 16 (recursao sempre passa)
+    std::vector<std::vector<uint16_t>> calls(4096);
+    auto callsFrom = [&](uint16_t entry) {
+        std::vector<bool> seen(4096, false);
+        std::vector<uint16_t> todo = {entry};
+        auto go = [&](uint16_t to) {
+            to &= 0x0FFF;
+            if (node[to].seen && !seen[to]) {
+                seen[to] = true;
+                todo.push_back(to);
+            }
+        };
+        seen[entry] = true;
+        while (!todo.empty()) {
+            uint16_t at = todo.back();
+            todo.pop_back();
+            uint16_t op = opcodeAt(memory, at);
+            uint16_t next = (at + 2) & 0x0FFF;
+            if (op == 0x00EE || op == 0x00FD) continue;
+            switch (op >> 12) {
+                case 0x1: go(op & 0x0FFF); break;
+                case 0x2:
+                    calls[entry].push_back(op & 0x0FFF);
+                    go(next);
+                    break;
+                default:
+                    go(next);
+                    if (isSkip(op)) go(next + 2);
+                    break;
+            }
+        }
+    };
+    // quantas chamadas empilham uma dentro da outra a partir de entry (17 = estoura ou recursao)
+    std::vector<int> height(4096, -1); // -1 = nao calculado, -2 = na cadeia atual
+    auto chain = [&](auto &self, uint16_t entry, int sp) -> int {
+        if (height[entry] == -2 || sp > 16) return 17;
+        if (height[entry] >= 0) return height[entry];
+        callsFrom(entry);
+        height[entry] = -2;
+        int h = 0;
+        for (uint16_t c : calls[entry]) {
+            h = std::max(h, 1 + self(self, c, sp + 1));
+            if (h > 16) {
+                h = 17;
+                break;
+            }
+        }
+        height[entry] = h;
+        return h;
+    };
+    if (chain(chain, a.start, 0) > 16) {
+        call_falls = true;
+        for (int at = 0; at < 4096; ++at) {
+            if (node[at].seen && (opcodeAt(memory, at) >> 12) == 0x2) work.push_back((uint16_t) at);
+        }
+        solve();
+    }
+
+    // ---- bytes de codigo e onde as escritas podem cair ----
+    auto written = [&](int32_t lo, int32_t hi) {
+        if (hi - lo >= 0x0FFF) {
+            a.unknown_writes = true;
+            for (uint8_t &f : a.flags) f |= ADDR_WRITTEN;
+            return;
+        }
+        for (int32_t v = lo; v <= hi; ++v) a.flags[v & 0x0FFF] |= ADDR_WRITTEN;
+    };
+    for (int at = 0; at < 4096; ++at) {
+        if (!node[at].seen) continue;
+        ++a.instructions;
+        a.flags[at] |= ADDR_INSTR | ADDR_CODE;
+        a.flags[(at + 1) & 0x0FFF] |= ADDR_CODE;
+        uint16_t op = opcodeAt(memory, at);
+        IRange r = node[at].i;
+        if ((op & 0xF0FF) == 0xF033) written(r.lo, r.hi + 2);
+        if ((op & 0xF0FF) == 0xF055) written(r.lo, r.hi + ((op >> 8) & 0xF));
+    }
+    for (int at = 0; at < 4096;) {
+        if ((a.flags[at] & (ADDR_CODE | ADDR_WRITTEN)) != (ADDR_CODE | ADDR_WRITTEN)) {
+            ++at;
+            continue;
+        }
+        int end = at;
+        while (end < 4096 && (a.flags[end] & (ADDR_CODE | ADDR_WRITTEN)) == (ADDR_CODE | ADDR_WRITTEN)) ++end;
+        a.selfmod.push_back({(uint16_t) at, (uint16_t) end});
+        at = end;
+    }
+    a.readonly = !a.computed_jumps && a.selfmod.empty();
+
+    // ---- blocos basicos ----
+    auto lead = [&](uint16_t at) {
+        if (node[at & 0x0FFF].seen) a.flags[at & 0x0FFF] |= ADDR_LEADER;
+    };
+    lead(a.start);
+    for (int at = 0; at < 4096; ++at) {
+        if (!node[at].seen) continue;
+        uint16_t op = opcodeAt(memory, at);
+        if (!endsBlock(op)) continue;
+        if ((op >> 12) == 0x1 || (op >> 12) == 0x2) lead(op & 0x0FFF);
+        lead(at + 2);
+        if (isSkip(op)) lead(at + 4);
+    }
+    for (int l = 0; l < 4096; ++l) {
+        if (!(a.flags[l] & ADDR_LEADER)) continue;
+        CfgBlock b;
+        b.start = (uint16_t) l;
+        b.ret = false;
+        b.depth = 0;
+        uint16_t at = (uint16_t) l;
+        for (int n = 0; n < 2048; ++n) {
+            uint16_t op = opcodeAt(memory, at);
+            uint16_t next = (at + 2) & 0x0FFF;
+            if (endsBlock(op)) {
+                if (op == 0x00EE) b.ret = true;
+                else if ((op >> 12) == 0x1) b.succ.push_back(op & 0x0FFF);
+                else if ((op >> 12) == 0x2) {
+                    b.succ.push_back(op & 0x0FFF);
+                    if (node[next].seen) b.succ.push_back(next);
+                } else if (isSkip(op)) {
+                    b.succ.push_back(next);
+                    b.succ.push_back((next + 2) & 0x0FFF);
+                }
+                at = next;
+                break;
+            }
+            at = next;
+            if (!node[at].seen || (a.flags[at] & ADDR_LEADER)) {
+                if (node[at].seen) b.succ.push_back(at);
+                break;
+            }
+        }
+        b.end = at > b.start ? at : at + 0x1000; // o codigo deu a volta no fim da memoria
+        a.blocks.push_back(b);
+    }
+
+    // ---- lacos: pulo de volta pra um bloco que ainda ta na pilha da busca em profundidade ----
+    std::vector<int> idx(4096, -1);
+    for (size_t i = 0; i < a.blocks.size(); ++i) idx[a.blocks[i].start] = (int) i;
+    std::vector<std::vector<int>> preds(a.blocks.size());
+    for (size_t i = 0; i < a.blocks.size(); ++i) {
+        for (uint16_t s : a.blocks[i].succ) {
+            if (idx[s] >= 0) preds[idx[s]].push_back((int) i);
+        }
+    }
+    std::vector<std::pair<int, int>> back_edges;
+    if (idx[a.start] >= 0) {
+        std::vector<uint8_t> color(a.blocks.size(), 0); // 0 = nao visto, 1 = na pilha, 2 = terminado
+        std::vector<std::pair<int, size_t>> stack = {{idx[a.start], 0}};
+        color[idx[a.start]] = 1;
+        while (!stack.empty()) {
+            auto &[bi, k] = stack.back();
+            const CfgBlock &b = a.blocks[bi];
+            if (k == b.succ.size()) {
+                color[bi] = 2;
+                stack.pop_back();
+                continue;
+            }
+            int s = idx[b.succ[k++]];
+            if (s < 0) continue;
+            if (color[s] == 1) back_edges.push_back({bi, s});
+            else if (color[s] == 0) {
+                color[s] = 1;
+                stack.push_back({s, 0});
+            }
+        }
+    }
+    // pulos de volta pra mesma cabeca sao um laco so (continue no meio do corpo)
+    std::sort(back_edges.begin(), back_edges.end(),
+              [](std::pair<int, int> x, std::pair<int, int> y) { return x.second < y.second; });
+    for (size_t e = 0; e < back_edges.size();) {
+        int head = back_edges[e].second;
+        int from = back_edges[e].first;
+        // corpo: o que chega nos pulos de volta andando pra tras sem passar pela cabeca
+        std::vector<bool> body(a.blocks.size(), false);
+        body[head] = true;
+        std::vector<int> todo;
+        for (; e < back_edges.size() && back_edges[e].second == head; ++e) {
+            int f = back_edges[e].first;
+            if (a.blocks[f].start > a.blocks[from].start) from = f;
+            if (!body[f]) {
+                body[f] = true;
+                todo.push_back(f);
+            }
+        }
+        while (!todo.empty()) {
+            int bi = todo.back();
+            todo.pop_back();
+            for (int p : preds[bi]) {
+                if (!body[p]) {
+                    body[p] = true;
+                    todo.push_back(p);
+                }
+            }
+        }
+
+        CfgLoop loop;
+        loop.head = a.blocks[head].start;
+        loop.back = a.blocks[from].start;
+        loop.instrs = 0;
+        loop.depth = 0;
+        bool timer = false, key = false, other = false;
+        for (size_t i = 0; i < a.blocks.size(); ++i) {
+            if (!body[i]) continue;
+            ++a.blocks[i].depth;
+            for (uint16_t at = a.blocks[i].start; at != (a.blocks[i].end & 0x0FFF); at = (at + 2) & 0x0FFF) {
+                uint16_t op = opcodeAt(memory, at);
+                ++loop.instrs;
+                if ((op & 0xF0FF) == 0xF007) timer = true;
+                else if ((op >> 12) == 0xE) key = true;
+                else if ((op >> 12) == 0xD || (op >> 12) == 0x2 || (op & 0xF0FF) == 0xF00A) other = true;
+            }
+        }
+        loop.kind = LOOP_PLAIN;
+        if (timer && !key && !other && loop.instrs <= 6) loop.kind = LOOP_TIMER;
+        else if (key && !other) loop.kind = LOOP_KEY;
+        a.flags[loop.head] |= ADDR_LOOP;
+        a.loops.push_back(loop);
+    }
+    for (CfgLoop &loop : a.loops) loop.depth = a.blocks[idx[loop.head]].depth - 1;
+    std::stable_sort(a.loops.begin(), a.loops.end(), [](const CfgLoop &x, const CfgLoop &y) {
+        return x.depth != y.depth ? x.depth > y.depth : x.instrs < y.instrs;
+    });
+
+    // ---- perfil de quirks ----
+    // SUPER-CHIP: alguma instrucao que so ele tem. VIP: FX55/FX65 seguido de outro sem
+    // recarregar o I (so faz sentido se o I andou). o resto fica modern
+    // shift com x != y e BXNN so entram de pista: tem rom de CHIP-48 que escreve assim
+    char line[96];
+    int schip_at = -1, shift_at = -1, reuse_at = -1, bxnn_at = -1;
+    for (int at = 0; at < 4096; ++at) {
+        if (!node[at].seen) continue;
+        uint16_t op = opcodeAt(memory, at);
+        if (schip_at < 0 && isSchip(op)) schip_at = at;
+        if (shift_at < 0 && (op & 0xF007) == 0x8006 && ((op >> 8) & 0xF) != ((op >> 4) & 0xF)) shift_at = at;
+        if (bxnn_at < 0 && (op >> 12) == 0xB && (op & 0x0F00) != 0) bxnn_at = at;
+        if (reuse_at < 0 && ((op & 0xF0FF) == 0xF055 || (op & 0xF0FF) == 0xF065)) {
+            for (uint16_t n = (at + 2) & 0x0FFF; node[n].seen && !(a.flags[n] & ADDR_LEADER); n = (n + 2) & 0x0FFF) {
+                uint16_t o = opcodeAt(memory, n);
+                if ((o & 0xF0FF) == 0xF055 || (o & 0xF0FF) == 0xF065) {
+                    reuse_at = at;
+                    break;
+                }
+                if ((o >> 12) == 0xA || (o & 0xF0FF) == 0xF029 || (o & 0xF0FF) == 0xF030 ||
+                    (o & 0xF0FF) == 0xF01E || endsBlock(o))
+                    break;
+            }
+        }
+    }
+    auto note = [&](int at, const char *why) {
+        std::snprintf(line, sizeof(line), "0x%03X %s: %s", at, disassemble(opcodeAt(memory, at)).c_str(), why);
+        a.evidence.push_back(line);
+    };
+    if (schip_at >= 0) note(schip_at, "so existe no SUPER-CHIP");
+    if (shift_at >= 0) note(shift_at, "shift com x != y, no VIP desloca o vy em vez do vx");
+    if (reuse_at >= 0) note(reuse_at, "usa o I de novo sem recarregar, conta com o I andando (VIP)");
+    if (bxnn_at >= 0) note(bxnn_at, "no CHIP-48/SUPER-CHIP pula com o vx em vez do v0");
+    if (schip_at >= 0) a.quirks = QUIRKS_SCHIP;
+    else if (reuse_at >= 0) a.quirks = QUIRKS_VIP;
+    return a;
+}
+
+std::string disassemble(uint16_t op) {
+    char s[32];
+    int x = (op >> 8) & 0xF, y = (op >> 4) & 0xF, n = op & 0xF, nn = op & 0xFF, nnn = op & 0x0FFF;
+    static const char *const alu[16] = {"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                                        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr};
+    std::snprintf(s, sizeof(s), "DW 0x%04X", op);
+    switch (op >> 12) {
+        case 0x0:
+            if (op == 0x00E0) std::snprintf(s, sizeof(s), "CLS");
+            else if (op == 0x00EE) std::snprintf(s, sizeof(s), "RET");
+            else if ((op & 0xFFF0) == 0x00C0) std::snprintf(s, sizeof(s), "SCD %d", n);
+            else if (op == 0x00FB) std::snprintf(s, sizeof(s), "SCR");
+            else if (op == 0x00FC) std::snprintf(s, sizeof(s), "SCL");
+            else if (op == 0x00FD) std::snprintf(s, sizeof(s), "EXIT");
+            else if (op == 0x00FE) std::snprintf(s, sizeof(s), "LOW");
+            else if (op == 0x00FF) std::snprintf(s, sizeof(s), "HIGH");
+            break;
+        case 0x1: std::snprintf(s, sizeof(s), "JP 0x%03X", nnn); break;
+        case 0x2: std::snprintf(s, sizeof(s), "CALL 0x%03X", nnn); break;
+        case 0x3: std::snprintf(s, sizeof(s), "SE V%X, 0x%02X", x, nn); break;
+        case 0x4: std::snprintf(s, sizeof(s), "SNE V%X, 0x%02X", x, nn); break;
+        case 0x5: if (n == 0) std::snprintf(s, sizeof(s), "SE V%X, V%X", x, y); break;
+        case 0x6: std::snprintf(s, sizeof(s), "LD V%X, 0x%02X", x, nn); break;
+        case 0x7: std::snprintf(s, sizeof(s), "ADD V%X, 0x%02X", x, nn); break;
+        case 0x8: if (alu[n]) std::snprintf(s, sizeof(s), "%s V%X, V%X", alu[n], x, y); break;
+        case 0x9: if (n == 0) std::snprintf(s, sizeof(s), "SNE V%X, V%X", x, y); break;
+        case 0xA: std::snprintf(s, sizeof(s), "LD I, 0x%03X", nnn); break;
+        case 0xB: std::snprintf(s, sizeof(s), "JP V0, 0x%03X", nnn); break;
+        case 0xC: std::snprintf(s, sizeof(s), "RND V%X, 0x%02X", x, nn); break;
+        case 0xD: std::snprintf(s, sizeof(s), "DRW V%X, V%X, %d", x, y, n); break;
+        case 0xE:
+            if (nn == 0x9E) std::snprintf(s, sizeof(s), "SKP V%X", x);
+            else if (nn == 0xA1) std::snprintf(s, sizeof(s), "SKNP V%X", x);
+            break;
+        case 0xF:
+            switch (nn) {
+                case 0x07: std::snprintf(s, sizeof(s), "LD V%X, DT", x); break;
+                case 0x0A: std::snprintf(s, sizeof(s), "LD V%X, K", x); break;
+                case 0x15: std::snprintf(s, sizeof(s), "LD DT, V%X", x); break;
+                case 0x18: std::snprintf(s, sizeof(s), "LD ST, V%X", x); break;
+                case 0x1E: std::snprintf(s, sizeof(s), "ADD I, V%X", x); break;
+                case 0x29: std::snprintf(s, sizeof(s), "LD F, V%X", x); break;
+                case 0x30: std::snprintf(s, sizeof(s), "LD HF, V%X", x); break;
+                case 0x33: std::snprintf(s, sizeof(s), "LD B, V%X", x); break;
+                case 0x55: std::snprintf(s, sizeof(s), "LD [I], V%X", x); break;
+                case 0x65: std::snprintf(s, sizeof(s), "LD V%X, [I]", x); break;
+                case 0x75: std::snprintf(s, sizeof(s), "LD R, V%X", x); break;
+                case 0x85: std::snprintf(s, sizeof(s), "LD V%X, R", x); break;
+                default: break;
+            }
+            break;
+    }
+    return s;
+}
+
+// trechos seguidos de bytes com a flag, "0x3E0-0x3E2, 0x3F0"
+static std::string ranges(const RomAnalysis &a, uint8_t flag) {
+    std::string out;
+    char s[24];
+    for (int at = 0; at < 4096;) {
+        if (!(a.flags[at] & flag)) {
+            ++at;
+            continue;
+        }
+        int end = at;
+        while (end + 1 < 4096 && (a.flags[end + 1] & flag)) ++end;
+        if (end == at) std::snprintf(s, sizeof(s), "0x%03X", at);
+        else std::snprintf(s, sizeof(s), "0x%03X-0x%03X", at, end);
+        if (!out.empty()) out += ", ";
+        out += s;
+        at = end + 1;
+    }
+    return out;
+}
+
+void printAnalysis(std::FILE *out, const RomAnalysis &a, const uint8_t *memory, bool listing) {
+    static const char *const kinds[] = {"", "  espera o delay timer", "  espera tecla"};
+    std::fprintf(out, "inicio: 0x%03X\n", a.start);
+    std::fprintf(out, "instrucoes: %d alcancaveis em %zu blocos, %zu lacos\n", a.instructions, a.blocks.size(),
+                 a.loops.size());
+    std::fprintf(out, "desvios calculados: %s\n", a.computed_jumps ? "sim (BNNN, pode ter codigo fora da analise)" : "nao");
+    if (a.unknown_writes) std::fprintf(out, "escritas: em qualquer lugar (I sem limite no FX33/FX55)\n");
+    else {
+        std::string w = ranges(a, ADDR_WRITTEN);
+        std::fprintf(out, "escritas: %s\n", w.empty() ? "nenhuma" : w.c_str());
+    }
+    if (a.selfmod.empty()) std::fprintf(out, "automodificavel: nao\n");
+    else {
+        std::fprintf(out, "automodificavel:");
+        for (auto [from, to] : a.selfmod) std::fprintf(out, " 0x%03X-0x%03X", from, to - 1);
+        std::fprintf(out, "\n");
+    }
+    std::fprintf(out, "codigo so leitura: %s\n", a.readonly ? "sim" : "nao");
+    std::fprintf(out, "quirks: %s\n", quirkProfileName(a.quirks));
+    for (const std::string &e : a.evidence) std::fprintf(out, "  %s\n", e.c_str());
+    if (!a.loops.empty()) {
+        std::fprintf(out, "lacos (os mais internos primeiro):\n");
+        for (const CfgLoop &l : a.loops) {
+            std::fprintf(out, "  0x%03X <- 0x%03X  %3d instrucoes  profundidade %d%s\n", l.head, l.back, l.instrs,
+                         l.depth, kinds[l.kind]);
+        }
+    }
+    if (!listing) return;
+
+    for (const CfgBlock &b : a.blocks) {
+        std::fprintf(out, "\n0x%03X:%s", b.start, (a.flags[b.start] & ADDR_LOOP) ? "  ; laco" : "");
+        if (!b.succ.empty()) {
+            std::fprintf(out, "  ; ->");
+            for (uint16_t s : b.succ) std::fprintf(out, " 0x%03X", s);
+        }
+        if (b.ret) std::fprintf(out, "  ; volta");
+        std::fprintf(out, "\n");
+        for (uint16_t at = b.start; at != (b.end & 0x0FFF); at = (at + 2) & 0x0FFF) {
+            uint16_t op = opcodeAt(memory, at);
+            std::fprintf(out, "  0x%03X  %04X  %s\n", at, op, disassemble(op).c_str());
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#include "../defs/audio.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// volume da onda quadrada (de 32767)
+static const int16_t AMPLITUDE = 3000;
+
+Audio::Audio()
+    : device(0), rate(AUDIO_SAMPLE_RATE), target(0), beeping(false), phase(0), step(0), started(false),
+      underrun_count(0) {}
+
+Audio::~Audio() { shutdown(); }
+
+bool Audio::init() {
+    SDL_AudioSpec want, have;
+    std::memset(&want, 0, sizeof(want));
+    want.freq = AUDIO_SAMPLE_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = AUDIO_DEVICE_SAMPLES;
+    want.callback = callback;
+    want.userdata = this;
+
+    // taxa e tamanho do buffer podem mudar, o formato e os canais nao
+    device = SDL_OpenAudioDevice(nullptr, 0, &want, &have,
+                                 SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+    if (device == 0) {
+        std::fprintf(stderr, "SDL_OpenAudioDevice error: %s (sem som)\n", SDL_GetError());
+        return false;
+    }
+    rate = have.freq;
+    step = (uint32_t) (((uint64_t) AUDIO_TONE_HZ << 32) / (uint64_t) rate);
+
+    // atraso = o que ta na fila + o buffer do dispositivo. o alvo fica abaixo do limite com
+    // folga pra um pump atrasado sem a fila esvaziar
+    int most = (int) ((int64_t) rate * AUDIO_MAX_LATENCY_MS / 1000) - have.samples;
+    target = std::min((int) ((int64_t) rate * AUDIO_TARGET_MS / 1000), most);
+    // dispositivo com buffer grande demais pro limite: fica no menor atraso que nao falha
+    if (target < have.samples) target = have.samples;
+    if (target > (int) SampleRing::capacity()) target = (int) SampleRing::capacity();
+    scratch.resize((size_t) target);
+
+    // a fila ja comeca no alvo (silencio): o dispositivo tem o que tocar ate o primeiro frame
+    ring.push(scratch.data(), scratch.size());
+
+    SDL_PauseAudioDevice(device, 0);
+    return true;
+}
+
+void Audio::frame(bool on) {
+    if (!device) return;
+    beeping = on;
+    started.store(true, std::memory_order_release);
+    pump();
+}
+
+void Audio::pump() {
+    if (!device) return;
+    size_t queued = ring.size();
+    if (queued >= (size_t) target) return;
+    size_t n = (size_t) target - queued;
+    if (beeping) {
+        for (size_t i = 0; i < n; ++i) {
+            scratch[i] = (phase & 0x80000000u) ? AMPLITUDE : -AMPLITUDE;
+            phase += step;
+        }
+    } else {
+        std::memset(scratch.data(), 0, n * sizeof(int16_t));
+    }
+    ring.push(scratch.data(), n);
+}
+
+// roda na thread de audio do sdl: so le a fila, completa com silencio se faltar
+void Audio::callback(void *userdata, Uint8 *stream, int len) {
+    Audio *self = static_cast<Audio *>(userdata);
+    int16_t *out = reinterpret_cast<int16_t *>(stream);
+    size_t want = (size_t) len / sizeof(int16_t);
+    size_t got = self->ring.pop(out, want);
+    if (got < want) {
+        std::memset(out + got, 0, (want - got) * sizeof(int16_t));
+        if (self->started.load(std::memory_order_acquire)) {
+            self->underrun_count.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void Audio::shutdown() {
+    if (device) {
+        SDL_CloseAudioDevice(device);
+        device = 0;
+    }
+}
@@ -0,0 +1,472 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+#include "../defs/chip8.h"
+#include "../defs/lockstep.h"
+#include "../defs/pool.h"
+#include "../defs/debugger.h"
+#include "../defs/scheduler.h"
+#include "../defs/defs.h"
+#ifdef BENCH_SDL
+#include "../defs/display.h"
+#endif
+
+// microbenchmarks do core: ips de cada rom (nos dois motores e com o trace do depurador),
+// kernels isolados (DXYN, ula, FX55/FX65, hires, espera do delay timer), reset da vm, o lockstep
+// e o VMPool com 1, 2, 4... threads ate o numero de nucleos (quanto escala)
+// compara com um arquivo de baseline pra pegar regressao antes de subir
+// com BENCH_SDL (make bench BENCH_SDL=1) tambem mede o Display::draw num renderer fora da tela
+
+// configs da linha de comando
+struct BenchConfig {
+    std::string roms = "roms/c8games"; // pasta com as roms medidas
+    std::string baseline;              // compara com esse arquivo
+    std::string write_baseline;        // grava o resultado como baseline nova
+    std::string filter;                // so roda os benchmarks com esse pedaco no nome
+    double tolerance = 10.0;           // quanto (em %) pode piorar antes de contar como regressao
+    double seconds = 0.2;              // tempo minimo de cada medida
+    int repeat = 3;                    // repeticoes de cada medida (fica a melhor)
+    int threads = 0;                   // maior numero de threads do pool/ (0 = os nucleos)
+};
+
+// resultado de um benchmark
+struct BenchResult {
+    std::string name;
+    uint64_t instructions; // instrucoes (ou draws, ou resets) da melhor repeticao
+    double ns_per_op;      // nanossegundos por instrucao (ou por draw, ou por reset)
+};
+
+static void print_help(const char *prog) {
+    std::printf(
+        "Uso: %s [opcoes]\n"
+        "Opcoes:\n"
+        "  --roms <pasta>            roms medidas (padrao roms/c8games)\n"
+        "  --baseline <arquivo>      compara com a baseline e falha se piorar mais que a tolerancia\n"
+        "  --write-baseline <arq>    grava o resultado como baseline\n"
+        "  --tolerance <pct>         piora aceita em %% (padrao 10)\n"
+        "  --filter <texto>          so roda benchmarks com esse texto no nome\n"
+        "  --seconds <s>             tempo minimo de cada medida (padrao 0.2)\n"
+        "  --repeat <n>              repeticoes de cada medida, fica a melhor (padrao 3)\n"
+        "  --threads <n>             pool/ mede de 1 ate n threads (padrao: os nucleos)\n"
+        "  --help                    mostra essa mensagem\n",
+        prog);
+}
+
+static bool parse_args(int argc, char **argv, BenchConfig &cfg) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--help") == 0) {
+            print_help(argv[0]);
+            return false;
+
+        } else if (std::strcmp(argv[i], "--roms") == 0 && i + 1 < argc) {
+            cfg.roms = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            cfg.baseline = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--write-baseline") == 0 && i + 1 < argc) {
+            cfg.write_baseline = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            cfg.tolerance = std::atof(argv[++i]);
+
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            cfg.filter = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            cfg.seconds = std::atof(argv[++i]);
+
+        } else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            cfg.repeat = std::atoi(argv[++i]);
+
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            cfg.threads = std::atoi(argv[++i]);
+
+        } else {
+            std::fprintf(stderr, "Opcao desconhecida: %s\n", argv[i]);
+            return false;
+        }
+    }
+    if (cfg.repeat <= 0) cfg.repeat = 1;
+    return true;
+}
+
+using bench_clock = std::chrono::steady_clock;
+
+static double elapsed(bench_clock::time_point since) {
+    return std::chrono::duration<double>(bench_clock::now() - since).count();
+}
+
+// roda a vm em frames de um clock bem alto ate dar o tempo minimo
+// a cada 30 frames solta/aperta uma tecla diferente, assim rom parada no FX0A anda
+// com trace roda pelo depurador gravando o trace so na memoria (o custo dos ganchos, sem o disco)
+static BenchResult runVM(const std::string &name, const Chip8 &image, const BenchConfig &cfg, bool trace = false) {
+    const int clock_hz = 60 * 100000; // 100 mil instrucoes por frame
+    BenchResult best{name, 0, 0.0};
+
+    for (int r = 0; r < cfg.repeat; ++r) {
+        Chip8 vm = image;
+        Debugger dbg;
+        if (trace) dbg.startTrace(vm, "");
+        uint64_t executed = 0;
+        uint64_t frame = 0;
+        auto start = bench_clock::now();
+        double secs;
+        do {
+            if (frame % 30 == 0) vm.setKey((frame / 30) % 16, true);
+            if (frame % 30 == 15) vm.setKey((frame / 30) % 16, false);
+            int cycles = Scheduler::frameCycles(clock_hz, frame);
+            executed += trace ? dbg.run(vm, cycles) : vm.run(cycles);
+            vm.tickTimers();
+            ++frame;
+            secs = elapsed(start);
+        } while (secs < cfg.seconds);
+
+        double ns = executed ? secs * 1e9 / (double) executed : 0.0;
+        if (r == 0 || ns < best.ns_per_op) {
+            best.instructions = executed;
+            best.ns_per_op = ns;
+        }
+    }
+    return best;
+}
+
+// monta uma vm com o programa (lista de opcodes) em 0x200
+static Chip8 makeKernel(const std::vector<uint16_t> &program, Engine engine) {
+    std::vector<uint8_t> bytes;
+    for (uint16_t op : program) {
+        bytes.push_back(op >> 8);
+        bytes.push_back(op & 0xFF);
+    }
+    Chip8 vm;
+    vm.initialize();
+    vm.seed(1);
+    vm.loadROM(bytes.data(), bytes.size());
+    vm.setEngine(engine);
+    return vm;
+}
+
+// custo de voltar a vm pro comeco da rom, como um fuzzer ou um lote faz entre uma execucao e outra
+// um lote de vms roda um pouco (suja memoria, tela e blocos) e so o reset do lote eh cronometrado
+// pristine usa o reset() da imagem limpa, senao eh o caminho antigo initialize + loadROM
+static BenchResult benchReset(const std::string &name, const std::vector<uint16_t> &program, bool pristine,
+                              const BenchConfig &cfg) {
+    const size_t batch = 64;
+    std::vector<uint8_t> bytes;
+    for (uint16_t op : program) {
+        bytes.push_back(op >> 8);
+        bytes.push_back(op & 0xFF);
+    }
+    Chip8 image = makeKernel(program, ENGINE_BLOCK);
+    image.markPristine();
+    BenchResult best{name, 0, 0.0};
+
+    for (int r = 0; r < cfg.repeat; ++r) {
+        std::vector<Chip8> vms(batch, image);
+        uint64_t resets = 0;
+        double secs = 0.0;
+        do {
+            for (Chip8 &vm : vms) vm.run(256);
+            auto start = bench_clock::now();
+            for (Chip8 &vm : vms) {
+                if (pristine) {
+                    vm.reset();
+                } else {
+                    vm.initialize();
+                    vm.loadROM(bytes.data(), bytes.size());
+                }
+            }
+            secs += elapsed(start);
+            resets += batch;
+        } while (secs < cfg.seconds);
+
+        double ns = secs * 1e9 / (double) resets;
+        if (r == 0 || ns < best.ns_per_op) {
+            best.instructions = resets;
+            best.ns_per_op = ns;
+        }
+    }
+    return best;
+}
+
+// fuzzing: LOCKSTEP_LANES vms com sementes diferentes no mesmo programa, rodando cada uma
+// sozinha (o jeito do pool) ou juntas no LockstepBatch. ns por instrucao somando as vms
+static BenchResult benchLockstep(const std::string &name, const std::vector<uint16_t> &program, bool batch,
+                                 const BenchConfig &cfg) {
+    const int clock_hz = 60 * 10000;
+    Chip8 image = makeKernel(program, ENGINE_SWITCH);
+    image.markPristine();
+    BenchResult best{name, 0, 0.0};
+
+    for (int r = 0; r < cfg.repeat; ++r) {
+        std::vector<Chip8> vms(LOCKSTEP_LANES, image);
+        for (int i = 0; i < LOCKSTEP_LANES; ++i) vms[i].seed(1 + i);
+        LockstepBatch lanes(vms.data(), LOCKSTEP_LANES);
+        uint64_t executed = 0;
+        uint64_t frame = 0;
+        auto start = bench_clock::now();
+        double secs;
+        do {
+            int cycles = Scheduler::frameCycles(clock_hz, frame);
+            if (batch) {
+                executed += lanes.run(cycles);
+            } else {
+                for (Chip8 &vm : vms) executed += vm.run(cycles);
+            }
+            for (Chip8 &vm : vms) vm.tickTimers();
+            ++frame;
+            secs = elapsed(start);
+        } while (secs < cfg.seconds);
+
+        double ns = executed ? secs * 1e9 / (double) executed : 0.0;
+        if (r == 0 || ns < best.ns_per_op) {
+            best.instructions = executed;
+            best.ns_per_op = ns;
+        }
+    }
+    return best;
+}
+
+// VMPool com o kernel de fuzzing em todas as vms, threads fixas: ns por instrucao de parede
+// (com o pool escalando, dobrar as threads corta pela metade)
+static BenchResult benchPool(const std::string &name, const std::vector<uint16_t> &program, int threads,
+                             const BenchConfig &cfg) {
+    const int clock_hz = 60 * 10000;
+    const size_t count = 256;
+    Chip8 image = makeKernel(program, ENGINE_SWITCH);
+    BenchResult best{name, 0, 0.0};
+
+    for (int r = 0; r < cfg.repeat; ++r) {
+        VMPool pool(count);
+        for (size_t i = 0; i < count; ++i) pool.vm(i) = image;
+        pool.seed(1);
+        uint64_t executed = 0;
+        auto start = bench_clock::now();
+        double secs;
+        do {
+            pool.run(8, clock_hz, threads, 2);
+            executed += pool.executed();
+            secs = elapsed(start);
+        } while (secs < cfg.seconds);
+
+        double ns = executed ? secs * 1e9 / (double) executed : 0.0;
+        if (r == 0 || ns < best.ns_per_op) {
+            best.instructions = executed;
+            best.ns_per_op = ns;
+        }
+    }
+    return best;
+}
+
+#ifdef BENCH_SDL
+// Display::draw num renderer de software com o driver de video fora da tela
+static bool benchDraw(const BenchConfig &cfg, BenchResult &best) {
+    SDL_setenv("SDL_VIDEODRIVER", "offscreen", 0);
+    SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        std::fprintf(stderr, "draw: SDL_Init falhou (%s)\n", SDL_GetError());
+        return false;
+    }
+    Display display;
+    if (!display.init(DEFAULT_SCALE)) {
+        SDL_Quit();
+        return false;
+    }
+
+    // tela com um padrao qualquer, metade dos pixels acesos
+    uint8_t frame[CHIP8_WIDTH * CHIP8_HEIGHT];
+    for (int i = 0; i < CHIP8_WIDTH * CHIP8_HEIGHT; ++i) frame[i] = ((i / CHIP8_WIDTH) + i) & 1;
+
+    best = {"draw", 0, 0.0};
+    for (int r = 0; r < cfg.repeat; ++r) {
+        uint64_t draws = 0;
+        auto start = bench_clock::now();
+        double secs;
+        do {
+            display.draw(frame, CHIP8_WIDTH, CHIP8_HEIGHT);
+            ++draws;
+            secs = elapsed(start);
+        } while (secs < cfg.seconds);
+        double ns = secs * 1e9 / (double) draws;
+        if (r == 0 || ns < best.ns_per_op) {
+            best.instructions = draws;
+            best.ns_per_op = ns;
+        }
+    }
+    display.shutdown();
+    SDL_Quit();
+    return true;
+}
+#endif
+
+// baseline: uma linha "<nome> <ns por instrucao>" por benchmark
+static bool loadBaseline(const std::string &path, std::map<std::string, double> &base) {
+    std::ifstream f(path);
+    if (!f.is_open()) return false;
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        std::string name;
+        double ns;
+        if (ss >> name >> ns) base[name] = ns;
+    }
+    return true;
+}
+
+static bool writeBaseline(const std::string &path, const std::vector<BenchResult> &results) {
+    std::ofstream f(path);
+    if (!f.is_open()) return false;
+    f << "# chip8-bench: <benchmark> <ns por instrucao (draw: ns por frame)>\n";
+    for (const BenchResult &r : results) {
+        char line[160];
+        std::snprintf(line, sizeof(line), "%s %.4f\n", r.name.c_str(), r.ns_per_op);
+        f << line;
+    }
+    return (bool) f;
+}
+
+int main(int argc, char **argv) {
+    BenchConfig cfg;
+    if (!parse_args(argc, argv, cfg)) return 1;
+
+    std::map<std::string, double> base;
+    if (!cfg.baseline.empty() && !loadBaseline(cfg.baseline, base)) {
+        std::fprintf(stderr, "Sem baseline em %s (gere com make bench-baseline)\n", cfg.baseline.c_str());
+    }
+
+    std::vector<BenchResult> results;
+    int regressions = 0;
+    auto wanted = [&](const std::string &name) {
+        return cfg.filter.empty() || name.find(cfg.filter) != std::string::npos;
+    };
+    auto report = [&](const BenchResult &r, const char *unit) {
+        results.push_back(r);
+        std::printf("%-28s %12.3f ns/%s %10.1f M%s/s", r.name.c_str(), r.ns_per_op, unit,
+                    r.ns_per_op > 0 ? 1e3 / r.ns_per_op : 0.0, unit);
+        auto it = base.find(r.name);
+        if (it != base.end() && it->second > 0) {
+            double delta = (r.ns_per_op / it->second - 1.0) * 100.0;
+            bool worse = delta > cfg.tolerance;
+            regressions += worse;
+            std::printf("  %+7.1f%%%s", delta, worse ? "  REGRESSAO" : "");
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+    };
+
+    static const Engine engines[] = {ENGINE_SWITCH, ENGINE_BLOCK};
+    static const char *const engine_names[] = {"switch", "block"};
+
+    // kernels isolados, todos em laco infinito
+    struct Kernel {
+        const char *name;
+        std::vector<uint16_t> program;
+    };
+    const std::vector<Kernel> kernels = {
+        // I = fonte, desenha 5 linhas, anda o x e repete
+        {"dxyn", {0xA000, 0xD015, 0x7001, 0x1202}},
+        // operacoes de ula do 8XY_ (inclusive as que mexem no vf)
+        {"alu", {0x6107, 0x6203, 0x8014, 0x8125, 0x8236, 0x8317, 0x842E, 0x8121, 0x8232, 0x8343, 0x8010, 0x1202}},
+        // copia os 16 registradores pra memoria e de volta (longe do codigo)
+        {"fx55-fx65", {0xA800, 0xFF55, 0xFF65, 0x7001, 0x1202}},
+        // hires do SUPER-CHIP: sprite 16x16 e as tres rolagens
+        {"schip", {0x00FF, 0xA000, 0xD010, 0x00C1, 0x00FB, 0x00FC, 0x7001, 0x1202}},
+        // espera o delay timer zerar (FX07/3000/1NNN) e arma de novo, um segundo por volta
+        {"idle", {0x6F3C, 0xFF15, 0xF007, 0x3000, 0x1204, 0x1200}},
+    };
+    for (const Kernel &k : kernels) {
+        for (int e = 0; e < 2; ++e) {
+            std::string name = std::string("kernel/") + k.name + "/" + engine_names[e];
+            if (!wanted(name)) continue;
+            report(runVM(name, makeKernel(k.program, engines[e]), cfg), "instr");
+        }
+    }
+
+    // reset da vm com o kernel que escreve na memoria (duas paginas sujas por volta)
+    for (int pristine = 0; pristine < 2; ++pristine) {
+        std::string name = pristine ? "reset/pristine" : "reset/initialize";
+        if (!wanted(name)) continue;
+        report(benchReset(name, kernels[2].program, pristine, cfg), "reset");
+    }
+
+    // lockstep: o kernel de ula (tudo em simd) e um de fuzzing, com aleatorio e skips que
+    // separam as lanes
+    const std::vector<Kernel> fuzz = {
+        kernels[1],
+        {"fuzz", {0xC0FF, 0xC1FF, 0x8014, 0x8105, 0x3000, 0x7101, 0x8216, 0x4200, 0x8312, 0x5010, 0x7201,
+                  0x8E1E, 0x1200}},
+    };
+    for (const Kernel &k : fuzz) {
+        for (int batch = 0; batch < 2; ++batch) {
+            std::string name = std::string("lockstep/") + k.name + (batch ? "/batch" : "/independent");
+            if (!wanted(name)) continue;
+            report(benchLockstep(name, k.program, batch, cfg), "instr");
+        }
+    }
+
+    // pool: 1, 2, 4... threads e o numero de nucleos (ou o --threads)
+    int cores = cfg.threads > 0 ? cfg.threads : (int) std::thread::hardware_concurrency();
+    if (cores <= 0) cores = 1;
+    for (int t = 1;; t = t * 2 < cores ? t * 2 : cores) {
+        std::string name = "pool/threads-" + std::to_string(t);
+        if (wanted(name)) report(benchPool(name, fuzz[1].program, t, cfg), "instr");
+        if (t == cores) break;
+    }
+
+    // todas as roms da pasta, em ordem de nome
+    std::vector<std::string> roms;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(cfg.roms, ec)) {
+        if (entry.is_regular_file()) roms.push_back(entry.path().string());
+    }
+    if (ec) std::fprintf(stderr, "Falha ao listar %s: %s\n", cfg.roms.c_str(), ec.message().c_str());
+    std::sort(roms.begin(), roms.end());
+
+    // a terceira coluna eh o interpretador passando pelo depurador com o trace ligado
+    // sem o atalho da espera do delay timer: as voltas puladas contariam como instrucao rodada
+    // (rom que so espera ia dar ~0 ns/instr) e o trace, que nunca pula, nao teria com quem
+    // comparar. quanto o atalho rende fica no kernel/idle
+    for (const std::string &path : roms) {
+        std::string rom = std::filesystem::path(path).filename().string();
+        for (int e = 0; e < 3; ++e) {
+            std::string name = "rom/" + rom + "/" + (e < 2 ? engine_names[e] : "trace");
+            if (!wanted(name)) continue;
+            Chip8 vm;
+            vm.initialize();
+            vm.seed(1);
+            if (!vm.loadROM(path)) continue; // nao eh rom (zip, pasta, etc)
+            vm.setEngine(e < 2 ? engines[e] : ENGINE_SWITCH);
+            vm.setIdleSkip(false);
+            report(runVM(name, vm, cfg, e == 2), "instr");
+        }
+    }
+
+#ifdef BENCH_SDL
+    BenchResult draw;
+    if (wanted("draw") && benchDraw(cfg, draw)) report(draw, "draw");
+#endif
+
+    if (!cfg.write_baseline.empty()) {
+        if (!writeBaseline(cfg.write_baseline, results)) {
+            std::fprintf(stderr, "Falha ao gravar baseline: %s\n", cfg.write_baseline.c_str());
+            return 1;
+        }
+        std::printf("baseline gravada em %s\n", cfg.write_baseline.c_str());
+    }
+    if (regressions > 0) {
+        std::printf("%d benchmark(s) piorou mais que %.0f%%\n", regressions, cfg.tolerance);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,416 @@
+#include "../defs/capture.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <zlib.h>
+
+Capture::~Capture() { close(); }
+
+CaptureFormat captureFormat(const std::string &path) {
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos) return CAPTURE_RAW;
+    std::string ext = path.substr(dot + 1);
+    for (char &c : ext) c = (char) std::tolower((unsigned char) c);
+    if (ext == "gif") return CAPTURE_GIF;
+    if (ext == "png" || ext == "apng") return CAPTURE_APNG;
+    return CAPTURE_RAW;
+}
+
+bool Capture::open(const std::string &path, int scale_, uint8_t r, uint8_t g, uint8_t b) {
+    close();
+    scale = std::max(1, scale_);
+    color[0] = r;
+    color[1] = g;
+    color[2] = b;
+    to_stdout = path == "-";
+    fmt = to_stdout ? CAPTURE_RAW : captureFormat(path);
+    out = to_stdout ? stdout : std::fopen(path.c_str(), "wb");
+    if (!out) return false;
+
+    has_pending = false;
+    queued_count = dropped_count = 0;
+    encoded_count = 0;
+    first = true;
+    owed = false;
+    write_ok = true;
+    elapsed = gif_cs = 0;
+    apng_frames = apng_seq = 0;
+    std::memset(previous, 0, sizeof(previous));
+    if (!queue) queue.reset(new SpscRing<CaptureFrame, CAPTURE_QUEUE_FRAMES>());
+    writeHeader();
+
+    closing = false;
+    worker = std::thread(&Capture::encodeLoop, this);
+    started = true;
+    return write_ok;
+}
+
+// ---- lado da emulacao ----
+
+void Capture::frame(const Chip8 &vm) {
+    if (!started) return;
+    // copia a tela do jeito que ela ta guardada (bits), desempacotar fica pro codificador
+    const uint64_t *rows = vm.videoRows();
+    CaptureFrame cur;
+    cur.hires = vm.isHires();
+    if (cur.hires) {
+        std::memcpy(cur.rows, rows, sizeof(cur.rows));
+    } else {
+        // o resto das linhas pode ter lixo de antes do 00FE, so as 32 primeiras valem
+        std::memset(cur.rows, 0, sizeof(cur.rows));
+        for (int y = 0; y < CHIP8_HEIGHT; ++y) cur.rows[y][0] = rows[2 * y];
+    }
+
+    // a tela nao mudou: so fica mais tempo
+    if (has_pending && pending.ticks < CAPTURE_MAX_TICKS && pending.hires == cur.hires &&
+        std::memcmp(pending.rows, cur.rows, sizeof(cur.rows)) == 0) {
+        ++pending.ticks;
+        return;
+    }
+    // mudou: a anterior ja tem a duracao final e vai pra fila. se nao coube, o tempo dela
+    // passa pra essa (perde a imagem mas nao o tempo)
+    uint32_t carry = 0;
+    if (has_pending) {
+        uint32_t ticks = pending.ticks;
+        if (!flushPending()) carry = ticks;
+    }
+    pending = cur;
+    pending.ticks = std::min<uint32_t>(1 + carry, CAPTURE_MAX_TICKS);
+    has_pending = true;
+}
+
+bool Capture::flushPending() {
+    has_pending = false;
+    if (queue->push(&pending, 1) == 0) {
+        ++dropped_count;
+        return false;
+    }
+    ++queued_count;
+    // sem pegar o mutex: se o aviso chegar antes do codificador dormir ele acorda sozinho
+    // no timeout do wait_for, a emulacao nunca espera por ele
+    wake.notify_one();
+    return true;
+}
+
+bool Capture::close() {
+    if (!started) return true;
+    // o ultimo frame nao pode sumir: aqui pode esperar ter lugar na fila
+    if (has_pending) {
+        while (queue->push(&pending, 1) == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ++queued_count;
+        has_pending = false;
+    }
+    closing.store(true, std::memory_order_release);
+    wake.notify_one();
+    worker.join();
+
+    writeTrailer();
+    if (to_stdout) {
+        if (std::fflush(out) != 0) write_ok = false;
+    } else if (std::fclose(out) != 0) {
+        write_ok = false;
+    }
+    out = nullptr;
+    started = false;
+    return write_ok;
+}
+
+// ---- thread do codificador ----
+
+void Capture::encodeLoop() {
+    CaptureFrame f;
+    for (;;) {
+        // le o closing antes do pop: tudo que entrou antes dele ja ta visivel na fila
+        bool done = closing.load(std::memory_order_acquire);
+        if (queue->pop(&f, 1)) {
+            encode(f);
+            encoded_count.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (done) break;
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+void Capture::encode(const CaptureFrame &f) {
+    // desempacota em 128x64 (lores com cada pixel dobrado)
+    for (int y = 0; y < SCHIP_HEIGHT; ++y) {
+        for (int x = 0; x < SCHIP_WIDTH; ++x) {
+            canvas[y * SCHIP_WIDTH + x] = f.hires ? (f.rows[y][x >> 6] >> (63 - (x & 63))) & 1
+                                                  : (f.rows[y >> 1][0] >> (63 - (x >> 1))) & 1;
+        }
+    }
+
+    elapsed += f.ticks;
+    if (fmt == CAPTURE_RAW) {
+        rawFrame(f.ticks);
+        return;
+    }
+    // o gif nao tem frame de menos de 2 centesimos (os navegadores trocam por 10): o frame
+    // curto fica pra tras e o proximo sai com o tempo dos dois (o retangulo ja pega os dois)
+    if (fmt == CAPTURE_GIF && gifTarget() < gif_cs + 2) {
+        owed = true;
+        return;
+    }
+    writeChange(f.ticks);
+}
+
+void Capture::writeChange(uint32_t ticks) {
+    // retangulo que mudou desde a ultima tela gravada (no primeiro frame a tela inteira)
+    int x0 = SCHIP_WIDTH, y0 = SCHIP_HEIGHT, x1 = 0, y1 = 0;
+    for (int y = 0; y < SCHIP_HEIGHT; ++y) {
+        for (int x = 0; x < SCHIP_WIDTH; ++x) {
+            if (!first && canvas[y * SCHIP_WIDTH + x] == previous[y * SCHIP_WIDTH + x]) continue;
+            x0 = std::min(x0, x);
+            x1 = std::max(x1, x + 1);
+            y0 = std::min(y0, y);
+            y1 = std::max(y1, y + 1);
+        }
+    }
+    // nada mudou (frame descartado no meio, ou so trocou de resolucao): um pixel igual,
+    // o frame precisa existir pra carregar o tempo
+    if (x1 == 0) {
+        x0 = y0 = 0;
+        x1 = y1 = 1;
+    }
+    scaleRect(x0, y0, x1, y1);
+    if (fmt == CAPTURE_GIF) gifFrame(x0 * scale, y0 * scale, (x1 - x0) * scale, (y1 - y0) * scale);
+    else apngFrame(x0 * scale, y0 * scale, (x1 - x0) * scale, (y1 - y0) * scale, ticks);
+    std::memcpy(previous, canvas, sizeof(canvas));
+    first = false;
+    owed = false;
+}
+
+void Capture::scaleRect(int x0, int y0, int x1, int y1) {
+    int w = (x1 - x0) * scale;
+    pixels.resize((size_t) w * (y1 - y0) * scale);
+    uint8_t *p = pixels.data();
+    for (int y = y0; y < y1; ++y) {
+        uint8_t *row = p;
+        for (int x = x0; x < x1; ++x) {
+            std::memset(p, canvas[y * SCHIP_WIDTH + x], scale);
+            p += scale;
+        }
+        for (int k = 1; k < scale; ++k, p += w) std::memcpy(p, row, w);
+    }
+}
+
+void Capture::writeBytes(const uint8_t *data, size_t n) {
+    if (n && std::fwrite(data, 1, n, out) != n) write_ok = false;
+}
+
+static void put16le(std::vector<uint8_t> &v, uint32_t x) {
+    v.push_back(x & 0xFF);
+    v.push_back((x >> 8) & 0xFF);
+}
+
+static void put32be(std::vector<uint8_t> &v, uint32_t x) {
+    for (int i = 3; i >= 0; --i) v.push_back((x >> (8 * i)) & 0xFF);
+}
+
+void Capture::writeHeader() {
+    bytes.clear();
+    if (fmt == CAPTURE_GIF) {
+        // tela logica com paleta global de 2 cores (fundo preto, pixel aceso) e loop infinito
+        const uint8_t sig[] = {'G', 'I', 'F', '8', '9', 'a'};
+        bytes.insert(bytes.end(), sig, sig + sizeof(sig));
+        put16le(bytes, width());
+        put16le(bytes, height());
+        bytes.push_back(0x80); // tem paleta global, 2 entradas
+        bytes.push_back(0);    // cor de fundo
+        bytes.push_back(0);    // proporcao do pixel
+        const uint8_t palette[] = {0, 0, 0, color[0], color[1], color[2]};
+        bytes.insert(bytes.end(), palette, palette + sizeof(palette));
+        const uint8_t loop[] = {0x21, 0xFF, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 3, 1, 0, 0, 0};
+        bytes.insert(bytes.end(), loop, loop + sizeof(loop));
+        writeBytes(bytes.data(), bytes.size());
+    } else if (fmt == CAPTURE_APNG) {
+        const uint8_t sig[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        writeBytes(sig, sizeof(sig));
+        // paleta de 8 bits (indice 0 ou 1 por pixel)
+        put32be(bytes, width());
+        put32be(bytes, height());
+        const uint8_t ihdr[] = {8, 3, 0, 0, 0};
+        bytes.insert(bytes.end(), ihdr, ihdr + sizeof(ihdr));
+        apngChunk("IHDR", bytes.data(), bytes.size());
+        // numero de frames ainda nao se sabe: volta aqui no fim
+        apng_actl = std::ftell(out);
+        bytes.clear();
+        put32be(bytes, 0);
+        put32be(bytes, 0); // repete pra sempre
+        apngChunk("acTL", bytes.data(), bytes.size());
+        const uint8_t palette[] = {0, 0, 0, color[0], color[1], color[2]};
+        apngChunk("PLTE", palette, sizeof(palette));
+    }
+}
+
+void Capture::writeTrailer() {
+    if (fmt == CAPTURE_GIF) {
+        // o ultimo frame pode ter ficado pra tras por ser curto
+        if (owed) writeChange(0);
+        const uint8_t end = 0x3B;
+        writeBytes(&end, 1);
+    } else if (fmt == CAPTURE_APNG) {
+        // png sem nenhuma imagem eh invalido: fecha com a tela vazia
+        if (apng_frames == 0) {
+            std::memset(canvas, 0, sizeof(canvas));
+            scaleRect(0, 0, SCHIP_WIDTH, SCHIP_HEIGHT);
+            apngFrame(0, 0, width(), height(), 1);
+        }
+        apngChunk("IEND", nullptr, 0);
+        // agora o acTL com o numero de frames (e o crc dele de novo)
+        bytes.clear();
+        put32be(bytes, apng_frames);
+        put32be(bytes, 0);
+        uint32_t crc = crc32(0, (const Bytef *) "acTL", 4);
+        crc = crc32(crc, bytes.data(), bytes.size());
+        put32be(bytes, crc);
+        if (apng_actl < 0 || std::fseek(out, apng_actl + 8, SEEK_SET) != 0) write_ok = false;
+        else writeBytes(bytes.data(), bytes.size());
+    }
+}
+
+// ---- gif ----
+
+// lzw do gif com codigo minimo de 2 bits (so os indices 0 e 1 aparecem), em sub-blocos de
+// ate 255 bytes. o dicionario eh uma arvore: filho de um codigo com mais um pixel
+static void gifLzw(const uint8_t *px, size_t n, std::vector<uint8_t> &out) {
+    const int min_bits = 2, clear = 1 << min_bits, eoi = clear + 1;
+    std::vector<uint16_t> tree(4096 * 4);
+    out.push_back(min_bits);
+
+    size_t block_at = out.size(); // byte com o tamanho do sub-bloco atual
+    out.push_back(0);
+    auto byte = [&](uint8_t b) {
+        if (out[block_at] == 255) {
+            block_at = out.size();
+            out.push_back(0);
+        }
+        out.push_back(b);
+        ++out[block_at];
+    };
+    uint32_t acc = 0;
+    int nacc = 0;
+    auto put = [&](int code, int bits) {
+        acc |= (uint32_t) code << nacc;
+        nacc += bits;
+        for (; nacc >= 8; nacc -= 8, acc >>= 8) byte(acc & 0xFF);
+    };
+
+    int bits = min_bits + 1, max_code = eoi, cur = -1;
+    put(clear, bits);
+    for (size_t i = 0; i < n; ++i) {
+        int v = px[i];
+        if (cur < 0) {
+            cur = v;
+            continue;
+        }
+        if (tree[cur * 4 + v]) {
+            cur = tree[cur * 4 + v];
+            continue;
+        }
+        put(cur, bits);
+        tree[cur * 4 + v] = ++max_code;
+        if (max_code >= (1 << bits)) ++bits;
+        // dicionario cheio: comeca outro
+        if (max_code == 4095) {
+            put(clear, bits);
+            std::fill(tree.begin(), tree.end(), 0);
+            bits = min_bits + 1;
+            max_code = eoi;
+        }
+        cur = v;
+    }
+    put(cur, bits);
+    // o decodificador anda um codigo atras: ao ler esse ele ainda cria uma entrada, e o fim
+    // ja tem que ir com o tamanho que ele vai estar esperando
+    if (++max_code >= (1 << bits)) ++bits;
+    put(eoi, bits);
+    if (nacc > 0) byte(acc & 0xFF);
+    if (out[block_at] == 0) out.pop_back();
+    out.push_back(0); // fim dos sub-blocos
+}
+
+void Capture::gifFrame(int x0, int y0, int w, int h) {
+    // o gif conta em centesimos: segue o relogio (elapsed) e nao a soma dos arredondados
+    uint64_t target = gifTarget();
+    uint64_t cs = std::min<uint64_t>(std::max<uint64_t>(target > gif_cs ? target - gif_cs : 0, 1), 0xFFFF);
+    gif_cs += cs;
+
+    bytes.clear();
+    // controle grafico: nao apaga o frame anterior (o retangulo vai por cima dele)
+    const uint8_t gce[] = {0x21, 0xF9, 4, 1 << 2, (uint8_t) (cs & 0xFF), (uint8_t) (cs >> 8), 0, 0};
+    bytes.insert(bytes.end(), gce, gce + sizeof(gce));
+    bytes.push_back(0x2C);
+    put16le(bytes, x0);
+    put16le(bytes, y0);
+    put16le(bytes, w);
+    put16le(bytes, h);
+    bytes.push_back(0); // sem paleta local, sem entrelacado
+    gifLzw(pixels.data(), pixels.size(), bytes);
+    writeBytes(bytes.data(), bytes.size());
+}
+
+// ---- apng ----
+
+void Capture::apngChunk(const char *type, const uint8_t *data, size_t n) {
+    uint8_t head[8];
+    for (int i = 0; i < 4; ++i) head[i] = (n >> (8 * (3 - i))) & 0xFF;
+    std::memcpy(head + 4, type, 4);
+    uint32_t crc = crc32(0, (const Bytef *) type, 4);
+    if (n) crc = crc32(crc, data, n);
+    uint8_t tail[4];
+    for (int i = 0; i < 4; ++i) tail[i] = (crc >> (8 * (3 - i))) & 0xFF;
+    writeBytes(head, sizeof(head));
+    writeBytes(data, n);
+    writeBytes(tail, sizeof(tail));
+}
+
+void Capture::apngFrame(int x0, int y0, int w, int h, uint32_t ticks) {
+    // fcTL: tamanho, posicao e duracao (ticks/60 s, exata), sem apagar nem misturar
+    bytes.clear();
+    put32be(bytes, apng_seq++);
+    put32be(bytes, w);
+    put32be(bytes, h);
+    put32be(bytes, x0);
+    put32be(bytes, y0);
+    bytes.push_back((ticks >> 8) & 0xFF);
+    bytes.push_back(ticks & 0xFF);
+    bytes.push_back(0);
+    bytes.push_back(60);
+    bytes.push_back(0); // APNG_DISPOSE_OP_NONE
+    bytes.push_back(0); // APNG_BLEND_OP_SOURCE
+    apngChunk("fcTL", bytes.data(), bytes.size());
+
+    // linhas com o filtro 0 na frente, comprimidas; o primeiro frame eh o IDAT (a imagem
+    // padrao, tela inteira), os outros fdAT com o numero de sequencia antes
+    std::vector<uint8_t> raw((size_t) (w + 1) * h);
+    for (int y = 0; y < h; ++y) {
+        raw[(size_t) y * (w + 1)] = 0;
+        std::memcpy(&raw[(size_t) y * (w + 1) + 1], &pixels[(size_t) y * w], w);
+    }
+    bool idat = apng_frames == 0;
+    bytes.clear();
+    if (!idat) put32be(bytes, apng_seq++);
+    size_t at = bytes.size();
+    uLongf len = compressBound(raw.size());
+    bytes.resize(at + len);
+    if (compress2(&bytes[at], &len, raw.data(), raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK) write_ok = false;
+    bytes.resize(at + len);
+    apngChunk(idat ? "IDAT" : "fdAT", bytes.data(), bytes.size());
+    ++apng_frames;
+}
+
+// ---- cru ----
+
+void Capture::rawFrame(uint32_t ticks) {
+    // rgb24 da tela inteira, repetido pra cada frame de 1/60s (o ffmpeg espera taxa fixa)
+    scaleRect(0, 0, SCHIP_WIDTH, SCHIP_HEIGHT);
+    bytes.resize(pixels.size() * 3);
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        for (int c = 0; c < 3; ++c) bytes[i * 3 + c] = pixels[i] ? color[c] : 0;
+    }
+    for (uint32_t t = 0; t < ticks; ++t) writeBytes(bytes.data(), bytes.size());
+}
@@ -1,13 +1,16 @@
 #include "../defs/chip8.h"
-#include "../defs/keyboard.h"
-#include "../defs/display.h"
+#include "../defs/romfile.h"
+#include "../defs/analyzer.h"
+#include "../defs/debugger.h"
 #include <cstdio>
 #include <cstring>
-#include <fstream>
 #include <random>
 
 // construtor da vm, chama initialize pra deixar tudo zerado
-Chip8::Chip8() {
+// a semente do aleatorio fica fora do initialize pra nao repetir a mesma sequencia
+Chip8::Chip8() : engine(ENGINE_SWITCH), quirks(QUIRKS_MODERN), idle_skip(true) {
+    rng_state = std::random_device{}();
+    if (rng_state == 0) rng_state = 1; // xorshift nao pode comecar em 0
     initialize(DEFAULT_PC_START);
 }
 
@@ -18,13 +21,25 @@ void Chip8::initialize(uint16_t start_pc) {
     I = 0;
     // zera o ponteiro da pilha
     SP = 0;
-    // zera o timer
+    // zera os timers
     delay_timer = 0;
+    sound_timer = 0;
     // zera toda a memoria e os registradores
     std::memset(memory, 0, sizeof(memory));
     std::memset(V, 0, sizeof(V));
     std::memset(stack, 0, sizeof(stack));
     std::memset(DISPLAY, 0, sizeof(DISPLAY));
+    hires = false;
+    video_stale = true;
+    frame_dirty = true;
+    std::memset(keypad, 0, sizeof(keypad));
+    wait_reg = -1;
+    cycle_count = 0;
+    halted = false;
+    std::memset(rpl, 0, sizeof(rpl));
+    pages_dirty = ~0ULL;
+    pages_touched = ~0ULL;
+    rows_dirty = ~0ULL;
 
     // carrega o conjunto de fontes padrao (sprites dos numeros 0-F)
     // esses bytes sao desenhados quando o programa pede pra mostrar numeros
@@ -39,298 +54,1119 @@ void Chip8::initialize(uint16_t start_pc) {
         0xF0, 0x80, 0xF0, 0x80, 0xF0, 0xF0, 0x80, 0xF0, 0x80, 0x80
     };
     for (int i = 0; i < 80; ++i) memory[i] = fontset[i];
+
+    // fonte grande do SUPER-CHIP (8x10), 0-9 do original e A-F que o XO-CHIP adicionou
+    static const uint8_t bigfont[160] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
+    for (int i = 0; i < 160; ++i) memory[BIGFONT_ADDR + i] = bigfont[i];
+
+    flushDecodeCache();
+    blocks.clear();
+    block_at.clear();
+    block_code.clear();
+    blocks_dirty = false;
+    code_readonly = false;
 }
 
-// le o arquivo da rom e coloca na memoria a partir do endereco 0x200
-bool Chip8::loadROM(const std::string &path, uint16_t load_addr) {
-    std::ifstream f(path, std::ios::binary | std::ios::ate);
-    if (!f.is_open()) {
-        return false;
+void Chip8::useAnalysis(const RomAnalysis &a) {
+    for (int addr = 0; addr < 4096; ++addr) {
+        if (a.flags[addr] & ADDR_INSTR) decoded[addr] = decode(fetch(addr));
     }
+    code_readonly = a.readonly;
+}
+
+void Chip8::markPristine() {
+    auto img = std::make_shared<Pristine>();
+    std::memcpy(img->memory, memory, sizeof(memory));
+    img->pc = PC;
+    pristine = std::move(img);
+    pages_touched = 0;
+}
 
-    std::streamsize size = f.tellg();
-    f.seekg(0, std::ios::beg);
+void Chip8::reset() {
+    if (!pristine) {
+        initialize();
+        return;
+    }
+    PC = pristine->pc;
+    I = 0;
+    SP = 0;
+    delay_timer = 0;
+    sound_timer = 0;
+    std::memset(V, 0, sizeof(V));
+    std::memset(stack, 0, sizeof(stack));
+    std::memset(keypad, 0, sizeof(keypad));
+    std::memset(rpl, 0, sizeof(rpl));
+    wait_reg = -1;
+    cycle_count = 0;
+    halted = false;
+    std::memset(DISPLAY, 0, sizeof(DISPLAY));
+    hires = false;
+    screenChanged();
 
+    // so as paginas escritas voltam, e o restorePage ainda pula as que voltaram sozinhas
+    // pro valor original (ele que invalida o cache de decodificacao e marca os blocos)
+    uint64_t touched = pages_touched;
+    for (uint64_t m = touched; m; m &= m - 1) {
+        int page = __builtin_ctzll(m);
+        restorePage(page, &pristine->memory[page * STATE_PAGE_SIZE]);
+    }
+    if (blocks_dirty) flushBlocks();
+    pages_dirty |= touched;
+    pages_touched = 0;
+}
+
+// le o arquivo da rom e coloca na memoria a partir do endereco 0x200
+bool Chip8::loadROM(const std::string &path, uint16_t load_addr) {
+    // arquivo mapeado (ou entrada de zip), os bytes vao direto pra memoria da vm
+    RomFile rom;
+    return rom.open(path) && loadROM(rom.data(), rom.size(), load_addr);
+}
+
+bool Chip8::loadROM(const uint8_t *data, size_t size, uint16_t load_addr) {
     if (load_addr + size > 4096) {
         return false;
     }
-    f.read(reinterpret_cast<char *>(&memory[load_addr]), size);
+    std::memcpy(&memory[load_addr], data, size);
+    flushDecodeCache();
+    flushBlocks();
+    pages_dirty = ~0ULL;
+    pages_touched = ~0ULL;
+    code_readonly = false;
     return true;
 }
 
+// atualiza o estado de uma tecla (teclas fora de 0x0-0xF sao ignoradas)
+// se a vm ta parada num FX0A, a tecla que acabou de ser apertada termina a espera
+void Chip8::setKey(uint8_t key, bool pressed) {
+    if (key > 0xF) return;
+    if (pressed && !keypad[key] && wait_reg >= 0) {
+        V[wait_reg] = key;
+        wait_reg = -1;
+        PC += 2; // agora sim sai do FX0A
+    }
+    keypad[key] = pressed;
+}
+
+// desempacota as linhas de bits pra um byte por pixel
+const uint8_t *Chip8::video() const {
+    if (video_stale) {
+        const int w = width(), h = height();
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                video_buf[y * w + x] = (DISPLAY[y][x >> 6] >> (63 - (x & 63))) & 1;
+            }
+        }
+        video_stale = false;
+    }
+    return video_buf;
+}
+
+// fnv-1a de 64 bits em cima dos pixels da tela (um byte por pixel, igual o video())
+uint64_t Chip8::videoHash() const {
+    uint64_t h = 1469598103934665603ULL;
+    const uint8_t *pixels = video();
+    for (int i = 0; i < width() * height(); ++i) {
+        uint8_t px = pixels[i];
+        h ^= px;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
 // reduz os timers em 1
 void Chip8::tickTimers() {
+    perf_counters.timerTick();
     if (delay_timer > 0) --delay_timer;
     if (sound_timer > 0) --sound_timer;
 }
 
+// monta o opcode com os 2 bytes (o endereco da volta no fim da memoria)
+uint16_t Chip8::fetch(uint16_t addr) const {
+    return (memory[addr & 0x0FFF] << 8) | memory[(addr + 1) & 0x0FFF];
+}
+
+void Chip8::writeMemory(uint16_t addr, uint8_t value) {
+    addr &= 0x0FFF;
+    memory[addr] = value;
+    pages_dirty |= 1ULL << (addr / STATE_PAGE_SIZE);
+    pages_touched |= 1ULL << (addr / STATE_PAGE_SIZE);
+    // rom provada sem escrita em codigo: o byte nao ta no cache nem em bloco nenhum
+    if (code_readonly) return;
+    // o byte faz parte da instrucao que comeca nele e da que comeca no anterior
+    decoded[addr].op = OP_NONE;
+    decoded[(addr - 1) & 0x0FFF].op = OP_NONE;
+    // se escreveu em cima de um bloco ele fica velho, mas o bloco que ta rodando
+    // agora pode ser ele mesmo, entao so marca e limpa entre um bloco e outro
+    if (!block_code.empty() && block_code[addr]) blocks_dirty = true;
+}
+
+void Chip8::flushDecodeCache() {
+    for (Instr &in : decoded) in.op = OP_NONE;
+}
+
+// separa os campos do opcode e escolhe o handler (o antigo switch do emulateCycle)
+Instr Chip8::decode(uint16_t opcode) {
+    Instr in;
+    in.nnn = opcode & 0x0FFF;
+    in.x = (opcode & 0x0F00) >> 8;
+    in.y = (opcode & 0x00F0) >> 4;
+    in.n = opcode & 0x000F;
+    in.nn = opcode & 0x00FF;
+    in.op = OP_UNKNOWN;
+
+    switch ((opcode & 0xF000) >> 12) {
+        case 0x0:
+            if (opcode == 0x00E0) in.op = OP_00E0;
+            else if (opcode == 0x00EE) in.op = OP_00EE;
+            else if ((opcode & 0xFFF0) == 0x00C0) in.op = OP_00CN;
+            else if (opcode == 0x00FB) in.op = OP_00FB;
+            else if (opcode == 0x00FC) in.op = OP_00FC;
+            else if (opcode == 0x00FD) in.op = OP_00FD;
+            else if (opcode == 0x00FE) in.op = OP_00FE;
+            else if (opcode == 0x00FF) in.op = OP_00FF;
+            break;
+        case 0x1: in.op = OP_1NNN;
+            break;
+        case 0x2: in.op = OP_2NNN;
+            break;
+        case 0x3: in.op = OP_3XNN;
+            break;
+        case 0x4: in.op = OP_4XNN;
+            break;
+        case 0x5: if (in.n == 0x0) in.op = OP_5XY0;
+            break;
+        case 0x6: in.op = OP_6XNN;
+            break;
+        case 0x7: in.op = OP_7XNN;
+            break;
+        case 0x8:
+            switch (in.n) {
+                case 0x0: in.op = OP_8XY0;
+                    break;
+                case 0x1: in.op = OP_8XY1;
+                    break;
+                case 0x2: in.op = OP_8XY2;
+                    break;
+                case 0x3: in.op = OP_8XY3;
+                    break;
+                case 0x4: in.op = OP_8XY4;
+                    break;
+                case 0x5: in.op = OP_8XY5;
+                    break;
+                case 0x6: in.op = OP_8XY6;
+                    break;
+                case 0x7: in.op = OP_8XY7;
+                    break;
+                case 0xE: in.op = OP_8XYE;
+                    break;
+                default: break;
+            }
+            break;
+        case 0x9: if (in.n == 0x0) in.op = OP_9XY0;
+            break;
+        case 0xA: in.op = OP_ANNN;
+            break;
+        case 0xB: in.op = OP_BNNN;
+            break;
+        case 0xC: in.op = OP_CXNN;
+            break;
+        case 0xD: in.op = in.n == 0 ? OP_DXY0 : OP_DXYN;
+            break;
+        case 0xE:
+            if (in.nn == 0x9E) in.op = OP_EX9E;
+            else if (in.nn == 0xA1) in.op = OP_EXA1;
+            break;
+        case 0xF:
+            switch (in.nn) {
+                case 0x07: in.op = OP_FX07;
+                    break;
+                case 0x0A: in.op = OP_FX0A;
+                    break;
+                case 0x15: in.op = OP_FX15;
+                    break;
+                case 0x18: in.op = OP_FX18;
+                    break;
+                case 0x1E: in.op = OP_FX1E;
+                    break;
+                case 0x29: in.op = OP_FX29;
+                    break;
+                case 0x30: in.op = OP_FX30;
+                    break;
+                case 0x33: in.op = OP_FX33;
+                    break;
+                case 0x55: in.op = OP_FX55;
+                    break;
+                case 0x65: in.op = OP_FX65;
+                    break;
+                case 0x75: in.op = OP_FX75;
+                    break;
+                case 0x85: in.op = OP_FX85;
+                    break;
+                default: break;
+            }
+            break;
+    }
+    return in;
+}
+
 // 00E0 - limpa a tela
-void Chip8::op_00E0() {
+void Chip8::op_00E0(const Instr &) {
+    std::memset(DISPLAY, 0, sizeof(DISPLAY));
+    screenChanged();
+}
+
+void Chip8::screenChanged() {
+    video_stale = true;
+    frame_dirty = true;
+    rows_dirty = ~0ULL;
+}
+
+// 00CN - rola a tela n linhas pra baixo (as de cima ficam apagadas)
+// a linha inteira eh copiada de uma vez, sem mexer pixel por pixel
+void Chip8::op_00CN(const Instr &in) {
+    int h = height();
+    if (in.n == 0) return;
+    std::memmove(&DISPLAY[in.n], &DISPLAY[0], (h - in.n) * sizeof(DISPLAY[0]));
+    std::memset(&DISPLAY[0], 0, in.n * sizeof(DISPLAY[0]));
+    screenChanged();
+}
+
+// 00FB - rola 4 pixels pra direita: shift nas palavras da linha (no hires o que sai
+// da primeira palavra entra na segunda)
+void Chip8::op_00FB(const Instr &) {
+    for (int y = 0; y < height(); ++y) {
+        if (hires) DISPLAY[y][1] = (DISPLAY[y][1] >> 4) | (DISPLAY[y][0] << 60);
+        DISPLAY[y][0] >>= 4;
+    }
+    screenChanged();
+}
+
+// 00FC - rola 4 pixels pra esquerda
+void Chip8::op_00FC(const Instr &) {
+    for (int y = 0; y < height(); ++y) {
+        DISPLAY[y][0] <<= 4;
+        if (hires) {
+            DISPLAY[y][0] |= DISPLAY[y][1] >> 60;
+            DISPLAY[y][1] <<= 4;
+        }
+    }
+    screenChanged();
+}
+
+// 00FD - sai do interpretador: a vm para nessa instrucao e nao roda mais
+uint16_t Chip8::op_00FD(const Instr &, uint16_t pc) {
+    halted = true;
+    return pc - 2;
+}
+
+// 00FE / 00FF - troca a resolucao (lores / hires), a tela comeca limpa
+void Chip8::op_00FE(const Instr &) {
+    hires = false;
     std::memset(DISPLAY, 0, sizeof(DISPLAY));
+    screenChanged();
+}
+
+void Chip8::op_00FF(const Instr &) {
+    hires = true;
+    std::memset(DISPLAY, 0, sizeof(DISPLAY));
+    screenChanged();
 }
 
 // 00EE - retorna de uma subrotina (volta da pilha)
-void Chip8::op_00EE() {
+uint16_t Chip8::op_00EE(const Instr &, uint16_t pc) {
     if (SP == 0) {
-        unknown(0x00EE);
-        return;
+        unknown(0x00EE, pc);
+        // a analise conta com chamada e retorno casados: daqui pra frente roda codigo que ela nao viu
+        code_readonly = false;
+        return pc;
     }
     --SP;
-    PC = stack[SP];
+    return stack[SP];
 }
 
 // 1NNN - pula pra endereco NNN
-void Chip8::op_1NNN(uint16_t opcode) { PC = opcode & 0x0FFF; }
+uint16_t Chip8::op_1NNN(const Instr &in, uint16_t) { return in.nnn; }
 
 // 2NNN - chama subrotina (empilha o pc e pula)
-void Chip8::op_2NNN(uint16_t opcode) {
+uint16_t Chip8::op_2NNN(const Instr &in, uint16_t pc) {
     if (SP >= 16) {
-        unknown(opcode);
-        return;
+        unknown(0x2000 | in.nnn, pc);
+        // segue no pc + 2 sem ter chamado: se a analise nao previu o estouro, isso eh codigo que ela nao viu
+        code_readonly = false;
+        return pc;
     }
-    stack[SP++] = PC;
-    PC = opcode & 0x0FFF;
+    stack[SP++] = pc;
+    return in.nnn;
 }
 
 // 3XNN - pula a proxima instrucao se vx == nn
-void Chip8::op_3XNN(uint16_t opcode) {
-    uint8_t x = (opcode & 0x0F00) >> 8;
-    uint8_t nn = opcode & 0x00FF;
-    if (V[x] == nn) PC += 2;
-}
+uint16_t Chip8::op_3XNN(const Instr &in, uint16_t pc) { return V[in.x] == in.nn ? pc + 2 : pc; }
 
 // 4XNN - pula se vx != nn
-void Chip8::op_4XNN(uint16_t opcode) {
-    uint8_t x = (opcode & 0x0F00) >> 8;
-    uint8_t nn = opcode & 0x00FF;
-    if (V[x] != nn) PC += 2;
-}
-
-// 5XY0 - compara dois registradores
-void Chip8::op_5XY0(uint16_t opcode) {
-    uint8_t x = (opcode & 0x0F00) >> 8;
-    uint8_t y = (opcode & 0x00F0) >> 4;
-    if ((opcode & 0x000F) == 0x0) {
-        if (V[x] == V[y]) PC += 2;
-    } else {
-        unknown(opcode);
-    }
-}
+uint16_t Chip8::op_4XNN(const Instr &in, uint16_t pc) { return V[in.x] != in.nn ? pc + 2 : pc; }
+
+// 5XY0 - pula se vx == vy
+uint16_t Chip8::op_5XY0(const Instr &in, uint16_t pc) { return V[in.x] == V[in.y] ? pc + 2 : pc; }
 
 // 6XNN - coloca valor direto em vx
-void Chip8::op_6XNN(uint16_t opcode) {
-    uint8_t x = (opcode & 0x0F00) >> 8;
-    uint8_t nn = opcode & 0x00FF;
-    V[x] = nn;
-}
+void Chip8::op_6XNN(const Instr &in) { V[in.x] = in.nn; }
 
 // 7XNN - soma valor em vx (sem carry)
-void Chip8::op_7XNN(uint16_t opcode) {
-    uint8_t x = (opcode & 0x0F00) >> 8;
-    uint8_t nn = opcode & 0x00FF;
-    V[x] = static_cast<uint8_t>(V[x] + nn);
-}
+void Chip8::op_7XNN(const Instr &in) { V[in.x] = static_cast<uint8_t>(V[in.x] + in.nn); }
 
 // 8XY_ - operacoes entre registradores
-void Chip8::op_8XY_(uint16_t opcode) {
-    uint8_t x = (opcode & 0x0F00) >> 8;
-    uint8_t y = (opcode & 0x00F0) >> 4;
-    switch (opcode & 0x000F) {
-        case 0x0: V[x] = V[y];
-            break; // copia
-        case 0x1: V[x] |= V[y];
-            break; // or
-        case 0x2: V[x] &= V[y];
-            break; // and
-        case 0x3: V[x] ^= V[y];
-            break; // xor
-        case 0x4: {
-            // soma com carry
-            uint16_t sum = V[x] + V[y];
-            V[0xF] = (sum > 0xFF);
-            V[x] = static_cast<uint8_t>(sum);
-            break;
-        }
-        case 0x5: {
-            // subtrai
-            V[0xF] = (V[x] >= V[y]);
-            V[x] -= V[y];
-            break;
-        }
-        case 0x6: {
-            // shift right
-            V[0xF] = V[x] & 0x1;
-            V[x] >>= 1;
-            break;
-        }
-        case 0x7: {
-            // vy - vx
-            V[0xF] = (V[y] >= V[x]);
-            V[x] = V[y] - V[x];
-            break;
-        }
-        case 0xE: {
-            // shift left
-            V[0xF] = (V[x] & 0x80) != 0;
-            V[x] <<= 1;
-            break;
-        }
-        default: unknown(opcode);
-    }
+void Chip8::op_8XY0(const Instr &in) { V[in.x] = V[in.y]; } // copia
+// no VIP as logicas zeram o vf (efeito colateral da rotina da ula original)
+template <class Q> void Chip8::op_8XY1(const Instr &in) { // or
+    V[in.x] |= V[in.y];
+    if constexpr (Q::vf_reset) V[0xF] = 0;
+}
+template <class Q> void Chip8::op_8XY2(const Instr &in) { // and
+    V[in.x] &= V[in.y];
+    if constexpr (Q::vf_reset) V[0xF] = 0;
+}
+template <class Q> void Chip8::op_8XY3(const Instr &in) { // xor
+    V[in.x] ^= V[in.y];
+    if constexpr (Q::vf_reset) V[0xF] = 0;
 }
 
-// 9XY0 - pula se vx != vy
-void Chip8::op_9XY0(uint16_t opcode) {
-    uint8_t x = (opcode & 0x0F00) >> 8;
-    uint8_t y = (opcode & 0x00F0) >> 4;
-    if ((opcode & 0x000F) == 0x0) {
-        if (V[x] != V[y]) PC += 2;
-    } else {
-        unknown(opcode);
-    }
+// soma com carry
+void Chip8::op_8XY4(const Instr &in) {
+    uint16_t sum = V[in.x] + V[in.y];
+    V[0xF] = (sum > 0xFF);
+    V[in.x] = static_cast<uint8_t>(sum);
 }
 
+// subtrai
+void Chip8::op_8XY5(const Instr &in) {
+    V[0xF] = (V[in.x] >= V[in.y]);
+    V[in.x] -= V[in.y];
+}
+
+// shift right (no VIP desloca o vy e guarda no vx)
+template <class Q> void Chip8::op_8XY6(const Instr &in) {
+    if constexpr (Q::shift_vy) V[in.x] = V[in.y];
+    V[0xF] = V[in.x] & 0x1;
+    V[in.x] >>= 1;
+}
+
+// vy - vx
+void Chip8::op_8XY7(const Instr &in) {
+    V[0xF] = (V[in.y] >= V[in.x]);
+    V[in.x] = V[in.y] - V[in.x];
+}
+
+// shift left (no VIP desloca o vy e guarda no vx)
+template <class Q> void Chip8::op_8XYE(const Instr &in) {
+    if constexpr (Q::shift_vy) V[in.x] = V[in.y];
+    V[0xF] = (V[in.x] & 0x80) != 0;
+    V[in.x] <<= 1;
+}
+
+// 9XY0 - pula se vx != vy
+uint16_t Chip8::op_9XY0(const Instr &in, uint16_t pc) { return V[in.x] != V[in.y] ? pc + 2 : pc; }
+
 // ANNN - coloca endereco em I
-void Chip8::op_ANNN(uint16_t opcode) { I = opcode & 0x0FFF; }
+void Chip8::op_ANNN(const Instr &in) { I = in.nnn; }
 
-// BNNN - pula pra nnn + v0
-void Chip8::op_BNNN(uint16_t opcode) { PC = (opcode & 0x0FFF) + V[0]; }
+// BNNN - pula pra nnn + v0 (CHIP-48 e SUPER-CHIP leem como BXNN: xnn + vx)
+template <class Q> uint16_t Chip8::op_BNNN(const Instr &in, uint16_t) {
+    return in.nnn + V[Q::jump_vx ? in.x : 0];
+}
 
 // CXNN - gera numero aleatorio & nn
-void Chip8::op_CXNN(uint16_t opcode) {
-    static std::mt19937 rng{std::random_device{}()};
-    std::uniform_int_distribution<int> dist(0, 255);
-    uint8_t x = (opcode & 0x0F00) >> 8;
-    uint8_t nn = opcode & 0x00FF;
-    V[x] = static_cast<uint8_t>(dist(rng) & nn);
+void Chip8::op_CXNN(const Instr &in) {
+    // xorshift32, usa o byte de cima que eh o mais aleatorio
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    V[in.x] = static_cast<uint8_t>((rng_state >> 24) & in.nn);
 }
 
 // DXYN - desenha sprite (n linhas) na tela
-void Chip8::op_DXYN(uint16_t opcode, Display &disp) {
-    uint8_t x = (opcode & 0x0F00) >> 8;
-    uint8_t y = (opcode & 0x00F0) >> 4;
-    uint8_t n = (opcode & 0x000F);
-    uint8_t X = V[x] % CHIP8_WIDTH;
-    uint8_t Y = V[y] % CHIP8_HEIGHT;
-    V[0xF] = 0;
-
-    // percorre as linhas do sprite e desenha na tela
-    for (int row = 0; row < n; ++row) {
-        uint8_t spriteByte = memory[I + row];
-        for (int col = 0; col < 8; ++col) {
-            if ((spriteByte & (0x80 >> col)) != 0) {
-                int px = (X + col) % CHIP8_WIDTH;
-                int py = (Y + row) % CHIP8_HEIGHT;
-                int idx = py * CHIP8_WIDTH + px;
-                if (DISPLAY[idx] == 1) V[0xF] = 1; // colisao
-                DISPLAY[idx] ^= 1; // alterna pixel (xor)
+template <class Q> void Chip8::op_DXYN(const Instr &in) { drawSprite<Q, false>(in, in.n); }
+
+// DXY0 - sprite 16x16 do SUPER-CHIP (2 bytes por linha)
+template <class Q> void Chip8::op_DXY0(const Instr &in) { drawSprite<Q, true>(in, 16); }
+
+// cada linha do sprite vira uma palavra de 64 bits ja na posicao x (rotacao faz o
+// wrap horizontal), ai colisao eh um AND e desenhar eh um XOR na linha inteira
+// no hires a linha tem 2 palavras: o sprite cai numa e o que passa vai pra outra
+// com clip o que passa da borda some: sem a volta na horizontal e sem linhas depois da ultima
+template <class Q, bool Wide> void Chip8::drawSprite(const Instr &in, int rows) {
+    const int h = height();
+    int Y = V[in.y] & (h - 1);
+    uint64_t hit = 0;
+    int pixels = 0;
+    if (Q::clip && Y + rows > h) rows = h - Y;
+
+    // linha do sprite alinhada a esquerda numa palavra de 64 bits
+    auto bits = [&](int row) -> uint64_t {
+        if constexpr (Wide) {
+            uint16_t addr = I + 2 * row;
+            return static_cast<uint64_t>((memory[addr & 0x0FFF] << 8) | memory[(addr + 1) & 0x0FFF]) << 48;
+        } else {
+            return static_cast<uint64_t>(memory[(I + row) & 0x0FFF]) << 56;
+        }
+    };
+
+    // o modo nao muda no meio do sprite, entao o loop de cada um fica separado
+    if (!hires) {
+        int X = V[in.x] % CHIP8_WIDTH;
+        for (int row = 0; row < rows; ++row) {
+            int y = (Y + row) % CHIP8_HEIGHT;
+            uint64_t sprite = bits(row);
+            if constexpr (Q::clip) sprite >>= X;
+            else sprite = (sprite >> X) | (sprite << ((64 - X) & 63));
+            uint64_t &line = DISPLAY[y][0];
+            hit |= line & sprite; // colisao
+            line ^= sprite; // alterna os pixels (xor)
+            rows_dirty |= 1ULL << y; // linha mudou pro proximo delta
+            if constexpr (PerfCounters::enabled) pixels += __builtin_popcountll(sprite);
+        }
+    } else {
+        int X = V[in.x] % SCHIP_WIDTH;
+        for (int row = 0; row < rows; ++row) {
+            int y = (Y + row) % SCHIP_HEIGHT;
+            uint64_t sprite = bits(row), s0, s1;
+            if (X < 64) {
+                s0 = sprite >> X;
+                s1 = X ? sprite << (64 - X) : 0;
+            } else {
+                s1 = sprite >> (X - 64);
+                s0 = Q::clip || X == 64 ? 0 : sprite << (128 - X); // volta pra coluna 0
             }
+            uint64_t *line = DISPLAY[y];
+            hit |= (line[0] & s0) | (line[1] & s1);
+            line[0] ^= s0;
+            line[1] ^= s1;
+            rows_dirty |= 1ULL << y;
+            if constexpr (PerfCounters::enabled) pixels += __builtin_popcountll(s0) + __builtin_popcountll(s1);
         }
     }
+    V[0xF] = hit != 0;
+    perf_counters.sprite(pixels, hit != 0);
+    video_stale = true;
+    frame_dirty = true;
+}
+
+// EX9E - pula se tecla ta pressionada
+uint16_t Chip8::op_EX9E(const Instr &in, uint16_t pc) { return V[in.x] <= 0xF && keypad[V[in.x]] ? pc + 2 : pc; }
+
+// EXA1 - pula se tecla nao ta pressionada
+uint16_t Chip8::op_EXA1(const Instr &in, uint16_t pc) { return V[in.x] > 0xF || !keypad[V[in.x]] ? pc + 2 : pc; }
+
+// FX07 - le o delay timer
+void Chip8::op_FX07(const Instr &in) { V[in.x] = delay_timer; }
+
+// FX0A - espera tecla
+// nao fica rodando em volta: marca a vm como esperando e o pc fica parado no FX0A.
+// o run() devolve o resto do orcamento e quem chama continua com timers e tela.
+// a espera acaba quando o setKey recebe uma tecla nova apertada
+uint16_t Chip8::op_FX0A(const Instr &in, uint16_t pc) {
+    wait_reg = in.x;
+    return pc - 2;
+}
+
+// FX15 - seta delay timer
+void Chip8::op_FX15(const Instr &in) { delay_timer = V[in.x]; }
+
+// FX18 - seta sound timer (o beep toca enquanto ele nao zerar)
+void Chip8::op_FX18(const Instr &in) { sound_timer = V[in.x]; }
+
+// FX1E - soma v[x] em I
+void Chip8::op_FX1E(const Instr &in) { I += V[in.x]; }
+
+// FX29 - pega endereco da fonte do digito
+void Chip8::op_FX29(const Instr &in) { I = V[in.x] * 5; }
+
+// FX30 - endereco do digito vx na fonte grande
+void Chip8::op_FX30(const Instr &in) { I = BIGFONT_ADDR + (V[in.x] & 0xF) * 10; }
+
+// FX75 - guarda v0..vx nas flags rpl
+void Chip8::op_FX75(const Instr &in) { std::memcpy(rpl, V, in.x + 1); }
+
+// FX85 - le v0..vx das flags rpl
+void Chip8::op_FX85(const Instr &in) { std::memcpy(V, rpl, in.x + 1); }
+
+// FX33 - bcd (conversao pra decimal)
+void Chip8::op_FX33(const Instr &in) {
+    uint8_t val = V[in.x];
+    writeMemory(I, val / 100);
+    writeMemory(I + 1, (val / 10) % 10);
+    writeMemory(I + 2, val % 10);
+}
+
+// FX55 - salva registradores (VIP e CHIP-48 deixam o I andando junto)
+template <class Q> void Chip8::op_FX55(const Instr &in) {
+    for (int i = 0; i <= in.x; ++i) writeMemory(I + i, V[i]);
+    if constexpr (Q::memory == MEMORY_I_X1) I += in.x + 1;
+    if constexpr (Q::memory == MEMORY_I_X) I += in.x;
+}
+
+// FX65 - carrega registradores
+template <class Q> void Chip8::op_FX65(const Instr &in) {
+    for (int i = 0; i <= in.x; ++i) V[i] = memory[(I + i) & 0x0FFF];
+    if constexpr (Q::memory == MEMORY_I_X1) I += in.x + 1;
+    if constexpr (Q::memory == MEMORY_I_X) I += in.x;
+}
+
+uint16_t Chip8::op_unknown(const Instr &, uint16_t pc) {
+    // a entrada do cache eh invalidada quando a memoria muda, entao o opcode ainda ta la
+    unknown(fetch(pc - 2), pc);
+    return pc;
+}
+
+// funcao pra opcode invalido (so imprime erro)
+void Chip8::unknown(uint16_t opcode, uint16_t pc) const {
+    std::fprintf(stderr, "Unknown/unsupported opcode: 0x%04X at PC=0x%04X\n", opcode, pc);
+}
+
+// executa 1 ciclo da cpu (busca, decodifica, executa)
+void Chip8::emulateCycle() { run(1); }
+
+int Chip8::run(int cycles) {
+    cycle_count += cycles; // o relogio anda mesmo se a vm ficar parada esperando tecla
+    if (wait_reg >= 0 || halted) return 0; // esperando tecla ou parada, nao tem o que rodar
+    switch (quirks) {
+        case QUIRKS_VIP: return runWith<QuirksVIP>(cycles);
+        case QUIRKS_CHIP48: return runWith<QuirksChip48>(cycles);
+        case QUIRKS_SCHIP: return runWith<QuirksSChip>(cycles);
+        default: return runWith<QuirksModern>(cycles);
+    }
+}
+
+template <class Q> int Chip8::runWith(int cycles) {
+    if (engine == ENGINE_BLOCK) return runBlocks<Q>(cycles);
+    return runSwitch<Q>(cycles);
 }
 
-// EX__ - instrucoes de teclado
-void Chip8::op_EX__(uint16_t opcode, Keyboard &kb) {
-    uint8_t x = (opcode & 0x0F00) >> 8;
-    switch (opcode & 0x00FF) {
-        case 0x9E: if (kb.isPressed(V[x])) PC += 2;
-            break; // pula se tecla ta pressionada
-        case 0xA1: if (!kb.isPressed(V[x])) PC += 2;
-            break; // pula se tecla nao ta pressionada
-        default: unknown(opcode);
+int Chip8::runDebug(int cycles, Debugger &dbg) {
+    dbg.stop = DEBUG_NONE;
+    if (wait_reg >= 0 || halted) {
+        cycle_count += cycles;
+        return 0;
+    }
+    int n;
+    switch (quirks) {
+        case QUIRKS_VIP: n = runSwitch<QuirksVIP, false, true>(cycles, nullptr, &dbg); break;
+        case QUIRKS_CHIP48: n = runSwitch<QuirksChip48, false, true>(cycles, nullptr, &dbg); break;
+        case QUIRKS_SCHIP: n = runSwitch<QuirksSChip, false, true>(cycles, nullptr, &dbg); break;
+        default: n = runSwitch<QuirksModern, false, true>(cycles, nullptr, &dbg); break;
     }
+    // parou no depurador: o resto do orcamento ainda vai rodar, so conta quando rodar
+    cycle_count += dbg.stop == DEBUG_NONE ? cycles : n;
+    return n;
 }
 
-// FX__ - operacoes de timer, memoria, etc
-void Chip8::op_FX__(uint16_t opcode, Keyboard &kb, Display &disp) {
-    uint8_t x = (opcode & 0x0F00) >> 8;
-    switch (opcode & 0x00FF) {
-        case 0x07: V[x] = delay_timer;
-            break; // le o delay timer
-        case 0x0A: {
-            int k = kb.waitForKey();
-            V[x] = k;
-            break;
-        } // espera tecla
-        case 0x15: delay_timer = V[x];
-            break; // seta delay timer
-        case 0x18: sound_timer = V[x];
-            break; // seta sound timer (sem som, so pra nao dar erro)
-        case 0x1E: I += V[x];
-            break; // soma v[x] em I
-        case 0x29: I = V[x] * 5;
-            break; // pega endereco da fonte do digito
-        case 0x33: {
-            // bcd (conversao pra decimal)
-            uint8_t val = V[x];
-            memory[I] = val / 100;
-            memory[I + 1] = (val / 10) % 10;
-            memory[I + 2] = val % 10;
-            break;
+bool Chip8::debugWatch(Debugger &dbg, uint16_t opcode, const uint8_t *before, uint16_t i0) {
+    uint32_t changed = I != i0 ? 1u << DEBUG_REG_I : 0;
+    for (int k = 0; k < 16; ++k) changed |= (uint32_t) (V[k] != before[k]) << k;
+    uint32_t hit = changed & dbg.watch_regs;
+    if (hit) {
+        dbg.stop = DEBUG_WATCH;
+        dbg.watch_hit = hit;
+        dbg.watch_addr = -1;
+        return true;
+    }
+    if ((opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055) {
+        int len = (opcode & 0xF0FF) == 0xF033 ? 3 : ((opcode >> 8) & 0xF) + 1;
+        for (int k = 0; k < len; ++k) {
+            if (!dbg.watch_mem[(i0 + k) & 0x0FFF]) continue;
+            dbg.stop = DEBUG_WATCH;
+            dbg.watch_hit = 0;
+            dbg.watch_addr = (i0 + k) & 0x0FFF;
+            return true;
         }
-        case 0x55: for (int i = 0; i <= x; ++i) memory[I + i] = V[i];
-            break; // salva registradores
-        case 0x65: for (int i = 0; i <= x; ++i) V[i] = memory[I + i];
-            break; // carrega registradores
-        default: unknown(opcode);
     }
+    return false;
 }
 
-// funcao pra opcode invalido (so imprime erro)
-void Chip8::unknown(uint16_t opcode) const {
-    std::fprintf(stderr, "Unknown/unsupported opcode: 0x%04X at PC=0x%04X\n", opcode, PC);
+inline bool Chip8::debugStep(Debugger &dbg, bool tracing, bool watching, uint16_t at, uint16_t opcode,
+                             const uint8_t *before, uint16_t i0) {
+    if (tracing) dbg.record({at, opcode, I, V[(opcode >> 8) & 0xF], V[0xF], SP, TRACE_INSTR});
+    return watching && debugWatch(dbg, opcode, before, i0);
 }
 
-// executa 1 ciclo da cpu (busca, decodifica, executa)
-void Chip8::emulateCycle(Keyboard &kb, Display &disp) {
-    // pega 2 bytes da memoria e forma o opcode
-    uint16_t opcode = (memory[PC] << 8) | memory[PC + 1];
-    PC += 2;
+// loop principal do interpretador. o switch fica aqui dentro (e nao numa funcao
+// separada) pra o compilador conseguir colocar os handlers pequenos direto nele.
+// o pc fica numa variavel local durante o loop: as instrucoes de desvio recebem
+// o pc e devolvem o proximo, as outras nem encostam nele
+template <class Q, bool Stop, bool Debug> int Chip8::runSwitch(int cycles, const uint8_t *stop, Debugger *dbg) {
+    uint16_t pc = PC;
+    // trace e watchpoints nao mudam dentro de um run (so no console, com a vm parada)
+    [[maybe_unused]] const bool tracing = Debug && dbg->tracing;
+    [[maybe_unused]] const bool watching = Debug && dbg->watching();
+    for (int c = 0; c < cycles; ++c) {
+        if constexpr (Stop) {
+            if (c > 0 && stop[pc & 0x0FFF]) {
+                PC = pc;
+                return c;
+            }
+        }
+        if constexpr (Debug) {
+            // a primeira instrucao o Debugger::run ja conferiu antes de chamar
+            if (c > 0 && (dbg->breaks[pc & 0x0FFF] || dbg->pause_req.load(std::memory_order_relaxed))) {
+                dbg->stop = dbg->breaks[pc & 0x0FFF] ? DEBUG_BREAK : DEBUG_PAUSE;
+                PC = pc;
+                return c;
+            }
+        }
+        // o pc da volta no fim da memoria (igual no motor de blocos)
+        pc &= 0x0FFF;
 
-    // separa o grupo
-    uint8_t group = (opcode & 0xF000) >> 12;
+        // usa a instrucao do cache, so decodifica se a entrada ta vazia
+        Instr &in = decoded[pc];
+        if (in.op == OP_NONE) in = decode(fetch(pc));
 
-    // escolhe a operacao pelo grupo
-    switch (group) {
-        case 0x0:
-            switch (opcode & 0x00FF) {
-                case 0xE0: op_00E0();
-                    break;
-                case 0xEE: op_00EE();
-                    break;
-                default: unknown(opcode);
+        // o depurador precisa do opcode (a propria instrucao pode sobrescrever ele) e, so com
+        // watchpoint, dos registradores antes dela
+        [[maybe_unused]] uint8_t before[16];
+        [[maybe_unused]] uint16_t here = pc, opcode = 0, i0 = 0;
+        if constexpr (Debug) {
+            opcode = fetch(pc);
+            if (watching) {
+                std::memcpy(before, V, 16);
+                i0 = I;
             }
-            break;
-        case 0x1: op_1NNN(opcode);
-            break;
-        case 0x2: op_2NNN(opcode);
-            break;
-        case 0x3: op_3XNN(opcode);
-            break;
-        case 0x4: op_4XNN(opcode);
-            break;
-        case 0x5: op_5XY0(opcode);
-            break;
-        case 0x6: op_6XNN(opcode);
-            break;
-        case 0x7: op_7XNN(opcode);
-            break;
-        case 0x8: op_8XY_(opcode);
-            break;
-        case 0x9: op_9XY0(opcode);
-            break;
-        case 0xA: op_ANNN(opcode);
-            break;
-        case 0xB: op_BNNN(opcode);
-            break;
-        case 0xC: op_CXNN(opcode);
-            break;
-        case 0xD: op_DXYN(opcode, disp);
-            break;
-        case 0xE: op_EX__(opcode, kb);
-            break;
-        case 0xF: op_FX__(opcode, kb, disp);
-            break;
-        default: unknown(opcode);
+        }
+        pc += 2;
+        perf_counters.op(in.op);
+
+        switch (in.op) {
+            case OP_00E0: op_00E0(in);
+                break;
+            case OP_00EE: pc = op_00EE(in, pc);
+                break;
+            case OP_1NNN: {
+                uint16_t at = pc - 2;
+                pc = op_1NNN(in, pc);
+                // pulo pra tras num FX07: pode ser a espera do delay timer
+                // (no depurador nao: cada volta tem que passar pelos ganchos)
+                if (!Debug && pc < at && decoded[pc].op == OP_FX07) {
+                    int to = idleLoop(at, pc, cycles - c - 1);
+                    if (to >= 0) {
+                        PC = to;
+                        return cycles;
+                    }
+                }
+                break;
+            }
+            case OP_2NNN: pc = op_2NNN(in, pc);
+                break;
+            case OP_3XNN: pc = op_3XNN(in, pc);
+                break;
+            case OP_4XNN: pc = op_4XNN(in, pc);
+                break;
+            case OP_5XY0: pc = op_5XY0(in, pc);
+                break;
+            case OP_6XNN: op_6XNN(in);
+                break;
+            case OP_7XNN: op_7XNN(in);
+                break;
+            case OP_8XY0: op_8XY0(in);
+                break;
+            case OP_8XY1: op_8XY1<Q>(in);
+                break;
+            case OP_8XY2: op_8XY2<Q>(in);
+                break;
+            case OP_8XY3: op_8XY3<Q>(in);
+                break;
+            case OP_8XY4: op_8XY4(in);
+                break;
+            case OP_8XY5: op_8XY5(in);
+                break;
+            case OP_8XY6: op_8XY6<Q>(in);
+                break;
+            case OP_8XY7: op_8XY7(in);
+                break;
+            case OP_8XYE: op_8XYE<Q>(in);
+                break;
+            case OP_9XY0: pc = op_9XY0(in, pc);
+                break;
+            case OP_ANNN: op_ANNN(in);
+                break;
+            case OP_BNNN: pc = op_BNNN<Q>(in, pc);
+                break;
+            case OP_CXNN: op_CXNN(in);
+                break;
+            case OP_DXYN: op_DXYN<Q>(in);
+                break;
+            case OP_EX9E: pc = op_EX9E(in, pc);
+                break;
+            case OP_EXA1: pc = op_EXA1(in, pc);
+                break;
+            case OP_FX07: op_FX07(in);
+                break;
+            case OP_FX0A: pc = op_FX0A(in, pc);
+                // parou esperando tecla: devolve o resto do orcamento
+                if constexpr (Debug) debugStep(*dbg, tracing, watching, here, opcode, before, i0);
+                PC = pc;
+                return c + 1;
+            case OP_FX15: op_FX15(in);
+                break;
+            case OP_FX18: op_FX18(in);
+                break;
+            case OP_FX1E: op_FX1E(in);
+                break;
+            case OP_FX29: op_FX29(in);
+                break;
+            case OP_FX33: op_FX33(in);
+                break;
+            case OP_FX55: op_FX55<Q>(in);
+                break;
+            case OP_FX65: op_FX65<Q>(in);
+                break;
+            case OP_00CN: op_00CN(in);
+                break;
+            case OP_00FB: op_00FB(in);
+                break;
+            case OP_00FC: op_00FC(in);
+                break;
+            case OP_00FD: pc = op_00FD(in, pc);
+                // parou de vez: devolve o resto do orcamento igual o FX0A
+                if constexpr (Debug) debugStep(*dbg, tracing, watching, here, opcode, before, i0);
+                PC = pc;
+                return c + 1;
+            case OP_00FE: op_00FE(in);
+                break;
+            case OP_00FF: op_00FF(in);
+                break;
+            case OP_DXY0: op_DXY0<Q>(in);
+                break;
+            case OP_FX30: op_FX30(in);
+                break;
+            case OP_FX75: op_FX75(in);
+                break;
+            case OP_FX85: op_FX85(in);
+                break;
+            default: pc = op_unknown(in, pc);
+        }
+        if constexpr (Debug) {
+            if (debugStep(*dbg, tracing, watching, here, opcode, before, i0)) {
+                PC = pc;
+                return c + 1;
+            }
+        }
+    }
+    PC = pc;
+    return cycles;
+}
+
+// o lockstep (lockstep.cpp) chama o interpretador direto pras instrucoes sem versao simd
+template int Chip8::runSwitch<QuirksModern, true>(int, const uint8_t *, Debugger *);
+template int Chip8::runSwitch<QuirksVIP, true>(int, const uint8_t *, Debugger *);
+template int Chip8::runSwitch<QuirksChip48, true>(int, const uint8_t *, Debugger *);
+template int Chip8::runSwitch<QuirksSChip, true>(int, const uint8_t *, Debugger *);
+
+// a espera do delay timer mais comum: "FX07; 3X00; 1NNN de volta pro FX07" (PONG, BRIX, TANK...)
+// vale tambem 3XNN/4XNN, e o 1NNN pode estar logo depois do skip ou uma instrucao depois
+// (quando o skip pula pra ele). os timers so descem entre um run e outro, entao dentro do run
+// toda volta faz a mesma coisa: se com o delay de agora a rom nao sai do laco, o resto do
+// orcamento inteiro vai nele. o pc, o vx e os contadores ficam iguais a rodar volta por volta
+int Chip8::idleLoop(uint16_t jump, uint16_t target, int left) {
+    if (!idle_skip) return -1;
+    const Instr &get = decoded[target];
+    uint16_t at = (target + 2) & 0x0FFF;
+    Instr &test = decoded[at];
+    if (test.op == OP_NONE) test = decode(fetch(at));
+    if ((test.op != OP_3XNN && test.op != OP_4XNN) || test.x != get.x) return -1;
+    bool skips = (test.op == OP_3XNN) == (delay_timer == test.nn);
+    if (((at + (skips ? 4 : 2)) & 0x0FFF) != jump) return -1;
+
+    // as left instrucoes sao FX07, skip, 1NNN, FX07, ...
+    if (left > 0) V[get.x] = delay_timer;
+    perf_counters.op(OP_FX07, (left + 2) / 3);
+    perf_counters.op(test.op, (left + 1) / 3);
+    perf_counters.op(OP_1NNN, left / 3);
+    switch (left % 3) {
+        case 0: return target;
+        case 1: return at;
+        default: return jump;
+    }
+}
+
+// ---- motor de blocos basicos ----
+
+// instrucoes que fecham um bloco: desvios (depois deles o pc nao eh mais sequencial),
+// escritas na memoria (podem mudar o proprio codigo, menos quando a analise provou que nao)
+// e o FX0A (para a vm)
+// os skips nao fecham: se o skip pular, o bloco sai pelo meio (saida lateral)
+static bool endsBlock(uint8_t op, bool readonly) {
+    switch (op) {
+        case OP_00EE: case OP_1NNN: case OP_2NNN: case OP_BNNN: case OP_FX0A: case OP_00FD:
+        case OP_UNKNOWN:
+            return true;
+        case OP_FX33: case OP_FX55:
+            return !readonly;
+        default:
+            return false;
+    }
+}
+
+void Chip8::flushBlocks() {
+    for (const Block &b : blocks) {
+        block_at[b.start] = nullptr;
+        for (int i = 0; i < b.len * 2; ++i) block_code[(b.start + i) & 0x0FFF] = 0;
     }
-}
\ No newline at end of file
+    blocks.clear();
+    blocks_dirty = false;
+}
+
+const Block &Chip8::buildBlock(uint16_t start) {
+    if (block_at.empty()) {
+        block_at.assign(4096, nullptr);
+        block_code.assign(4096, 0);
+    }
+
+    blocks.emplace_back();
+    Block &b = blocks.back();
+    b.start = start;
+    b.len = 0;
+
+    // vai decodificando ate achar o fim do bloco, sem passar do fim da memoria (a instrucao
+    // em 0xFFF pega o byte 0, igual o fetch, e fecha o bloco: o pc da volta no proximo)
+    uint16_t addr = start;
+    while (b.len < BLOCK_MAX_LEN && addr <= 0x0FFF) {
+        Instr &in = decoded[addr];
+        if (in.op == OP_NONE) in = decode(fetch(addr));
+        b.ops[b.len++] = in;
+        block_code[addr] = 1;
+        block_code[(addr + 1) & 0x0FFF] = 1;
+        addr += 2;
+        if (endsBlock(in.op, code_readonly)) break;
+    }
+    b.ops[b.len].op = OP_NONE; // sentinela: fim do bloco
+
+    // "1NNN" pulando pra ele mesmo: a rom parou ali de vez (fim de jogo, por exemplo)
+    b.self_loop = (b.len == 1 && b.ops[0].op == OP_1NNN && b.ops[0].nnn == start);
+
+    block_at[start] = &b;
+    return b;
+}
+
+// executa por blocos. no gcc/clang usa computed goto: cada handler pula direto pro
+// proximo (direct threading) e o fim de um bloco ja procura o seguinte, sem voltar
+// pra um loop central. nos outros compiladores vira um switch normal
+template <class Q> int Chip8::runBlocks(int cycles) {
+    // o interpretador pode ter escrito em cima de algum bloco na ultima chamada
+    if (blocks_dirty) flushBlocks();
+
+    int left = cycles;
+    uint16_t pc = PC;
+    const Instr *ip;
+    const Block *cur;
+
+#if defined(__GNUC__)
+    static void *const labels[OP_COUNT] = {
+        &&L_NONE,
+        &&L_00E0,
+        &&L_00EE,
+        &&L_1NNN,
+        &&L_2NNN,
+        &&L_3XNN,
+        &&L_4XNN,
+        &&L_5XY0,
+        &&L_6XNN,
+        &&L_7XNN,
+        &&L_8XY0,
+        &&L_8XY1,
+        &&L_8XY2,
+        &&L_8XY3,
+        &&L_8XY4,
+        &&L_8XY5,
+        &&L_8XY6,
+        &&L_8XY7,
+        &&L_8XYE,
+        &&L_9XY0,
+        &&L_ANNN,
+        &&L_BNNN,
+        &&L_CXNN,
+        &&L_DXYN,
+        &&L_EX9E,
+        &&L_EXA1,
+        &&L_FX07,
+        &&L_FX0A,
+        &&L_FX15,
+        &&L_FX18,
+        &&L_FX1E,
+        &&L_FX29,
+        &&L_FX33,
+        &&L_FX55,
+        &&L_FX65,
+        &&L_00CN,
+        &&L_00FB,
+        &&L_00FC,
+        &&L_00FD,
+        &&L_00FE,
+        &&L_00FF,
+        &&L_DXY0,
+        &&L_FX30,
+        &&L_FX75,
+        &&L_FX85,
+        &&L_UNKNOWN
+    };
+#define BLOCK_CASE(name) case OP_##name: L_##name
+#define BLOCK_NEXT() goto *labels[(++ip)->op]
+#else
+#define BLOCK_CASE(name) case OP_##name
+#define BLOCK_NEXT() ++ip; continue
+#endif
+
+next_block:
+    {
+        pc &= 0x0FFF;
+        // procura o bloco que comeca no pc, ou compila um novo
+        const Block *bp = block_at.empty() ? nullptr : block_at[pc];
+        const Block &b = bp ? *bp : buildBlock(pc);
+        cur = &b;
+
+        // o resto do orcamento nao cobre o bloco inteiro: termina no interpretador
+        // pra parar exatamente no mesmo ciclo
+        if (b.len > left) {
+            PC = pc;
+            return cycles - left + runSwitch<Q>(left);
+        }
+        // laco infinito de uma instrucao so: o estado nao muda mais, gasta o resto de uma vez
+        if (b.self_loop) {
+            perf_counters.op(OP_1NNN, left);
+            PC = pc;
+            return cycles;
+        }
+        left -= b.len;
+        ip = b.ops;
+        // conta o bloco inteiro na entrada, a saida lateral desconta o que nao rodou
+        if constexpr (PerfCounters::enabled) {
+            for (int i = 0; i < b.len; ++i) perf_counters.op(b.ops[i].op);
+        }
+    }
+
+#if defined(__GNUC__)
+    goto *labels[ip->op];
+#endif
+    for (;;) {
+        switch (ip->op) {
+            BLOCK_CASE(00E0): pc += 2; op_00E0(*ip); BLOCK_NEXT();
+            BLOCK_CASE(00EE): pc += 2; pc = op_00EE(*ip, pc); goto block_end;
+            BLOCK_CASE(1NNN): pc += 2; pc = op_1NNN(*ip, pc); if (decoded[pc].op == OP_FX07) goto block_idle; goto block_end;
+            BLOCK_CASE(2NNN): pc += 2; pc = op_2NNN(*ip, pc); goto block_end;
+            BLOCK_CASE(3XNN): pc += 2; if (op_3XNN(*ip, pc) != pc) goto block_skip; BLOCK_NEXT();
+            BLOCK_CASE(4XNN): pc += 2; if (op_4XNN(*ip, pc) != pc) goto block_skip; BLOCK_NEXT();
+            BLOCK_CASE(5XY0): pc += 2; if (op_5XY0(*ip, pc) != pc) goto block_skip; BLOCK_NEXT();
+            BLOCK_CASE(6XNN): pc += 2; op_6XNN(*ip); BLOCK_NEXT();
+            BLOCK_CASE(7XNN): pc += 2; op_7XNN(*ip); BLOCK_NEXT();
+            BLOCK_CASE(8XY0): pc += 2; op_8XY0(*ip); BLOCK_NEXT();
+            BLOCK_CASE(8XY1): pc += 2; op_8XY1<Q>(*ip); BLOCK_NEXT();
+            BLOCK_CASE(8XY2): pc += 2; op_8XY2<Q>(*ip); BLOCK_NEXT();
+            BLOCK_CASE(8XY3): pc += 2; op_8XY3<Q>(*ip); BLOCK_NEXT();
+            BLOCK_CASE(8XY4): pc += 2; op_8XY4(*ip); BLOCK_NEXT();
+            BLOCK_CASE(8XY5): pc += 2; op_8XY5(*ip); BLOCK_NEXT();
+            BLOCK_CASE(8XY6): pc += 2; op_8XY6<Q>(*ip); BLOCK_NEXT();
+            BLOCK_CASE(8XY7): pc += 2; op_8XY7(*ip); BLOCK_NEXT();
+            BLOCK_CASE(8XYE): pc += 2; op_8XYE<Q>(*ip); BLOCK_NEXT();
+            BLOCK_CASE(9XY0): pc += 2; if (op_9XY0(*ip, pc) != pc) goto block_skip; BLOCK_NEXT();
+            BLOCK_CASE(ANNN): pc += 2; op_ANNN(*ip); BLOCK_NEXT();
+            BLOCK_CASE(BNNN): pc += 2; pc = op_BNNN<Q>(*ip, pc); goto block_end;
+            BLOCK_CASE(CXNN): pc += 2; op_CXNN(*ip); BLOCK_NEXT();
+            BLOCK_CASE(DXYN): pc += 2; op_DXYN<Q>(*ip); BLOCK_NEXT();
+            BLOCK_CASE(EX9E): pc += 2; if (op_EX9E(*ip, pc) != pc) goto block_skip; BLOCK_NEXT();
+            BLOCK_CASE(EXA1): pc += 2; if (op_EXA1(*ip, pc) != pc) goto block_skip; BLOCK_NEXT();
+            BLOCK_CASE(FX07): pc += 2; op_FX07(*ip); BLOCK_NEXT();
+            BLOCK_CASE(FX0A): pc += 2; pc = op_FX0A(*ip, pc); PC = pc; return cycles - left;
+            BLOCK_CASE(FX15): pc += 2; op_FX15(*ip); BLOCK_NEXT();
+            BLOCK_CASE(FX18): pc += 2; op_FX18(*ip); BLOCK_NEXT();
+            BLOCK_CASE(FX1E): pc += 2; op_FX1E(*ip); BLOCK_NEXT();
+            BLOCK_CASE(FX29): pc += 2; op_FX29(*ip); BLOCK_NEXT();
+            // escrita na memoria: se escreveu em cima de codigo compilado corta o bloco ali e
+            // joga os blocos fora antes de procurar o proximo (com a rom provada so leitura o
+            // FX33/FX55 ficam no meio do bloco, o resto dele so roda se nao sujou nada)
+            BLOCK_CASE(FX33): pc += 2; op_FX33(*ip); if (blocks_dirty) goto block_cut; BLOCK_NEXT();
+            BLOCK_CASE(FX55): pc += 2; op_FX55<Q>(*ip); if (blocks_dirty) goto block_cut; BLOCK_NEXT();
+            BLOCK_CASE(FX65): pc += 2; op_FX65<Q>(*ip); BLOCK_NEXT();
+            BLOCK_CASE(00CN): pc += 2; op_00CN(*ip); BLOCK_NEXT();
+            BLOCK_CASE(00FB): pc += 2; op_00FB(*ip); BLOCK_NEXT();
+            BLOCK_CASE(00FC): pc += 2; op_00FC(*ip); BLOCK_NEXT();
+            BLOCK_CASE(00FD): pc += 2; pc = op_00FD(*ip, pc); PC = pc; return cycles - left;
+            BLOCK_CASE(00FE): pc += 2; op_00FE(*ip); BLOCK_NEXT();
+            BLOCK_CASE(00FF): pc += 2; op_00FF(*ip); BLOCK_NEXT();
+            BLOCK_CASE(DXY0): pc += 2; op_DXY0<Q>(*ip); BLOCK_NEXT();
+            BLOCK_CASE(FX30): pc += 2; op_FX30(*ip); BLOCK_NEXT();
+            BLOCK_CASE(FX75): pc += 2; op_FX75(*ip); BLOCK_NEXT();
+            BLOCK_CASE(FX85): pc += 2; op_FX85(*ip); BLOCK_NEXT();
+            BLOCK_CASE(UNKNOWN): pc += 2; pc = op_unknown(*ip, pc); goto block_end;
+            // sentinela, so chega aqui bloco que parou no tamanho maximo
+            BLOCK_CASE(NONE):
+            default:
+                goto block_end;
+        }
+    }
+
+// skip pulou (ou escrita sujou os blocos) no meio do bloco: devolve pro orcamento as
+// instrucoes que nao rodaram
+block_skip:
+    pc += 2;
+block_cut:
+    left += cur->len - static_cast<int>(ip - cur->ops) - 1;
+    if constexpr (PerfCounters::enabled) {
+        for (const Instr *p = ip + 1; p < cur->ops + cur->len; ++p) perf_counters.unop(p->op);
+    }
+    if (blocks_dirty) flushBlocks();
+    goto block_end;
+
+// 1NNN pra um FX07: se for pra tras e for a espera do delay timer, o resto do orcamento vai nela
+block_idle:
+    {
+        uint16_t at = (cur->start + 2 * static_cast<int>(ip - cur->ops)) & 0x0FFF;
+        int to = pc < at ? idleLoop(at, pc, left) : -1;
+        if (to >= 0) {
+            PC = to;
+            return cycles;
+        }
+    }
+block_end:
+    if (left == 0) {
+        PC = pc;
+        return cycles;
+    }
+    goto next_block;
+#undef BLOCK_CASE
+#undef BLOCK_NEXT
+}
+
+bool Chip8::sameState(const Chip8 &o, std::string *what) const {
+    const char *diff = nullptr;
+    if (std::memcmp(memory, o.memory, sizeof(memory)) != 0) diff = "memory";
+    else if (std::memcmp(V, o.V, sizeof(V)) != 0) diff = "V";
+    else if (I != o.I) diff = "I";
+    else if (PC != o.PC) diff = "PC";
+    else if (SP != o.SP) diff = "SP";
+    else if (std::memcmp(stack, o.stack, sizeof(stack)) != 0) diff = "stack";
+    else if (std::memcmp(DISPLAY, o.DISPLAY, sizeof(DISPLAY)) != 0) diff = "DISPLAY";
+    else if (hires != o.hires) diff = "hires";
+    else if (halted != o.halted) diff = "halted";
+    else if (std::memcmp(rpl, o.rpl, sizeof(rpl)) != 0) diff = "rpl";
+    else if (delay_timer != o.delay_timer) diff = "delay_timer";
+    else if (sound_timer != o.sound_timer) diff = "sound_timer";
+    else if (rng_state != o.rng_state) diff = "rng_state";
+    else if (wait_reg != o.wait_reg) diff = "wait_reg";
+
+    if (diff && what) *what = diff;
+    return diff == nullptr;
+}
@@ -0,0 +1,440 @@
+#include "../defs/debugger.h"
+#include "../defs/chip8.h"
+#include "../defs/analyzer.h"
+#include "../defs/state.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+Debugger::Debugger() {}
+
+Debugger::~Debugger() { stopTrace(); }
+
+void Debugger::watchRegister(int reg, bool on) {
+    if (reg < 0 || reg > DEBUG_REG_I) return;
+    if (on) watch_regs |= 1u << reg;
+    else watch_regs &= ~(1u << reg);
+}
+
+// ---- trace ----
+
+bool Debugger::startTrace(const Chip8 &vm, const std::string &path, size_t records) {
+    stopTrace();
+    size_t cap = 1024;
+    while (cap < records) cap <<= 1;
+    ring.assign(cap, TraceRecord());
+    mask = cap - 1;
+    next = ring.data();
+    ring_end = next + cap;
+    base = written = 0;
+    file_ok = true;
+    waiting_reg = vm.wait_reg;
+
+    if (!path.empty()) {
+        file = std::fopen(path.c_str(), "wb");
+        if (!file) return false;
+        std::vector<uint8_t> state;
+        vm.saveState(state);
+        uint8_t header[10];
+        std::memcpy(header, TRACE_MAGIC, 4);
+        header[4] = TRACE_VERSION;
+        header[5] = sizeof(TraceRecord);
+        for (int i = 0; i < 4; ++i) header[6 + i] = (state.size() >> (8 * i)) & 0xFF;
+        file_ok = std::fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+                  std::fwrite(state.data(), 1, state.size(), file) == state.size();
+    }
+    tracing = true;
+    return file_ok;
+}
+
+bool Debugger::stopTrace() {
+    if (!tracing) return true;
+    tracing = false;
+    if (file) {
+        writeTrace();
+        if (std::fclose(file) != 0) file_ok = false;
+        file = nullptr;
+    }
+    return file_ok;
+}
+
+void Debugger::writeTrace() {
+    size_t n = (next - ring.data()) - written;
+    if (n && std::fwrite(&ring[written], sizeof(TraceRecord), n, file) != n) file_ok = false;
+    written += n;
+}
+
+void Debugger::flushTrace() {
+    // sem arquivo o buffer so da a volta (fica com as ultimas instrucoes)
+    if (file) writeTrace();
+    base += ring.size();
+    next = ring.data();
+    written = 0;
+}
+
+// ---- execucao ----
+
+int Debugger::run(Chip8 &vm, int cycles) {
+    int executed = 0;
+    int left = cycles;
+    while (left > 0 && !quit) {
+        // a tecla do FX0A chegou entre um run e outro (setKey): vai pro trace como registro proprio
+        if (tracing && waiting_reg >= 0 && vm.wait_reg < 0) {
+            uint16_t at = (vm.PC - 2) & 0x0FFF;
+            record({at, vm.fetch(at), vm.I, vm.V[waiting_reg], vm.V[0xF], vm.SP, TRACE_KEY});
+        }
+        waiting_reg = vm.wait_reg;
+
+        // a primeira instrucao o interpretador nao confere: pausa pedida ou breakpoint bem
+        // no pc (menos o que acabou de parar nele, senao nunca sai do lugar)
+        bool running = !vm.isWaitingKey() && !vm.isHalted();
+        if (pause_req.exchange(false, std::memory_order_relaxed)) stop = DEBUG_PAUSE;
+        else if (running && !resume && breaks[vm.PC & 0x0FFF]) stop = DEBUG_BREAK;
+        if (stop != DEBUG_NONE) {
+            halt(vm);
+            continue;
+        }
+        resume = false;
+
+        int budget = steps > 0 && steps < left ? steps : left;
+        int n = vm.runDebug(budget, *this);
+        executed += n;
+        // parada no meio: so o que rodou saiu do orcamento
+        int used = stop == DEBUG_NONE ? budget : n;
+        left -= used;
+        if (steps > 0) {
+            steps -= used;
+            if (steps <= 0 && stop == DEBUG_NONE) stop = DEBUG_STEP;
+        }
+        waiting_reg = vm.wait_reg;
+        if (stop != DEBUG_NONE) halt(vm);
+    }
+    return executed;
+}
+
+void Debugger::halt(Chip8 &vm) {
+    last_stop = stop;
+    ++stop_count;
+    if (con_out) printStop(con_out, vm);
+    if (con_in) console(vm);
+    stop = DEBUG_NONE;
+    resume = true;
+}
+
+// ---- visoes ----
+
+// nome do registrador vigiado (0..15 = Vx, 16 = I)
+static const char *regName(int reg) {
+    static const char *const names[] = {"V0", "V1", "V2", "V3", "V4", "V5", "V6", "V7", "V8",
+                                        "V9", "VA", "VB", "VC", "VD", "VE", "VF", "I"};
+    return names[reg];
+}
+
+void Debugger::printStop(std::FILE *out, const Chip8 &vm) const {
+    switch (stop) {
+        case DEBUG_BREAK: std::fprintf(out, "breakpoint em 0x%03X\n", vm.PC & 0x0FFF); break;
+        case DEBUG_PAUSE: std::fprintf(out, "pausa em 0x%03X\n", vm.PC & 0x0FFF); break;
+        case DEBUG_STEP: break;
+        case DEBUG_WATCH:
+            if (watch_addr >= 0) {
+                std::fprintf(out, "watchpoint: escreveu em 0x%03X = %02X\n", watch_addr, vm.memory[watch_addr]);
+            } else {
+                std::fprintf(out, "watchpoint:");
+                for (int r = 0; r <= DEBUG_REG_I; ++r) {
+                    if (!(watch_hit & (1u << r))) continue;
+                    if (r == DEBUG_REG_I) std::fprintf(out, " I = %03X", vm.I);
+                    else std::fprintf(out, " %s = %02X", regName(r), vm.V[r]);
+                }
+                std::fprintf(out, "\n");
+            }
+            break;
+        default: break;
+    }
+    printCode(out, vm, vm.PC, 1);
+}
+
+void Debugger::printRegisters(std::FILE *out, const Chip8 &vm) {
+    for (int half = 0; half < 2; ++half) {
+        std::fprintf(out, "V%X-V%X:", half * 8, half * 8 + 7);
+        for (int i = 0; i < 8; ++i) std::fprintf(out, " %02X", vm.V[half * 8 + i]);
+        std::fprintf(out, "\n");
+    }
+    std::fprintf(out, "I=%03X PC=%03X SP=%d DT=%02X ST=%02X ciclo %llu", vm.I, vm.PC, vm.SP, vm.delay_timer,
+                 vm.sound_timer, (unsigned long long) vm.cycle_count);
+    if (vm.wait_reg >= 0) std::fprintf(out, " (esperando tecla em V%X)", vm.wait_reg);
+    if (vm.halted) std::fprintf(out, " (parada)");
+    std::fprintf(out, "\n");
+}
+
+void Debugger::printStack(std::FILE *out, const Chip8 &vm) {
+    // cada entrada eh o endereco de volta (o 2NNN ja somou 2), a mais recente primeiro
+    std::fprintf(out, "pilha:");
+    if (vm.SP == 0) std::fprintf(out, " vazia");
+    for (int i = vm.SP - 1; i >= 0; --i) std::fprintf(out, " %03X", vm.stack[i]);
+    std::fprintf(out, "\n");
+}
+
+void Debugger::printMemory(std::FILE *out, const Chip8 &vm, uint16_t addr, int len) {
+    for (int row = 0; row < len; row += 16) {
+        uint16_t at = (addr + row) & 0x0FFF;
+        std::fprintf(out, "%03X:", at);
+        for (int i = 0; i < 16 && row + i < len; ++i) std::fprintf(out, " %02X", vm.memory[(at + i) & 0x0FFF]);
+        std::fprintf(out, "\n");
+    }
+}
+
+void Debugger::printCode(std::FILE *out, const Chip8 &vm, uint16_t addr, int count) const {
+    for (int i = 0; i < count; ++i) {
+        uint16_t at = (addr + 2 * i) & 0x0FFF;
+        uint16_t op = vm.fetch(at);
+        std::fprintf(out, "%c%c %03X  %04X  %s\n", at == (vm.PC & 0x0FFF) ? '>' : ' ', breaks[at] ? '*' : ' ', at,
+                     op, disassemble(op).c_str());
+    }
+}
+
+// o que a instrucao mexe alem dos registradores, so pra mostrar
+static const char *traceMark(uint16_t opcode) {
+    if ((opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055) return " mem";
+    if ((opcode & 0xF000) == 0xD000 || opcode == 0x00E0 || (opcode & 0xFFF0) == 0x00C0 ||
+        (opcode >= 0x00FB && opcode <= 0x00FF && opcode != 0x00FD))
+        return " tela";
+    if ((opcode & 0xF0FF) == 0xF015 || (opcode & 0xF0FF) == 0xF018) return " timer";
+    if ((opcode & 0xF0FF) == 0xF00A || opcode == 0x00FD) return " parou";
+    return "";
+}
+
+// registradores refeitos pelo dumpTrace
+struct TraceRegs {
+    uint8_t V[16];
+    uint16_t I;
+    uint8_t sp;
+};
+
+// uma linha do trace: endereco, opcode, mnemonico e o que mudou. o que mudou so da pra saber
+// com o antes e o depois (before/after, o dumpTrace refaz), sem eles mostra o vx, o vf e o I
+static void printRecord(std::FILE *out, const TraceRecord &r, const TraceRegs *before, const TraceRegs *after) {
+    int x = (r.opcode >> 8) & 0xF;
+    if (r.kind == TRACE_KEY) {
+        std::fprintf(out, "%03X  ----  tecla                  V%X=%02X\n", r.pc, x, r.vx);
+        return;
+    }
+    std::fprintf(out, "%03X  %04X  %-22s", r.pc, r.opcode, disassemble(r.opcode).c_str());
+    if (after) {
+        for (int i = 0; i < 16; ++i) {
+            if (after->V[i] != before->V[i]) std::fprintf(out, " V%X=%02X", i, after->V[i]);
+        }
+        if (after->I != before->I) std::fprintf(out, " I=%03X", after->I);
+        if (after->sp != before->sp) std::fprintf(out, " SP=%d", after->sp);
+    } else {
+        std::fprintf(out, " V%X=%02X VF=%02X I=%03X SP=%d", x, r.vx, r.vf, r.I, r.sp);
+    }
+    std::fprintf(out, "%s\n", traceMark(r.opcode));
+}
+
+void Debugger::printTrace(std::FILE *out, size_t n) const {
+    if (ring.empty()) {
+        std::fprintf(out, "trace desligado\n");
+        return;
+    }
+    uint64_t pos = traced();
+    uint64_t have = std::min<uint64_t>(pos, ring.size());
+    if (n > have) n = have;
+    for (uint64_t i = pos - n; i < pos; ++i) printRecord(out, ring[i & mask], nullptr, nullptr);
+}
+
+bool Debugger::dumpTrace(const std::string &path, std::FILE *out, uint64_t limit) {
+    std::FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    uint8_t header[10];
+    bool ok = std::fread(header, 1, sizeof(header), f) == sizeof(header) &&
+              std::memcmp(header, TRACE_MAGIC, 4) == 0 && header[4] == TRACE_VERSION &&
+              header[5] == sizeof(TraceRecord);
+    uint32_t state_size = 0;
+    for (int i = 0; i < 4; ++i) state_size |= (uint32_t) header[6 + i] << (8 * i);
+    std::vector<uint8_t> state(ok && state_size <= STATE_MAX_SIZE ? state_size : 0);
+    Chip8 vm;
+    if (ok) ok = !state.empty() && std::fread(state.data(), 1, state.size(), f) == state.size() && vm.loadState(state);
+    if (!ok) {
+        std::fclose(f);
+        return false;
+    }
+
+    std::fprintf(out, "estado no comeco do trace:\n");
+    printRegisters(out, vm);
+    printStack(out, vm);
+
+    // refaz os registradores, o I, a memoria e as flags rpl instrucao por instrucao a partir do
+    // snapshot (so as escritas que a propria rom faz, que eh tudo o que muda dentro do run)
+    TraceRegs regs, prev;
+    uint8_t rpl[16], mem[4096];
+    uint8_t *V = regs.V;
+    std::memcpy(V, vm.V, 16);
+    std::memcpy(rpl, vm.rpl, 16);
+    std::memcpy(mem, vm.memory, 4096);
+    regs.I = vm.I;
+    regs.sp = vm.SP;
+
+    TraceRecord r;
+    uint64_t n = 0;
+    while ((limit == 0 || n < limit) && std::fread(&r, sizeof(r), 1, f) == 1) {
+        int x = (r.opcode >> 8) & 0xF;
+        uint16_t I = regs.I;
+        prev = regs;
+        if (r.kind != TRACE_KEY) {
+            switch (r.opcode & 0xF0FF) {
+                case 0xF033:
+                    mem[I & 0x0FFF] = V[x] / 100;
+                    mem[(I + 1) & 0x0FFF] = V[x] / 10 % 10;
+                    mem[(I + 2) & 0x0FFF] = V[x] % 10;
+                    break;
+                case 0xF055: for (int k = 0; k <= x; ++k) mem[(I + k) & 0x0FFF] = V[k]; break;
+                case 0xF065: for (int k = 0; k <= x; ++k) V[k] = mem[(I + k) & 0x0FFF]; break;
+                case 0xF075: std::memcpy(rpl, V, x + 1); break;
+                case 0xF085: std::memcpy(V, rpl, x + 1); break;
+                default: break;
+            }
+        }
+        // vx, vf, I e SP vem do registro (CXNN, tecla, flags...), valem mais que o que foi refeito
+        V[x] = r.vx;
+        V[0xF] = r.vf;
+        regs.I = r.I;
+        regs.sp = r.sp;
+        std::fprintf(out, "%10llu  ", (unsigned long long) n);
+        printRecord(out, r, &prev, &regs);
+        ++n;
+    }
+    std::fclose(f);
+    std::fprintf(out, "%llu instrucoes, registradores no fim:\n", (unsigned long long) n);
+    for (int half = 0; half < 2; ++half) {
+        std::fprintf(out, "V%X-V%X:", half * 8, half * 8 + 7);
+        for (int i = 0; i < 8; ++i) std::fprintf(out, " %02X", V[half * 8 + i]);
+        std::fprintf(out, "\n");
+    }
+    std::fprintf(out, "I=%03X\n", regs.I);
+    return true;
+}
+
+// ---- console ----
+
+// registrador no formato do console: v0..vf ou i (-1 se nao for)
+static int parseRegister(const char *s) {
+    if ((s[0] == 'i' || s[0] == 'I') && s[1] == 0) return DEBUG_REG_I;
+    if ((s[0] == 'v' || s[0] == 'V') && std::isxdigit((unsigned char) s[1]) && s[2] == 0) {
+        return (int) std::strtol(s + 1, nullptr, 16);
+    }
+    return -1;
+}
+
+// endereco em hex, com ou sem 0x
+static bool parseAddress(const char *s, uint16_t &addr) {
+    char *end;
+    unsigned long v = std::strtoul(s, &end, 16);
+    if (end == s || *end || v > 0x0FFF) return false;
+    addr = (uint16_t) v;
+    return true;
+}
+
+bool parseDebugTarget(const char *s, int &reg, uint16_t &addr) {
+    reg = parseRegister(s);
+    return reg >= 0 || parseAddress(s, addr);
+}
+
+static void printHelp(std::FILE *out) {
+    std::fprintf(out,
+                 "  c              continua\n"
+                 "  s [n]          roda n instrucoes (padrao 1)\n"
+                 "  b [end]        breakpoint em end (sem endereco lista)\n"
+                 "  w <end|vX|i>   watchpoint de memoria ou registrador (sem argumento lista)\n"
+                 "  d <end|vX|i>   tira o breakpoint/watchpoint\n"
+                 "  r              registradores e pilha\n"
+                 "  m <end> [n]    n bytes da memoria (padrao 64)\n"
+                 "  l [end] [n]    n instrucoes desmontadas (padrao: a partir do pc, 8)\n"
+                 "  t [n]          ultimas n instrucoes do trace (padrao 16)\n"
+                 "  q              sai\n"
+                 "linha vazia repete o ultimo comando\n");
+}
+
+void Debugger::console(Chip8 &vm) {
+    // o trace do console: se ninguem ligou, guarda as ultimas instrucoes na memoria
+    if (!tracing) startTrace(vm, "", 1 << 16);
+
+    char line[256];
+    while (true) {
+        std::fprintf(con_out, "(chip8) ");
+        std::fflush(con_out);
+        if (!std::fgets(line, sizeof(line), con_in)) {
+            // fim da entrada: deixa a rom seguir sem parar mais
+            con_in = nullptr;
+            return;
+        }
+        line[std::strcspn(line, "\r\n")] = 0;
+        if (line[0] == 0) std::snprintf(line, sizeof(line), "%s", last_cmd.c_str());
+        else last_cmd = line;
+
+        char cmd[16] = "", a1[64] = "", a2[64] = "";
+        if (std::sscanf(line, "%15s %63s %63s", cmd, a1, a2) < 1) continue;
+        uint16_t addr;
+        int reg;
+
+        if (!std::strcmp(cmd, "c")) {
+            steps = 0;
+            return;
+        } else if (!std::strcmp(cmd, "s")) {
+            steps = a1[0] ? std::atoi(a1) : 1;
+            if (steps <= 0) steps = 1;
+            return;
+        } else if (!std::strcmp(cmd, "q")) {
+            quit = true;
+            return;
+        } else if (!std::strcmp(cmd, "b")) {
+            if (!a1[0]) {
+                for (int at = 0; at < 4096; ++at) {
+                    if (breaks[at]) std::fprintf(con_out, "breakpoint %03X\n", at);
+                }
+            } else if (parseAddress(a1, addr)) {
+                setBreak(addr);
+            } else {
+                std::fprintf(con_out, "endereco invalido: %s\n", a1);
+            }
+        } else if (!std::strcmp(cmd, "w")) {
+            if (!a1[0]) {
+                for (int r = 0; r <= DEBUG_REG_I; ++r) {
+                    if (watch_regs & (1u << r)) std::fprintf(con_out, "watchpoint %s\n", regName(r));
+                }
+                for (int at = 0; at < 4096; ++at) {
+                    if (watch_mem[at]) std::fprintf(con_out, "watchpoint %03X\n", at);
+                }
+            } else if ((reg = parseRegister(a1)) >= 0) {
+                watchRegister(reg);
+            } else if (parseAddress(a1, addr)) {
+                watchMemory(addr);
+            } else {
+                std::fprintf(con_out, "endereco ou registrador invalido: %s\n", a1);
+            }
+        } else if (!std::strcmp(cmd, "d")) {
+            if ((reg = parseRegister(a1)) >= 0) {
+                watchRegister(reg, false);
+            } else if (parseAddress(a1, addr)) {
+                setBreak(addr, false);
+                watchMemory(addr, false);
+            } else {
+                std::fprintf(con_out, "endereco ou registrador invalido: %s\n", a1);
+            }
+        } else if (!std::strcmp(cmd, "r")) {
+            printRegisters(con_out, vm);
+            printStack(con_out, vm);
+        } else if (!std::strcmp(cmd, "m")) {
+            if (parseAddress(a1, addr)) printMemory(con_out, vm, addr, a2[0] ? std::atoi(a2) : 64);
+            else std::fprintf(con_out, "endereco invalido: %s\n", a1);
+        } else if (!std::strcmp(cmd, "l")) {
+            addr = vm.PC & 0x0FFF;
+            if (a1[0] && !parseAddress(a1, addr)) std::fprintf(con_out, "endereco invalido: %s\n", a1);
+            else printCode(con_out, vm, addr, a2[0] ? std::atoi(a2) : 8);
+        } else if (!std::strcmp(cmd, "t")) {
+            printTrace(con_out, a1[0] ? (size_t) std::atoi(a1) : 16);
+        } else {
+            printHelp(con_out);
+        }
+    }
+}
@@ -2,7 +2,7 @@
 #include <cstdio>
 
 // construtor, ja deixa os ponteiros nulos e a escala padrao
-Display::Display() : window(nullptr), renderer(nullptr), scale(10) {
+Display::Display() : window(nullptr), renderer(nullptr), texture(nullptr), scale(10) {
 }
 
 // destrutor, chama shutdown pra fechar corretamente
@@ -39,6 +39,16 @@ bool Display::init(int scl) {
     // define o modo de mistura
     SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
 
+    // textura com 1 texel por pixel do chip8, atualizada pela cpu a cada frame
+    // o escalonamento (nearest) fica por conta do renderer
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                SCHIP_WIDTH, SCHIP_HEIGHT);
+    if (!texture) {
+        std::fprintf(stderr, "SDL_CreateTexture error: %s\n", SDL_GetError());
+        return false;
+    }
+
     // limpa a tela no inicio
     clear();
     return true;
@@ -53,37 +63,42 @@ void Display::clear() {
 }
 
 // desenha o framebuffer (o que vem da vm chip8)
-void Display::draw(const uint8_t *framebuffer, int r_color, int g_color, int b_color) {
-    if (!renderer) return;
+void Display::draw(const uint8_t *framebuffer, int width, int height, int r_color, int g_color, int b_color) {
+    if (!renderer || !texture) return;
 
-    // primeiro limpa a tela toda (preto)
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
+    // cor dos pixels acesos e apagados no formato da textura
+    const uint32_t on = 0xFF000000u | (r_color << 16) | (g_color << 8) | b_color;
+    const uint32_t off = 0xFF000000u;
 
-    // define a cor passada pelo usuario pra desenhar os pixels
-    SDL_Rect r;
-    r.w = scale;
-    r.h = scale;
-    SDL_SetRenderDrawColor(renderer, r_color, g_color, b_color, 255);
-
-    // percorre a tela do chip8 (64x32)
-    for (int y = 0; y < CHIP8_HEIGHT; ++y) {
-        for (int x = 0; x < CHIP8_WIDTH; ++x) {
-            // se o pixel tiver 1, desenha um quadradinho
-            if (framebuffer[y * CHIP8_WIDTH + x]) {
-                r.x = x * scale;
-                r.y = y * scale;
-                SDL_RenderFillRect(renderer, &r);
-            }
+    // escreve os pixels direto na memoria da textura, so no canto usado pela resolucao atual
+    // (a textura tem o tamanho do hires, trocar de modo nao recria nada)
+    SDL_Rect area = {0, 0, width, height};
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, &area, &pixels, &pitch) != 0) return;
+    for (int y = 0; y < height; ++y) {
+        uint32_t *row = reinterpret_cast<uint32_t *>(static_cast<uint8_t *>(pixels) + y * pitch);
+        for (int x = 0; x < width; ++x) {
+            row[x] = framebuffer[y * width + x] ? on : off;
         }
     }
+    SDL_UnlockTexture(texture);
 
-    // mostra o que foi desenhado na janela
+    // uma copia so do canto usado, esticada pra janela toda, e mostra
+    SDL_RenderCopy(renderer, texture, &area, nullptr);
     SDL_RenderPresent(renderer);
 }
 
+void Display::setTitle(const char *title) {
+    if (window) SDL_SetWindowTitle(window, title);
+}
+
 // fecha a janela e libera memoria
 void Display::shutdown() {
+    if (texture) {
+        SDL_DestroyTexture(texture);
+        texture = nullptr;
+    }
     if (renderer) {
         SDL_DestroyRenderer(renderer);
         renderer = nullptr;
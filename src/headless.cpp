@@ -0,0 +1,595 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <random>
+
+#include "../defs/chip8.h"
+#include "../defs/scheduler.h"
+#include "../defs/pool.h"
+#include "../defs/lockstep.h"
+#include "../defs/movie.h"
+#include "../defs/romlib.h"
+#include "../defs/analyzer.h"
+#include "../defs/debugger.h"
+#include "../defs/capture.h"
+#include "../defs/perf.h"
+#include "../defs/defs.h"
+
+// runner sem sdl: roda a vm o mais rapido possivel, sem janela e sem sleep
+// serve pra testes de regressao e medir throughput nos servidores de build
+
+// evento de teclado lido do arquivo de input
+struct InputEvent {
+    uint64_t frame; // frame em que o evento acontece
+    uint8_t key;    // tecla do chip8 (0x0 a 0xF)
+    bool pressed;   // true = apertou, false = soltou
+};
+
+// configs da linha de comando do modo headless
+struct HeadlessConfig {
+    std::string rom;                 // caminho da rom
+    std::string input;               // arquivo de input (opcional)
+    int clock_hz = DEFAULT_CLOCK_HZ; // usado so pra saber quantos ciclos cabem num frame (timers)
+    uint64_t cycles = 0;             // limite de instrucoes (0 = sem limite)
+    uint64_t frames = 0;             // limite de frames (0 = sem limite)
+    Engine engine = ENGINE_SWITCH;   // motor de execucao
+    QuirkProfile quirks = QUIRKS_MODERN; // perfil de compatibilidade
+    bool diff = false;               // roda switch e blocos lado a lado comparando o estado
+    size_t instances = 1;            // quantas vms rodar juntas (pool)
+    int threads = 0;                 // threads do pool (0 = todos os nucleos)
+    int slice = 8;                   // frames que uma vm do pool roda antes de trocar
+    bool lockstep = false;           // instancias em grupos simd (lockstep.h)
+    bool has_seed = false;           // semente do aleatorio fixada na linha de comando
+    uint32_t seed = 0;
+    std::string record;              // grava o input aplicado num filme
+    std::string replay;              // toca um filme (semente e clock vem dele)
+    std::string library;             // pasta ou zip de roms: lista, ou acha a rom pelo nome
+    bool rescan = false;             // refaz o indice da biblioteca mesmo se ele estiver valendo
+    bool has_quirks = false;         // --quirks passado (senao usa o que a biblioteca detectou)
+    bool analyze = false;            // so mostra a analise estatica da rom e sai
+    bool disasm = false;             // analise com o codigo desmontado
+    bool debug = false;              // console do depurador, comeca parado
+    std::vector<std::string> breaks; // breakpoints (enderecos)
+    std::vector<std::string> watches; // watchpoints (enderecos ou registradores)
+    std::string trace;               // grava o trace da execucao nesse arquivo
+    std::string trace_dump;          // so mostra um trace gravado e sai
+    std::string capture;             // grava a tela (gif, apng ou cru, "-" = stdout)
+    int capture_scale = CAPTURE_DEFAULT_SCALE;
+};
+
+static void print_help(const char *prog) {
+    std::printf(
+        "Uso: %s [opcoes] <rom.ch8 | jogos.zip:ROM>\n"
+        "     %s --library <pasta|zip> [rom]\n"
+        "Opcoes:\n"
+        "  --cycles <n>       numero de ciclos a executar (ciclos esperando tecla contam)\n"
+        "  --frames <n>       numero de frames (1/60s virtual) a executar\n"
+        "  --clock <hz>       instrucoes por segundo virtual, define os ciclos por frame (padrao %d)\n"
+        "  --input <arquivo>  script de teclado, linhas \"<frame> <tecla hex> <down|up>\"\n"
+        "  --engine <nome>    motor de execucao: switch ou block (padrao switch)\n"
+        "  --quirks <perfil>  compatibilidade: modern, vip, chip48 ou schip (padrao modern)\n"
+        "  --diff             roda os dois motores juntos e compara o estado a cada frame\n"
+        "  --instances <n>    roda n vms da mesma rom em paralelo, cada uma com outra semente\n"
+        "  --threads <n>      threads usadas pelas instancias (padrao: todos os nucleos)\n"
+        "  --slice <n>        frames que cada instancia roda antes de trocar (padrao 8)\n"
+        "  --lockstep         instancias andam juntas em grupos de %d, em simd quando compensa\n"
+        "  --seed <n>         semente do aleatorio (CXNN), deixa a execucao reproduzivel\n"
+        "                     (com --instances eh a base: a vm i usa n + i)\n"
+        "  --record <arquivo> grava o input aplicado num filme pra replay\n"
+        "  --replay <arquivo> toca um filme e confere o estado final (usa a semente e o clock dele)\n"
+        "  --library <fonte>  biblioteca de roms (pasta ou zip): sem rom lista o indice, com rom\n"
+        "                     acha ela pelo nome, titulo ou hash e usa o perfil de quirks detectado\n"
+        "  --rescan           refaz o indice da biblioteca\n"
+        "  --analyze          nao roda: mostra a analise da rom (blocos, escritas, lacos, quirks)\n"
+        "  --disasm           igual o --analyze, com o codigo desmontado bloco por bloco\n"
+        "  --debug            abre o console do depurador antes da primeira instrucao\n"
+        "  --break <end>      breakpoint no endereco (hex), pode repetir\n"
+        "  --watch <end|vX|i> watchpoint de memoria ou registrador, pode repetir\n"
+        "  --trace <arquivo>  grava o trace da execucao (pc, opcode e o que mudou)\n"
+        "  --trace-dump <arquivo> mostra um trace gravado em texto e sai\n"
+        "  --capture <arquivo> grava a tela: .gif, .png (apng) ou frames rgb24 crus (- = stdout,\n"
+        "                     o relatorio vai pro stderr)\n"
+        "  --capture-scale <n> escala da gravacao, tela de 128x64 (padrao %d)\n"
+        "  --help             mostra essa mensagem\n"
+        "Sem --cycles e sem --frames roda %d frames.\n",
+        prog, prog, DEFAULT_CLOCK_HZ, LOCKSTEP_LANES, CAPTURE_DEFAULT_SCALE, HEADLESS_DEFAULT_FRAMES);
+}
+
+static bool parse_engine(const char *name, Engine &engine) {
+    if (std::strcmp(name, "switch") == 0) engine = ENGINE_SWITCH;
+    else if (std::strcmp(name, "block") == 0) engine = ENGINE_BLOCK;
+    else return false;
+    return true;
+}
+
+static bool parse_args(int argc, char **argv, HeadlessConfig &cfg) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--help") == 0) {
+            print_help(argv[0]);
+            return false;
+
+        } else if (std::strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            cfg.cycles = std::strtoull(argv[++i], nullptr, 10);
+
+        } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            cfg.frames = std::strtoull(argv[++i], nullptr, 10);
+
+        } else if (std::strcmp(argv[i], "--clock") == 0 && i + 1 < argc) {
+            cfg.clock_hz = std::atoi(argv[++i]);
+
+        } else if (std::strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            cfg.input = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            if (!parse_engine(argv[++i], cfg.engine)) {
+                std::fprintf(stderr, "Motor desconhecido: %s\n", argv[i]);
+                return false;
+            }
+
+        } else if (std::strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            if (!parseQuirkProfile(argv[++i], cfg.quirks)) {
+                std::fprintf(stderr, "Perfil de quirks desconhecido: %s\n", argv[i]);
+                return false;
+            }
+            cfg.has_quirks = true;
+
+        } else if (std::strcmp(argv[i], "--diff") == 0) {
+            cfg.diff = true;
+
+        } else if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            cfg.instances = std::strtoull(argv[++i], nullptr, 10);
+
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            cfg.threads = std::atoi(argv[++i]);
+
+        } else if (std::strcmp(argv[i], "--slice") == 0 && i + 1 < argc) {
+            cfg.slice = std::atoi(argv[++i]);
+
+        } else if (std::strcmp(argv[i], "--lockstep") == 0) {
+            cfg.lockstep = true;
+
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            cfg.seed = (uint32_t) std::strtoul(argv[++i], nullptr, 10);
+            cfg.has_seed = true;
+
+        } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            cfg.record = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            cfg.replay = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--library") == 0 && i + 1 < argc) {
+            cfg.library = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--rescan") == 0) {
+            cfg.rescan = true;
+
+        } else if (std::strcmp(argv[i], "--analyze") == 0) {
+            cfg.analyze = true;
+
+        } else if (std::strcmp(argv[i], "--disasm") == 0) {
+            cfg.analyze = true;
+            cfg.disasm = true;
+
+        } else if (std::strcmp(argv[i], "--debug") == 0) {
+            cfg.debug = true;
+
+        } else if (std::strcmp(argv[i], "--break") == 0 && i + 1 < argc) {
+            cfg.breaks.push_back(argv[++i]);
+
+        } else if (std::strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            cfg.watches.push_back(argv[++i]);
+
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            cfg.trace = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--trace-dump") == 0 && i + 1 < argc) {
+            cfg.trace_dump = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            cfg.capture = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--capture-scale") == 0 && i + 1 < argc) {
+            cfg.capture_scale = std::atoi(argv[++i]);
+
+        } else if (argv[i][0] == '-') {
+            std::fprintf(stderr, "Opcao desconhecida: %s\n", argv[i]);
+            return false;
+
+        } else {
+            cfg.rom = argv[i];
+        }
+    }
+
+    if (!cfg.trace_dump.empty()) return true;
+    if (cfg.rom.empty() && cfg.library.empty()) {
+        print_help(argv[0]);
+        return false;
+    }
+    if (cfg.clock_hz <= 0) {
+        std::fprintf(stderr, "Clock invalido: %d\n", cfg.clock_hz);
+        return false;
+    }
+    if (cfg.instances == 0) {
+        std::fprintf(stderr, "Numero de instancias invalido\n");
+        return false;
+    }
+    bool debugging = cfg.debug || !cfg.breaks.empty() || !cfg.watches.empty() || !cfg.trace.empty();
+    if (cfg.instances > 1 && (!cfg.input.empty() || cfg.diff || cfg.cycles != 0 ||
+                              !cfg.record.empty() || !cfg.replay.empty() || debugging || !cfg.capture.empty())) {
+        std::fprintf(stderr, "--instances nao combina com --input, --diff, --cycles, --record, --replay, --capture ou o depurador\n");
+        return false;
+    }
+    if (!cfg.replay.empty() && (!cfg.input.empty() || !cfg.record.empty())) {
+        std::fprintf(stderr, "--replay nao combina com --input ou --record\n");
+        return false;
+    }
+    // no replay o fim vem do filme
+    if (cfg.cycles == 0 && cfg.frames == 0 && cfg.replay.empty()) cfg.frames = HEADLESS_DEFAULT_FRAMES;
+    return true;
+}
+
+// biblioteca: sem rom lista o indice e sai (0), com rom troca o nome pelo caminho e segue (-1)
+static int open_library(HeadlessConfig &cfg) {
+    RomLibrary lib;
+    auto start = std::chrono::steady_clock::now();
+    if (!lib.open(cfg.library, cfg.rescan)) {
+        std::fprintf(stderr, "Falha ao abrir biblioteca: %s\n", cfg.library.c_str());
+        return 1;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (cfg.rom.empty()) {
+        for (const RomInfo &r : lib.roms()) {
+            std::printf("%016llx %6u %-7s %s\n", (unsigned long long) r.hash, r.size,
+                        quirkProfileName(r.quirks), r.name.c_str());
+        }
+        std::printf("%zu roms, indice %s em %.3f ms\n", lib.roms().size(), lib.fromCache() ? "do cache" : "refeito", ms);
+        return 0;
+    }
+    const RomInfo *rom = lib.find(cfg.rom);
+    if (!rom) {
+        std::fprintf(stderr, "Rom nao encontrada na biblioteca: %s\n", cfg.rom.c_str());
+        return 1;
+    }
+    cfg.rom = lib.path(*rom);
+    if (!cfg.has_quirks) cfg.quirks = rom->quirks;
+    return -1;
+}
+
+// analise estatica: carrega a rom numa vm (fontes no lugar) e mostra o relatorio
+static int run_analysis(const HeadlessConfig &cfg) {
+    Chip8 vm;
+    vm.initialize();
+    if (!vm.loadROM(cfg.rom)) {
+        std::fprintf(stderr, "Falha ao carregar ROM: %s\n", cfg.rom.c_str());
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    RomAnalysis a = analyzeRom(vm.memoryData(), DEFAULT_PC_START);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("rom: %s (analise em %.3f ms)\n", cfg.rom.c_str(), ms);
+    printAnalysis(stdout, a, vm.memoryData(), cfg.disasm);
+    return 0;
+}
+
+// modo com varias instancias: todas rodam os mesmos frames, sem input
+static int run_pool(const HeadlessConfig &cfg) {
+    VMPool pool(cfg.instances);
+    if (!pool.loadROM(cfg.rom)) {
+        std::fprintf(stderr, "Falha ao carregar ROM: %s\n", cfg.rom.c_str());
+        return 1;
+    }
+    // vm i usa a semente base + i: com --seed o run se repete, sem ela cada run sorteia a base
+    uint32_t seed = cfg.has_seed ? cfg.seed : std::random_device{}();
+    pool.seed(seed);
+    pool.setEngine(cfg.engine);
+    pool.setQuirks(cfg.quirks);
+    pool.setLockstep(cfg.lockstep);
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run(cfg.frames, cfg.clock_hz, cfg.threads, cfg.slice);
+    auto end = std::chrono::steady_clock::now();
+
+    uint64_t executed = pool.executed();
+    double secs = std::chrono::duration<double>(end - start).count();
+    double ips = secs > 0.0 ? (double) executed / secs : 0.0;
+
+    // hash combinado de todas as telas e quantas telas diferentes sairam
+    std::vector<uint64_t> hashes;
+    uint64_t combined = 0;
+    for (size_t i = 0; i < pool.size(); ++i) {
+        uint64_t h = pool.vm(i).videoHash();
+        combined = (combined ^ h) * 1099511628211ull;
+        hashes.push_back(h);
+    }
+    std::sort(hashes.begin(), hashes.end());
+    size_t distinct = std::unique(hashes.begin(), hashes.end()) - hashes.begin();
+
+    std::printf("instancias: %zu\n", pool.size());
+    std::printf("semente: %u (base, vm i usa base + i)\n", seed);
+    std::printf("instrucoes: %llu\n", (unsigned long long) executed);
+    std::printf("frames: %llu (por instancia)\n", (unsigned long long) cfg.frames);
+    std::printf("tempo: %.6f s\n", secs);
+    std::printf("ips: %.0f total, %.0f por instancia\n", ips, ips / pool.size());
+    std::printf("hash: %016llx (%zu telas diferentes)\n", (unsigned long long) combined, distinct);
+    if (cfg.lockstep) {
+        double share = executed ? 100.0 * (double) pool.vectorExecuted() / (double) executed : 0.0;
+        uint64_t runs = pool.simdRuns() + pool.soloRuns();
+        double simd = runs ? 100.0 * (double) pool.simdRuns() / (double) runs : 0.0;
+        std::printf("lockstep: %s, %.1f%% das instrucoes em simd, %.1f%% dos runs em simd\n", LockstepBatch::isa(),
+                    share, simd);
+    }
+    return 0;
+}
+
+// le o script de input, ignora linhas vazias e comentarios com '#'
+static bool load_input(const std::string &path, std::vector<InputEvent> &events) {
+    std::ifstream f(path);
+    if (!f.is_open()) return false;
+
+    std::string line;
+    int lineno = 0;
+    while (std::getline(f, line)) {
+        ++lineno;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+
+        std::istringstream ss(line);
+        uint64_t frame;
+        std::string key, action;
+        if (!(ss >> frame)) continue; // linha vazia
+        if (!(ss >> key >> action)) {
+            std::fprintf(stderr, "%s:%d: linha invalida\n", path.c_str(), lineno);
+            return false;
+        }
+
+        unsigned long k = std::strtoul(key.c_str(), nullptr, 16);
+        if (k > 0xF || (action != "down" && action != "up")) {
+            std::fprintf(stderr, "%s:%d: tecla ou acao invalida\n", path.c_str(), lineno);
+            return false;
+        }
+        events.push_back({frame, static_cast<uint8_t>(k), action == "down"});
+    }
+
+    // garante a ordem por frame (mantendo a ordem do arquivo dentro do mesmo frame)
+    std::stable_sort(events.begin(), events.end(),
+                     [](const InputEvent &a, const InputEvent &b) { return a.frame < b.frame; });
+    return true;
+}
+
+int main(int argc, char **argv) {
+    HeadlessConfig cfg;
+    if (!parse_args(argc, argv, cfg)) return 1;
+    if (!cfg.trace_dump.empty()) {
+        if (Debugger::dumpTrace(cfg.trace_dump, stdout)) return 0;
+        std::fprintf(stderr, "Falha ao ler trace: %s\n", cfg.trace_dump.c_str());
+        return 1;
+    }
+    if (!cfg.library.empty()) {
+        int r = open_library(cfg);
+        if (r >= 0) return r;
+    }
+    if (cfg.analyze) return run_analysis(cfg);
+    if (cfg.instances > 1) return run_pool(cfg);
+
+    uint64_t rom_hash = 0;
+    if (!fileHash(cfg.rom, rom_hash)) {
+        std::fprintf(stderr, "Falha ao carregar ROM: %s\n", cfg.rom.c_str());
+        return 1;
+    }
+
+    // replay: semente, clock e teclas vem do filme, ele roda ate o ciclo onde a gravacao parou
+    Movie movie;
+    if (!cfg.replay.empty()) {
+        if (!loadMovie(cfg.replay, movie)) {
+            std::fprintf(stderr, "Falha ao ler filme: %s\n", cfg.replay.c_str());
+            return 1;
+        }
+        if (movie.rom_hash != rom_hash) {
+            std::fprintf(stderr, "O filme foi gravado com outra rom\n");
+            return 1;
+        }
+        cfg.seed = movie.seed;
+        cfg.has_seed = true;
+        cfg.clock_hz = movie.clock_hz;
+        cfg.quirks = movie.quirks;
+        if (cfg.cycles == 0 && cfg.frames == 0) {
+            if (movie.finished) cfg.cycles = movie.end_cycle;
+            else if (!movie.events.empty()) cfg.cycles = movie.events.back().cycle + 1;
+            else cfg.frames = HEADLESS_DEFAULT_FRAMES;
+        }
+    }
+    // gravando sem semente: sorteia uma aqui pra ela ir pro filme
+    if (!cfg.record.empty() && !cfg.has_seed) {
+        cfg.seed = std::random_device{}();
+        cfg.has_seed = true;
+    }
+
+    std::vector<InputEvent> events;
+    if (!cfg.input.empty() && !load_input(cfg.input, events)) {
+        std::fprintf(stderr, "Falha ao ler input: %s\n", cfg.input.c_str());
+        return 1;
+    }
+
+    Chip8 vm;
+    vm.initialize();
+    if (!vm.loadROM(cfg.rom)) {
+        std::fprintf(stderr, "Falha ao carregar ROM: %s\n", cfg.rom.c_str());
+        return 1;
+    }
+    if (cfg.has_seed) vm.seed(cfg.seed);
+    vm.setQuirks(cfg.quirks);
+    vm.useAnalysis(analyzeRom(vm.memoryData(), DEFAULT_PC_START));
+
+    // depurador: so a vm principal passa por ele (no --diff a de blocos roda normal)
+    Debugger dbg;
+    bool debugging = cfg.debug || !cfg.breaks.empty() || !cfg.watches.empty() || !cfg.trace.empty();
+    for (const std::string &b : cfg.breaks) {
+        int reg;
+        uint16_t addr;
+        if (!parseDebugTarget(b.c_str(), reg, addr) || reg >= 0) {
+            std::fprintf(stderr, "Breakpoint invalido: %s\n", b.c_str());
+            return 1;
+        }
+        dbg.setBreak(addr);
+    }
+    for (const std::string &w : cfg.watches) {
+        int reg;
+        uint16_t addr;
+        if (!parseDebugTarget(w.c_str(), reg, addr)) {
+            std::fprintf(stderr, "Watchpoint invalido: %s\n", w.c_str());
+            return 1;
+        }
+        if (reg >= 0) dbg.watchRegister(reg);
+        else dbg.watchMemory(addr);
+    }
+    // gravando os frames no stdout o texto (relatorio e paradas do depurador) vai pro stderr
+    std::FILE *report = cfg.capture == "-" ? stderr : stdout;
+
+    // com console as paradas abrem o prompt, sem ele so aparecem na saida
+    dbg.setConsole(cfg.debug ? stdin : nullptr, report);
+    if (cfg.debug) dbg.pause();
+    if (!cfg.trace.empty() && !dbg.startTrace(vm, cfg.trace)) {
+        std::fprintf(stderr, "Falha ao criar trace: %s\n", cfg.trace.c_str());
+        return 1;
+    }
+
+    MovieWriter recorder;
+    if (!cfg.record.empty() && !recorder.open(cfg.record, cfg.seed, cfg.clock_hz, rom_hash, cfg.quirks)) {
+        std::fprintf(stderr, "Falha ao criar filme: %s\n", cfg.record.c_str());
+        return 1;
+    }
+
+    Capture capture;
+    if (!cfg.capture.empty() && !capture.open(cfg.capture, cfg.capture_scale)) {
+        std::fprintf(stderr, "Falha ao criar captura: %s\n", cfg.capture.c_str());
+        return 1;
+    }
+
+    // no modo diff a segunda vm eh uma copia da primeira (mesma rom e mesmo aleatorio)
+    // rodando no motor de blocos, a primeira fica no interpretador
+    Chip8 ref;
+    if (cfg.diff) {
+        vm.setEngine(ENGINE_SWITCH);
+        ref = vm;
+        ref.setEngine(ENGINE_BLOCK);
+    } else {
+        vm.setEngine(cfg.engine);
+    }
+
+    uint64_t executed = 0;  // instrucoes que rodaram de verdade (pro ips)
+    uint64_t scheduled = 0; // ciclos agendados, inclusive os devolvidos esperando tecla
+    uint64_t frame = 0;
+    size_t next_event = 0;
+    size_t next_movie = 0;
+    Scheduler sched(cfg.clock_hz);
+
+    // aplica uma tecla nas vms e grava no filme com o ciclo atual
+    auto apply_key = [&](uint8_t key, bool pressed) {
+        recorder.key(vm.cycles(), key, pressed);
+        vm.setKey(key, pressed);
+        if (cfg.diff) ref.setKey(key, pressed);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    // cada volta eh um frame virtual: aplica input, roda os ciclos do frame e desce os timers
+    while (cfg.frames == 0 || frame < cfg.frames) {
+        while (next_event < events.size() && events[next_event].frame <= frame) {
+            apply_key(events[next_event].key, events[next_event].pressed);
+            ++next_event;
+        }
+        while (next_movie < movie.events.size() && movie.events[next_movie].cycle <= vm.cycles()) {
+            apply_key(movie.events[next_movie].key, movie.events[next_movie].pressed);
+            ++next_movie;
+        }
+
+        int frame_cycles = sched.nextFrameCycles();
+
+        // no ultimo frame o limite de ciclos pode cortar o frame no meio
+        // (o limite conta ciclos agendados, senao uma rom parada no FX0A nunca terminaria)
+        // se o limite cai bem no fim do frame, o frame fecha normal (com os timers)
+        bool budget_done = false, budget_cut = false;
+        if (cfg.cycles != 0 && scheduled + frame_cycles >= cfg.cycles) {
+            budget_cut = scheduled + frame_cycles > cfg.cycles;
+            frame_cycles = (int) (cfg.cycles - scheduled);
+            budget_done = true;
+        }
+        scheduled += frame_cycles;
+        executed += debugging ? dbg.run(vm, frame_cycles) : vm.run(frame_cycles);
+        if (dbg.quitRequested()) break;
+
+        if (cfg.diff) {
+            ref.run(frame_cycles);
+            std::string what;
+            if (!vm.sameState(ref, &what)) {
+                std::fprintf(stderr, "Diferenca entre switch e block no frame %llu (%s)\n",
+                             (unsigned long long) frame, what.c_str());
+                return 2;
+            }
+        }
+        if (budget_cut) break;
+
+        // a tela que fica no fim do frame (o que a janela mostraria)
+        capture.frame(vm);
+        vm.tickTimers();
+        if (cfg.diff) ref.tickTimers();
+        ++frame;
+        if (budget_done) break;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(end - start).count();
+    double ips = secs > 0.0 ? (double) executed / secs : 0.0;
+
+    std::fprintf(report, "instrucoes: %llu\n", (unsigned long long) executed);
+    std::fprintf(report, "frames: %llu\n", (unsigned long long) frame);
+    std::fprintf(report, "tempo: %.6f s\n", secs);
+    std::fprintf(report, "ips: %.0f (alvo %d, %.0fx tempo real)\n", ips, cfg.clock_hz, ips / cfg.clock_hz);
+    std::fprintf(report, "hash: %016llx\n", (unsigned long long) vm.videoHash());
+    std::fprintf(report, "estado: %016llx\n", (unsigned long long) vm.stateHash());
+
+    if (PerfCounters::enabled) {
+        vm.perf().addTime(PERF_EMULATION, (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        if (writePerfJson(PERF_JSON_PATH, vm.perf())) std::fprintf(report, "contadores: %s\n", PERF_JSON_PATH);
+    }
+
+    if (dbg.isTracing()) {
+        uint64_t traced = dbg.traced();
+        if (!dbg.stopTrace()) {
+            std::fprintf(stderr, "Falha ao gravar trace: %s\n", cfg.trace.c_str());
+            return 1;
+        }
+        if (!cfg.trace.empty()) std::fprintf(report, "trace: %llu instrucoes em %s\n", (unsigned long long) traced, cfg.trace.c_str());
+    }
+
+    if (capture.isOpen()) {
+        uint64_t dropped = capture.dropped();
+        if (!capture.close()) {
+            std::fprintf(stderr, "Falha ao gravar captura: %s\n", cfg.capture.c_str());
+            return 1;
+        }
+        std::fprintf(report, "captura: %llu frames (%llu descartados) em %s, %dx%d\n",
+                     (unsigned long long) capture.encoded(), (unsigned long long) dropped, cfg.capture.c_str(),
+                     capture.width(), capture.height());
+    }
+
+    if (recorder.isOpen() && !recorder.finish(vm.cycles(), vm.stateHash())) {
+        std::fprintf(stderr, "Falha ao gravar filme: %s\n", cfg.record.c_str());
+        return 1;
+    }
+    if (!cfg.replay.empty() && movie.finished) {
+        bool ok = vm.cycles() == movie.end_cycle && vm.stateHash() == movie.end_hash;
+        std::fprintf(report, "replay: %s\n", ok ? "ok" : "DIVERGIU");
+        if (!ok) return 3;
+    }
+    return 0;
+}
@@ -46,16 +46,3 @@ bool Keyboard::isPressed(uint8_t chip8_key) const {
     if (chip8_key > 0xF) return false;
     return keys[chip8_key];
 }
-
-int Keyboard::waitForKey() {
-    SDL_Event e;
-    while (true) {
-        while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_KEYDOWN) {
-                uint8_t k = mapSDLKeyToChip8(e.key.keysym.sym);
-                if (k != 0xFF) return (int) k;
-            }
-        }
-        SDL_Delay(1);
-    }
-}
@@ -0,0 +1,523 @@
+#include "../defs/lockstep.h"
+#include "../defs/lockstep_kernel.h"
+#include "../defs/scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// lanes sem simd: um laco por operacao (o compilador vetoriza o que der)
+struct LanesScalar {
+    struct B {
+        uint8_t b[LOCKSTEP_LANES];
+    };
+    struct W {
+        uint16_t w[LOCKSTEP_LANES];
+    };
+
+    template <class F> static B mapB(F f) {
+        B r;
+        for (int i = 0; i < LOCKSTEP_LANES; ++i) r.b[i] = f(i);
+        return r;
+    }
+    template <class F> static W mapW(F f) {
+        W r;
+        for (int i = 0; i < LOCKSTEP_LANES; ++i) r.w[i] = f(i);
+        return r;
+    }
+
+    static B loadB(const uint8_t *p) { return mapB([&](int i) { return p[i]; }); }
+    static void storeB(uint8_t *p, const B &v) { std::memcpy(p, v.b, sizeof(v.b)); }
+    static B set1B(uint8_t v) { return mapB([&](int) { return v; }); }
+    static B addB(const B &a, const B &b) { return mapB([&](int i) { return (uint8_t) (a.b[i] + b.b[i]); }); }
+    static B subB(const B &a, const B &b) { return mapB([&](int i) { return (uint8_t) (a.b[i] - b.b[i]); }); }
+    static B andB(const B &a, const B &b) { return mapB([&](int i) { return (uint8_t) (a.b[i] & b.b[i]); }); }
+    static B orB(const B &a, const B &b) { return mapB([&](int i) { return (uint8_t) (a.b[i] | b.b[i]); }); }
+    static B xorB(const B &a, const B &b) { return mapB([&](int i) { return (uint8_t) (a.b[i] ^ b.b[i]); }); }
+    static B eqB(const B &a, const B &b) { return mapB([&](int i) { return (uint8_t) (a.b[i] == b.b[i] ? 0xFF : 0); }); }
+    static B geB(const B &a, const B &b) { return mapB([&](int i) { return (uint8_t) (a.b[i] >= b.b[i] ? 0xFF : 0); }); }
+    static B shr1B(const B &a) { return mapB([&](int i) { return (uint8_t) (a.b[i] >> 1); }); }
+    static B shl1B(const B &a) { return mapB([&](int i) { return (uint8_t) (a.b[i] << 1); }); }
+    static B shr7B(const B &a) { return mapB([&](int i) { return (uint8_t) (a.b[i] >> 7); }); }
+    static B blendB(const B &a, const B &b, const B &m) {
+        return mapB([&](int i) { return (uint8_t) ((b.b[i] & m.b[i]) | (a.b[i] & ~m.b[i])); });
+    }
+    static B bitsB(uint32_t bits) { return mapB([&](int i) { return (uint8_t) ((bits >> i) & 1 ? 0xFF : 0); }); }
+    static uint32_t moveB(const B &m) {
+        uint32_t bits = 0;
+        for (int i = 0; i < LOCKSTEP_LANES; ++i) bits |= (uint32_t) (m.b[i] >> 7) << i;
+        return bits;
+    }
+
+    static W loadW(const uint16_t *p) { return mapW([&](int i) { return p[i]; }); }
+    static void storeW(uint16_t *p, const W &v) { std::memcpy(p, v.w, sizeof(v.w)); }
+    static W set1W(uint16_t v) { return mapW([&](int) { return v; }); }
+    static W addW(const W &a, const W &b) { return mapW([&](int i) { return (uint16_t) (a.w[i] + b.w[i]); }); }
+    static W blendW(const W &a, const W &b, const W &m) {
+        return mapW([&](int i) { return (uint16_t) ((b.w[i] & m.w[i]) | (a.w[i] & ~m.w[i])); });
+    }
+    static W bitsW(uint32_t bits) { return mapW([&](int i) { return (uint16_t) ((bits >> i) & 1 ? 0xFFFF : 0); }); }
+    static W widenB(const B &a) { return mapW([&](int i) { return (uint16_t) a.b[i]; }); }
+    static uint32_t eqW(const W &a, uint16_t v) {
+        uint32_t bits = 0;
+        for (int i = 0; i < LOCKSTEP_LANES; ++i) bits |= (uint32_t) (a.w[i] == v) << i;
+        return bits;
+    }
+    static uint16_t minW(const W &a) {
+        uint16_t r = a.w[0];
+        for (int i = 1; i < LOCKSTEP_LANES; ++i) r = a.w[i] < r ? a.w[i] : r;
+        return r;
+    }
+    static uint16_t maxW(const W &a) {
+        uint16_t r = a.w[0];
+        for (int i = 1; i < LOCKSTEP_LANES; ++i) r = a.w[i] > r ? a.w[i] : r;
+        return r;
+    }
+    static B randB(uint32_t *rng, uint32_t bits) {
+        B r;
+        for (int i = 0; i < LOCKSTEP_LANES; ++i) {
+            uint32_t x = rng[i];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            if ((bits >> i) & 1) rng[i] = x;
+            r.b[i] = (uint8_t) (x >> 24);
+        }
+        return r;
+    }
+};
+
+#if defined(__SSE2__)
+// sse2 (todo x86-64 tem): 32 lanes = dois registradores de bytes, quatro de palavras
+struct LanesSse2 {
+    struct B {
+        __m128i lo, hi;
+    };
+    struct W {
+        __m128i v[4];
+    };
+
+    static __m128i ld(const void *p) { return _mm_load_si128((const __m128i *) p); }
+    static void st(void *p, __m128i v) { _mm_store_si128((__m128i *) p, v); }
+
+    static B loadB(const uint8_t *p) { return {ld(p), ld(p + 16)}; }
+    static void storeB(uint8_t *p, B v) {
+        st(p, v.lo);
+        st(p + 16, v.hi);
+    }
+    static B set1B(uint8_t v) { return {_mm_set1_epi8((char) v), _mm_set1_epi8((char) v)}; }
+    static B addB(B a, B b) { return {_mm_add_epi8(a.lo, b.lo), _mm_add_epi8(a.hi, b.hi)}; }
+    static B subB(B a, B b) { return {_mm_sub_epi8(a.lo, b.lo), _mm_sub_epi8(a.hi, b.hi)}; }
+    static B andB(B a, B b) { return {_mm_and_si128(a.lo, b.lo), _mm_and_si128(a.hi, b.hi)}; }
+    static B orB(B a, B b) { return {_mm_or_si128(a.lo, b.lo), _mm_or_si128(a.hi, b.hi)}; }
+    static B xorB(B a, B b) { return {_mm_xor_si128(a.lo, b.lo), _mm_xor_si128(a.hi, b.hi)}; }
+    static B eqB(B a, B b) { return {_mm_cmpeq_epi8(a.lo, b.lo), _mm_cmpeq_epi8(a.hi, b.hi)}; }
+    // a >= b sem sinal: max(a, b) == a
+    static B geB(B a, B b) {
+        return {_mm_cmpeq_epi8(_mm_max_epu8(a.lo, b.lo), a.lo), _mm_cmpeq_epi8(_mm_max_epu8(a.hi, b.hi), a.hi)};
+    }
+    // nao tem shift de byte: desloca as palavras e limpa o bit que veio do byte vizinho
+    static B shr1B(B a) {
+        const __m128i k = _mm_set1_epi8(0x7F);
+        return {_mm_and_si128(_mm_srli_epi16(a.lo, 1), k), _mm_and_si128(_mm_srli_epi16(a.hi, 1), k)};
+    }
+    static B shl1B(B a) { return {_mm_add_epi8(a.lo, a.lo), _mm_add_epi8(a.hi, a.hi)}; }
+    static B shr7B(B a) {
+        const __m128i k = _mm_set1_epi8(1);
+        return {_mm_and_si128(_mm_srli_epi16(a.lo, 7), k), _mm_and_si128(_mm_srli_epi16(a.hi, 7), k)};
+    }
+    static __m128i blend(__m128i a, __m128i b, __m128i m) { return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a)); }
+    static B blendB(B a, B b, B m) { return {blend(a.lo, b.lo, m.lo), blend(a.hi, b.hi, m.hi)}; }
+    // cada byte do bitmap vira 8 bytes iguais, e o and com 1,2,4..128 separa os bits
+    static __m128i bits16(uint32_t bits) {
+        const uint64_t spread = 0x0101010101010101ULL;
+        const __m128i k = _mm_set1_epi64x(0x8040201008040201LL);
+        __m128i v = _mm_set_epi64x((long long) (((bits >> 8) & 0xFF) * spread), (long long) ((bits & 0xFF) * spread));
+        return _mm_cmpeq_epi8(_mm_and_si128(v, k), k);
+    }
+    static B bitsB(uint32_t bits) { return {bits16(bits), bits16(bits >> 16)}; }
+    static uint32_t moveB(B m) { return (uint32_t) _mm_movemask_epi8(m.lo) | ((uint32_t) _mm_movemask_epi8(m.hi) << 16); }
+
+    static W loadW(const uint16_t *p) { return {{ld(p), ld(p + 8), ld(p + 16), ld(p + 24)}}; }
+    static void storeW(uint16_t *p, W v) {
+        for (int k = 0; k < 4; ++k) st(p + 8 * k, v.v[k]);
+    }
+    static W set1W(uint16_t v) {
+        __m128i s = _mm_set1_epi16((short) v);
+        return {{s, s, s, s}};
+    }
+    static W addW(W a, W b) {
+        W r;
+        for (int k = 0; k < 4; ++k) r.v[k] = _mm_add_epi16(a.v[k], b.v[k]);
+        return r;
+    }
+    static W blendW(W a, W b, W m) {
+        W r;
+        for (int k = 0; k < 4; ++k) r.v[k] = blend(a.v[k], b.v[k], m.v[k]);
+        return r;
+    }
+    static W bitsW(uint32_t bits) {
+        const __m128i k = _mm_set_epi16(128, 64, 32, 16, 8, 4, 2, 1);
+        W r;
+        for (int i = 0; i < 4; ++i) {
+            __m128i v = _mm_set1_epi16((short) ((bits >> (8 * i)) & 0xFF));
+            r.v[i] = _mm_cmpeq_epi16(_mm_and_si128(v, k), k);
+        }
+        return r;
+    }
+    static W widenB(B a) {
+        const __m128i z = _mm_setzero_si128();
+        return {{_mm_unpacklo_epi8(a.lo, z), _mm_unpackhi_epi8(a.lo, z), _mm_unpacklo_epi8(a.hi, z),
+                 _mm_unpackhi_epi8(a.hi, z)}};
+    }
+    static uint32_t eqW(W a, uint16_t v) {
+        __m128i s = _mm_set1_epi16((short) v);
+        __m128i lo = _mm_packs_epi16(_mm_cmpeq_epi16(a.v[0], s), _mm_cmpeq_epi16(a.v[1], s));
+        __m128i hi = _mm_packs_epi16(_mm_cmpeq_epi16(a.v[2], s), _mm_cmpeq_epi16(a.v[3], s));
+        return (uint32_t) _mm_movemask_epi8(lo) | ((uint32_t) _mm_movemask_epi8(hi) << 16);
+    }
+    // min/max com sinal do sse2 servem: os valores nunca passam de 0x7FFF
+    static uint16_t minW(W a) {
+        __m128i m = _mm_min_epi16(_mm_min_epi16(a.v[0], a.v[1]), _mm_min_epi16(a.v[2], a.v[3]));
+        m = _mm_min_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+        m = _mm_min_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+        m = _mm_min_epi16(m, _mm_srli_epi32(m, 16));
+        return (uint16_t) _mm_cvtsi128_si32(m);
+    }
+    static uint16_t maxW(W a) {
+        __m128i m = _mm_max_epi16(_mm_max_epi16(a.v[0], a.v[1]), _mm_max_epi16(a.v[2], a.v[3]));
+        m = _mm_max_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+        m = _mm_max_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+        m = _mm_max_epi16(m, _mm_srli_epi32(m, 16));
+        return (uint16_t) _mm_cvtsi128_si32(m);
+    }
+    // xorshift32 de 4 lanes por vez, o byte de cima das 32 junta com dois packs
+    static B randB(uint32_t *rng, uint32_t bits) {
+        const __m128i k = _mm_set_epi32(8, 4, 2, 1);
+        __m128i top[8];
+        for (int i = 0; i < 8; ++i) {
+            __m128i x = ld(rng + 4 * i);
+            x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+            x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+            x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+            __m128i m = _mm_set1_epi32((int) ((bits >> (4 * i)) & 0xF));
+            m = _mm_cmpeq_epi32(_mm_and_si128(m, k), k);
+            st(rng + 4 * i, blend(ld(rng + 4 * i), x, m));
+            top[i] = _mm_srli_epi32(x, 24);
+        }
+        __m128i w0 = _mm_packs_epi32(top[0], top[1]), w1 = _mm_packs_epi32(top[2], top[3]);
+        __m128i w2 = _mm_packs_epi32(top[4], top[5]), w3 = _mm_packs_epi32(top[6], top[7]);
+        return {_mm_packus_epi16(w0, w1), _mm_packus_epi16(w2, w3)};
+    }
+};
+#endif
+
+} // namespace
+
+const LockstepKernels *lockstepKernelsScalar() { return lockstepKernels<LanesScalar>(); }
+
+const LockstepKernels *lockstepKernelsSse2() {
+#if defined(__SSE2__)
+    return lockstepKernels<LanesSse2>();
+#else
+    return nullptr;
+#endif
+}
+
+// o melhor que a maquina roda, escolhido uma vez
+static const LockstepKernels *bestKernels(const char **name) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (lockstepKernelsAvx2() && __builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return lockstepKernelsAvx2();
+    }
+#endif
+    if (lockstepKernelsSse2()) {
+        *name = "sse2";
+        return lockstepKernelsSse2();
+    }
+    *name = "scalar";
+    return lockstepKernelsScalar();
+}
+
+static const char *kernels_name = "scalar";
+
+static const LockstepKernels *kernels() {
+    static const LockstepKernels *k = bestKernels(&kernels_name);
+    return k;
+}
+
+const char *LockstepBatch::isa() {
+    kernels();
+    return kernels_name;
+}
+
+LockstepBatch::LockstepBatch(Chip8 *vms, int count) : vms(vms), count(count), lockstep(false) {
+    std::memset(&lanes, 0, sizeof(lanes));
+    std::memset(parked, 0, sizeof(parked));
+    std::memset(enter, 0, sizeof(enter));
+    if (count <= 0 || count > LOCKSTEP_LANES || !vms[0].pristine) return;
+
+    // todas com a mesma rom (mesma imagem limpa) e o mesmo perfil
+    const uint8_t *image = vms[0].pristine->memory;
+    for (int i = 1; i < count; ++i) {
+        const Chip8 &vm = vms[i];
+        if (!vm.pristine || vm.quirks != vms[0].quirks) return;
+        if (vm.pristine != vms[0].pristine && std::memcmp(vm.pristine->memory, image, 4096) != 0) return;
+    }
+    for (int a = 0; a < 4096; ++a) decoded[a] = Chip8::decode((image[a] << 8) | image[(a + 1) & 0x0FFF]);
+    // de tras pra frente: o trecho continua na proxima instrucao, menos depois de um pulo
+    for (int a = 4095; a >= 0; --a) {
+        const Instr &in = decoded[a];
+        int run = 0;
+        bool jumps = in.op == OP_1NNN || in.op == OP_2NNN || in.op == OP_00EE;
+        if (lockstepSimd(in.op)) run = 1 + (!jumps && a + 2 < 4096 ? simd_run[a + 2] : 0);
+        simd_run[a] = (uint8_t) (run < 255 ? run : 255);
+    }
+    // laco todo simd (o 1NNN volta pra um trecho que chega nele, tipo esperar o delay timer):
+    // por menor que seja vale como trecho longo, as lanes ficam rodando ele em simd
+    for (int a = 0; a < 4096; ++a) {
+        const Instr &in = decoded[a];
+        int t = in.nnn;
+        if (in.op != OP_1NNN || t > a || (a - t) % 2 || simd_run[t] < (a - t) / 2 + 1) continue;
+        for (int p = t; p <= a; p += 2) simd_run[p] = 255;
+    }
+    for (int a = 0; a < 4096; ++a) enter[a] = simd_run[a] >= LOCKSTEP_MIN_RUN;
+    lockstep = true;
+}
+
+void LockstepBatch::pull(int l) {
+    const Chip8 &vm = vms[l];
+    for (int r = 0; r < 16; ++r) lanes.V[r][l] = vm.V[r];
+    lanes.I[l] = vm.I;
+    lanes.PC[l] = vm.PC;
+    lanes.delay[l] = vm.delay_timer;
+    lanes.sound[l] = vm.sound_timer;
+    lanes.rng[l] = vm.rng_state;
+    lanes.SP[l] = vm.SP;
+    for (int d = 0; d < 16; ++d) lanes.stack[d][l] = vm.stack[d];
+}
+
+void LockstepBatch::push(int l) {
+    Chip8 &vm = vms[l];
+    for (int r = 0; r < 16; ++r) vm.V[r] = lanes.V[r][l];
+    vm.I = lanes.I[l];
+    vm.PC = lanes.PC[l];
+    vm.delay_timer = lanes.delay[l];
+    vm.sound_timer = lanes.sound[l];
+    vm.rng_state = lanes.rng[l];
+    vm.SP = lanes.SP[l];
+    for (int d = 0; d < 16; ++d) vm.stack[d] = lanes.stack[d][l];
+}
+
+void LockstepBatch::scalarRun(int l, int cycles, bool alone) {
+    Chip8 &vm = vms[l];
+    push(l);
+
+    // o interpretador para nos enderecos marcados: inicio de trecho simd, ou (lane sozinha)
+    // onde tem outra lane parada. as outras nao andam enquanto essa roda
+    const uint8_t *stop = enter;
+    uint32_t others = lanes.active & ~(1u << l);
+    if (alone) {
+        for (uint32_t o = others; o; o &= o - 1) parked[lanes.PC[__builtin_ctz(o)] & 0x0FFF] = 1;
+        stop = parked;
+    }
+
+    int left = cycles - lanes.done[l];
+    int ran;
+    switch (vm.quirks) {
+        case QUIRKS_VIP: ran = vm.runSwitch<QuirksVIP, true>(left, stop); break;
+        case QUIRKS_CHIP48: ran = vm.runSwitch<QuirksChip48, true>(left, stop); break;
+        case QUIRKS_SCHIP: ran = vm.runSwitch<QuirksSChip, true>(left, stop); break;
+        default: ran = vm.runSwitch<QuirksModern, true>(left, stop); break;
+    }
+    if (alone) {
+        for (uint32_t o = others; o; o &= o - 1) parked[lanes.PC[__builtin_ctz(o)] & 0x0FFF] = 0;
+    }
+
+    pull(l);
+    lanes.done[l] += ran;
+    scalar_instrs += ran;
+    lanes.touched |= vm.pages_touched;
+    lanes.readonly = lanes.readonly && vm.code_readonly; // a pilha estourou: tem codigo fora da analise
+    if (vm.wait_reg >= 0 || vm.halted) lanes.active &= ~(1u << l);
+}
+
+void LockstepBatch::laneOp(int l, const Instr &in, uint16_t pc) {
+    Chip8 &vm = vms[l];
+    switch (in.op) {
+        case OP_DXYN: case OP_DXY0:
+            vm.V[in.x] = lanes.V[in.x][l];
+            vm.V[in.y] = lanes.V[in.y][l];
+            vm.I = lanes.I[l];
+            break;
+        case OP_FX33:
+            vm.V[in.x] = lanes.V[in.x][l];
+            vm.I = lanes.I[l];
+            break;
+        case OP_FX55:
+            for (int r = 0; r <= in.x; ++r) vm.V[r] = lanes.V[r][l];
+            vm.I = lanes.I[l];
+            break;
+        case OP_FX65:
+            vm.I = lanes.I[l];
+            break;
+        default: // 00E0 e os do SUPER-CHIP que so mexem na tela
+            break;
+    }
+
+    // uma instrucao so pelo interpretador (o stop nao vale na primeira)
+    vm.PC = pc;
+    switch (vm.quirks) {
+        case QUIRKS_VIP: vm.runSwitch<QuirksVIP, true>(1, enter); break;
+        case QUIRKS_CHIP48: vm.runSwitch<QuirksChip48, true>(1, enter); break;
+        case QUIRKS_SCHIP: vm.runSwitch<QuirksSChip, true>(1, enter); break;
+        default: vm.runSwitch<QuirksModern, true>(1, enter); break;
+    }
+
+    switch (in.op) {
+        case OP_DXYN: case OP_DXY0:
+            lanes.V[0xF][l] = vm.V[0xF];
+            break;
+        case OP_FX55:
+            lanes.I[l] = vm.I;
+            break;
+        case OP_FX65:
+            for (int r = 0; r <= in.x; ++r) lanes.V[r][l] = vm.V[r];
+            lanes.I[l] = vm.I;
+            break;
+        default:
+            break;
+    }
+    lanes.touched |= vm.pages_touched;
+}
+
+template <class F> uint64_t LockstepBatch::gate(F &&go) {
+    // medindo: LOCKSTEP_PROBE_RUNS runs de cada jeito, alternando (frames seguidos se parecem,
+    // um bloco de cada jeito pegaria fases diferentes do jogo)
+    bool probing = gate_left == 0;
+    bool mode = probing && (gate_probe & 1) ? !simd : simd;
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t n = go(mode);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    ++runs[mode];
+
+    if (!probing) {
+        --gate_left;
+        // media dos ultimos runs: o jeito atual ficou mais caro que o outro tava na medida (o
+        // jogo mudou de fase, as lanes se separaram), entao mede de novo ja
+        if (n) gate_cost += (ns / (double) n - gate_cost) * 0.25;
+        if (gate_cost > gate_rival) {
+            gate_left = 0;
+            gate_wait = LOCKSTEP_PROBE_RUNS;
+        }
+        return n;
+    }
+
+    gate_ns[mode] += ns;
+    gate_instrs[mode] += n;
+    if (++gate_probe == 2 * LOCKSTEP_PROBE_RUNS) {
+        double cur = gate_ns[simd] / (double) (gate_instrs[simd] ? gate_instrs[simd] : 1);
+        double other = gate_ns[!simd] / (double) (gate_instrs[!simd] ? gate_instrs[!simd] : 1);
+        // cada medida que confirma dobra a espera ate a proxima, uma troca volta pro comeco (a
+        // abertura do jogo costuma ser diferente do resto e a escolha feita ali pode nao valer)
+        if (other < cur) {
+            simd = !simd;
+            std::swap(cur, other);
+            gate_wait = LOCKSTEP_PROBE_RUNS;
+        } else {
+            gate_wait = std::min(gate_wait * 2, LOCKSTEP_PROBE_MAX);
+        }
+        gate_left = gate_wait;
+        gate_cost = cur;
+        gate_rival = other;
+        gate_probe = 0;
+        gate_ns[0] = gate_ns[1] = 0;
+        gate_instrs[0] = gate_instrs[1] = 0;
+    }
+    return n;
+}
+
+uint64_t LockstepBatch::run(int cycles) {
+    if (cycles <= 0) return 0;
+    if (!lockstep) return runSolo(cycles);
+    return gate([&](bool on) { return on ? runLanes(cycles) : runSolo(cycles); });
+}
+
+uint64_t LockstepBatch::runFrames(uint64_t first, int frames, int clock_hz) {
+    auto go = [&](bool on) {
+        uint64_t total = 0;
+        if (on) {
+            for (int f = 0; f < frames; ++f) {
+                total += runLanes(Scheduler::frameCycles(clock_hz, first + (uint64_t) f));
+                for (int i = 0; i < count; ++i) vms[i].tickTimers();
+            }
+            return total;
+        }
+        for (int i = 0; i < count; ++i) {
+            for (int f = 0; f < frames; ++f) {
+                total += (uint64_t) vms[i].run(Scheduler::frameCycles(clock_hz, first + (uint64_t) f));
+                vms[i].tickTimers();
+            }
+        }
+        scalar_instrs += total;
+        return total;
+    };
+    if (frames <= 0) return 0;
+    if (!lockstep) return go(false);
+    return gate(go);
+}
+
+uint64_t LockstepBatch::runSolo(int cycles) {
+    uint64_t total = 0;
+    for (int i = 0; i < count; ++i) total += (uint64_t) vms[i].run(cycles);
+    scalar_instrs += total;
+    return total;
+}
+
+uint64_t LockstepBatch::runLanes(int cycles) {
+    // o relogio anda pra todas, igual o Chip8::run (mesmo parada esperando tecla)
+    lanes.touched = 0;
+    lanes.pressed = 0;
+    lanes.readonly = true;
+    for (int l = 0; l < count; ++l) {
+        Chip8 &vm = vms[l];
+        vm.cycle_count += (uint64_t) cycles;
+        pull(l);
+        lanes.touched |= vm.pages_touched;
+        lanes.readonly = lanes.readonly && vm.code_readonly;
+        uint16_t keys = 0;
+        for (int k = 0; k < 16; ++k) keys |= (uint16_t) (vm.keypad[k] ? 1 : 0) << k;
+        lanes.keys[l] = keys;
+        if (keys) lanes.pressed |= 1u << l;
+    }
+
+    const LockstepKernels *k = kernels();
+    LockstepKernel kernel;
+    switch (vms[0].quirks) {
+        case QUIRKS_VIP: kernel = k->vip; break;
+        case QUIRKS_CHIP48: kernel = k->chip48; break;
+        case QUIRKS_SCHIP: kernel = k->schip; break;
+        default: kernel = k->modern; break;
+    }
+
+    // o done das lanes eh de 16 bits: orcamento grande vai em rodadas
+    uint64_t before = lanes.vector + scalar_instrs;
+    for (int left = cycles; left > 0;) {
+        int round = left < 0x7FFF ? left : 0x7FFF;
+        lanes.active = 0;
+        for (int l = 0; l < count; ++l) {
+            lanes.done[l] = 0;
+            if (vms[l].wait_reg < 0 && !vms[l].halted) lanes.active |= 1u << l;
+        }
+        kernel(*this, lanes, decoded, simd_run, round);
+        left -= round;
+    }
+
+    for (int l = 0; l < count; ++l) push(l);
+    return lanes.vector + scalar_instrs - before;
+}
@@ -0,0 +1,108 @@
+#include "../defs/lockstep.h"
+
+// kernel do lockstep em avx2: esse arquivo compila com -mavx2 (ver Makefile) e o lockstep.cpp
+// so escolhe ele se o processador tiver avx2. sem a flag (outra arquitetura) fica vazio
+#if defined(__AVX2__)
+#include "../defs/lockstep_kernel.h"
+#include <immintrin.h>
+
+namespace {
+
+// 32 lanes = um registrador de bytes, dois de palavras (lanes 0-15 e 16-31)
+struct LanesAvx2 {
+    using B = __m256i;
+    struct W {
+        __m256i lo, hi;
+    };
+
+    static B loadB(const uint8_t *p) { return _mm256_load_si256((const __m256i *) p); }
+    static void storeB(uint8_t *p, B v) { _mm256_store_si256((__m256i *) p, v); }
+    static B set1B(uint8_t v) { return _mm256_set1_epi8((char) v); }
+    static B addB(B a, B b) { return _mm256_add_epi8(a, b); }
+    static B subB(B a, B b) { return _mm256_sub_epi8(a, b); }
+    static B andB(B a, B b) { return _mm256_and_si256(a, b); }
+    static B orB(B a, B b) { return _mm256_or_si256(a, b); }
+    static B xorB(B a, B b) { return _mm256_xor_si256(a, b); }
+    static B eqB(B a, B b) { return _mm256_cmpeq_epi8(a, b); }
+    static B geB(B a, B b) { return _mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a); }
+    static B shr1B(B a) { return _mm256_and_si256(_mm256_srli_epi16(a, 1), _mm256_set1_epi8(0x7F)); }
+    static B shl1B(B a) { return _mm256_add_epi8(a, a); }
+    static B shr7B(B a) { return _mm256_and_si256(_mm256_srli_epi16(a, 7), _mm256_set1_epi8(1)); }
+    static B blendB(B a, B b, B m) { return _mm256_blendv_epi8(a, b, m); }
+    // cada byte do bitmap vira 8 bytes iguais, e o and com 1,2,4..128 separa os bits
+    static B bitsB(uint32_t bits) {
+        const uint64_t spread = 0x0101010101010101ULL;
+        const __m256i k = _mm256_set1_epi64x(0x8040201008040201LL);
+        __m256i v = _mm256_set_epi64x((long long) ((bits >> 24) * spread), (long long) (((bits >> 16) & 0xFF) * spread),
+                                      (long long) (((bits >> 8) & 0xFF) * spread), (long long) ((bits & 0xFF) * spread));
+        return _mm256_cmpeq_epi8(_mm256_and_si256(v, k), k);
+    }
+    static uint32_t moveB(B m) { return (uint32_t) _mm256_movemask_epi8(m); }
+
+    static W loadW(const uint16_t *p) {
+        return {_mm256_load_si256((const __m256i *) p), _mm256_load_si256((const __m256i *) (p + 16))};
+    }
+    static void storeW(uint16_t *p, W v) {
+        _mm256_store_si256((__m256i *) p, v.lo);
+        _mm256_store_si256((__m256i *) (p + 16), v.hi);
+    }
+    static W set1W(uint16_t v) { return {_mm256_set1_epi16((short) v), _mm256_set1_epi16((short) v)}; }
+    static W addW(W a, W b) { return {_mm256_add_epi16(a.lo, b.lo), _mm256_add_epi16(a.hi, b.hi)}; }
+    static W blendW(W a, W b, W m) { return {_mm256_blendv_epi8(a.lo, b.lo, m.lo), _mm256_blendv_epi8(a.hi, b.hi, m.hi)}; }
+    static W bitsW(uint32_t bits) {
+        const __m256i k = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384,
+                                            (short) 0x8000);
+        __m256i lo = _mm256_set1_epi16((short) (bits & 0xFFFF));
+        __m256i hi = _mm256_set1_epi16((short) (bits >> 16));
+        return {_mm256_cmpeq_epi16(_mm256_and_si256(lo, k), k), _mm256_cmpeq_epi16(_mm256_and_si256(hi, k), k)};
+    }
+    static W widenB(B a) {
+        return {_mm256_cvtepu8_epi16(_mm256_castsi256_si128(a)), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(a, 1))};
+    }
+    // o pack junta por metade de 128 bits, o permute poe as lanes de volta em ordem
+    static uint32_t eqW(W a, uint16_t v) {
+        __m256i s = _mm256_set1_epi16((short) v);
+        __m256i p = _mm256_packs_epi16(_mm256_cmpeq_epi16(a.lo, s), _mm256_cmpeq_epi16(a.hi, s));
+        return (uint32_t) _mm256_movemask_epi8(_mm256_permute4x64_epi64(p, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    // minpos (sse4.1) acha o menor de 8 palavras sem sinal, o maior eh o menor do complemento
+    static uint16_t minW(W a) {
+        __m256i m = _mm256_min_epu16(a.lo, a.hi);
+        __m128i h = _mm_min_epu16(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+        return (uint16_t) _mm_cvtsi128_si32(_mm_minpos_epu16(h));
+    }
+    static uint16_t maxW(W a) {
+        __m256i m = _mm256_max_epu16(a.lo, a.hi);
+        __m128i h = _mm_max_epu16(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+        h = _mm_xor_si128(h, _mm_set1_epi16(-1));
+        return (uint16_t) ~_mm_cvtsi128_si32(_mm_minpos_epu16(h));
+    }
+    // xorshift32 de 8 lanes por vez. os packs juntam por metade de 128 bits, entao sai em
+    // pedacos de 4 lanes fora de ordem e o permute arruma
+    static B randB(uint32_t *rng, uint32_t bits) {
+        const __m256i k = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i top[4];
+        for (int i = 0; i < 4; ++i) {
+            __m256i old = _mm256_load_si256((const __m256i *) (rng + 8 * i));
+            __m256i x = _mm256_xor_si256(old, _mm256_slli_epi32(old, 13));
+            x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+            x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+            __m256i m = _mm256_set1_epi32((int) ((bits >> (8 * i)) & 0xFF));
+            m = _mm256_cmpeq_epi32(_mm256_and_si256(m, k), k);
+            _mm256_store_si256((__m256i *) (rng + 8 * i), _mm256_blendv_epi8(old, x, m));
+            top[i] = _mm256_srli_epi32(x, 24);
+        }
+        __m256i w = _mm256_packus_epi16(_mm256_packus_epi32(top[0], top[1]), _mm256_packus_epi32(top[2], top[3]));
+        return _mm256_permutevar8x32_epi32(w, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    }
+};
+
+} // namespace
+
+const LockstepKernels *lockstepKernelsAvx2() { return lockstepKernels<LanesAvx2>(); }
+
+#else
+
+const LockstepKernels *lockstepKernelsAvx2() { return nullptr; }
+
+#endif
@@ -2,11 +2,24 @@
 #include <cstdio>
 #include <cstring>
 #include <string>
+#include <vector>
 #include <chrono>
+#include <random>
+#include <thread>
+#include <atomic>
 
 #include "../defs/chip8.h"
 #include "../defs/display.h"
 #include "../defs/keyboard.h"
+#include "../defs/audio.h"
+#include "../defs/triple_buffer.h"
+#include "../defs/scheduler.h"
+#include "../defs/state.h"
+#include "../defs/rewind.h"
+#include "../defs/movie.h"
+#include "../defs/analyzer.h"
+#include "../defs/capture.h"
+#include "../defs/perf.h"
 #include "../defs/defs.h"
 
 // struct pra guardar as configs que vem da linha de comando
@@ -17,6 +30,21 @@ struct Config {
     int color_r = 255;               // cor padrao (branco)
     int color_g = 255;
     int color_b = 255;
+    Engine engine = ENGINE_SWITCH;   // motor de execucao da vm
+    QuirkProfile quirks = QUIRKS_MODERN; // perfil de compatibilidade
+    int rewind_mb = REWIND_DEFAULT_MB; // memoria do rewind (0 desliga)
+    bool has_seed = false;           // semente do aleatorio fixada pelo usuario
+    uint32_t seed = 0;
+    std::string record;              // arquivo do filme (gravacao de input)
+    std::string capture;             // grava a tela (gif, apng ou frames crus)
+    int capture_scale = CAPTURE_DEFAULT_SCALE;
+};
+
+// uma tela pronta, do jeito que a thread da emulacao publica pra principal desenhar
+struct VideoFrame {
+    int width = CHIP8_WIDTH;
+    int height = CHIP8_HEIGHT;
+    uint8_t pixels[SCHIP_WIDTH * SCHIP_HEIGHT];
 };
 
 // mostra as instrucoes pro usuario
@@ -27,8 +55,17 @@ static void print_help(const char *prog) {
         "  --scale <n>        escala da janela (padrao %d)\n"
         "  --clock <hz>       velocidade da cpu (padrao %d)\n"
         "  --color <r> <g> <b> cor dos pixels (0-255 cada, padrao branco)\n"
-        "  --help             mostra essa mensagem\n",
-        prog, DEFAULT_SCALE, DEFAULT_CLOCK_HZ);
+        "  --engine <nome>    motor de execucao: switch ou block (padrao switch)\n"
+        "  --quirks <perfil>  compatibilidade: modern, vip, chip48 ou schip (padrao modern)\n"
+        "  --rewind-mb <n>    memoria do rewind em mb, ate %d s de historico (padrao %d, 0 desliga)\n"
+        "  --seed <n>         semente do aleatorio (CXNN)\n"
+        "  --record <arquivo> grava o input num filme (tocar com chip8-headless --replay)\n"
+        "  --capture <arquivo> grava a tela: .gif, .png (apng) ou frames rgb24 crus\n"
+        "  --capture-scale <n> escala da gravacao, tela de 128x64 (padrao %d)\n"
+        "  --help             mostra essa mensagem\n"
+        "Teclas: F5 salva o estado, F9 carrega, Backspace (segurando) volta no tempo,\n"
+        "        F10 grava os contadores de performance em " PERF_JSON_PATH " (make PERF=1), Esc sai\n",
+        prog, DEFAULT_SCALE, DEFAULT_CLOCK_HZ, REWIND_MAX_SECONDS, REWIND_DEFAULT_MB, CAPTURE_DEFAULT_SCALE);
 }
 
 // le os argumentos do terminal
@@ -50,6 +87,37 @@ static bool parse_args(int argc, char **argv, Config &cfg) {
             cfg.color_g = std::atoi(argv[++i]);
             cfg.color_b = std::atoi(argv[++i]);
 
+        } else if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (std::strcmp(name, "switch") == 0) cfg.engine = ENGINE_SWITCH;
+            else if (std::strcmp(name, "block") == 0) cfg.engine = ENGINE_BLOCK;
+            else {
+                std::fprintf(stderr, "Motor desconhecido: %s\n", name);
+                return false;
+            }
+
+        } else if (std::strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            if (!parseQuirkProfile(argv[++i], cfg.quirks)) {
+                std::fprintf(stderr, "Perfil de quirks desconhecido: %s\n", argv[i]);
+                return false;
+            }
+
+        } else if (std::strcmp(argv[i], "--rewind-mb") == 0 && i + 1 < argc) {
+            cfg.rewind_mb = std::atoi(argv[++i]);
+
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            cfg.seed = (uint32_t) std::strtoul(argv[++i], nullptr, 10);
+            cfg.has_seed = true;
+
+        } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            cfg.record = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            cfg.capture = argv[++i];
+
+        } else if (std::strcmp(argv[i], "--capture-scale") == 0 && i + 1 < argc) {
+            cfg.capture_scale = std::atoi(argv[++i]);
+
         } else if (argv[i][0] == '-') {
             std::fprintf(stderr, "Opcao desconhecida: %s\n", argv[i]);
             return false;
@@ -64,6 +132,19 @@ static bool parse_args(int argc, char **argv, Config &cfg) {
         print_help(argv[0]);
         return false;
     }
+    if (cfg.clock_hz <= 0) {
+        std::fprintf(stderr, "Clock invalido: %d\n", cfg.clock_hz);
+        return false;
+    }
+    if (cfg.rewind_mb < 0) {
+        std::fprintf(stderr, "Memoria do rewind invalida: %d\n", cfg.rewind_mb);
+        return false;
+    }
+    // aqui o stdout tem as mensagens do emulador, frames no stdout so pelo chip8-headless
+    if (cfg.capture == "-") {
+        std::fprintf(stderr, "--capture - so no chip8-headless, aqui grave num arquivo\n");
+        return false;
+    }
     return true;
 }
 
@@ -82,66 +163,289 @@ int main(int argc, char **argv) {
     if (!display.init(cfg.scale)) return 1;
     Keyboard keyboard;
 
+    // som: se nao abrir o dispositivo segue mudo
+    Audio audio;
+    audio.init();
+
     // cria a vm e carrega a rom
     Chip8 vm;
     vm.initialize();
+    vm.setEngine(cfg.engine);
+    vm.setQuirks(cfg.quirks);
     if (!vm.loadROM(cfg.rom)) {
         std::fprintf(stderr, "Falha ao carregar ROM: %s\n", cfg.rom.c_str());
         return 1;
     }
+    vm.useAnalysis(analyzeRom(vm.memoryData(), DEFAULT_PC_START));
+
+    // gravando: a semente tem que ir pro filme, entao sorteia aqui se nao passaram uma
+    // (rewind e F9 ficam desligados, eles mudariam a vm por fora do input gravado)
+    MovieWriter recorder;
+    if (!cfg.record.empty()) {
+        uint64_t rom_hash = 0;
+        if (!cfg.has_seed) cfg.seed = std::random_device{}();
+        cfg.has_seed = true;
+        cfg.rewind_mb = 0;
+        if (!fileHash(cfg.rom, rom_hash) || !recorder.open(cfg.record, cfg.seed, cfg.clock_hz, rom_hash, cfg.quirks)) {
+            std::fprintf(stderr, "Falha ao criar filme: %s\n", cfg.record.c_str());
+            return 1;
+        }
+    }
+    if (cfg.has_seed) vm.seed(cfg.seed);
+
+    // gravacao da tela: a thread da emulacao so entrega os frames, quem codifica eh a do Capture
+    Capture capture;
+    if (!cfg.capture.empty() && !capture.open(cfg.capture, cfg.capture_scale, cfg.color_r, cfg.color_g, cfg.color_b)) {
+        std::fprintf(stderr, "Falha ao criar captura: %s\n", cfg.capture.c_str());
+        return 1;
+    }
+
+    // a cpu roda em lotes de um frame (1/60s): o scheduler diz quantos ciclos cada
+    // frame tem, e o relogio so decide quando o proximo frame ja devia ter rodado
+    Scheduler sched(cfg.clock_hz);
+    IpsMeter meter; // ips desde o inicio (relatorio no final)
+
+    // save state fica do lado da rom (jogo.ch8 -> jogo.ch8.state)
+    const std::string state_path = cfg.rom + ".state";
+
+    // historico do rewind, ja guarda o estado inicial como primeiro frame
+    RewindBuffer rewind((size_t) cfg.rewind_mb * 1024 * 1024);
+    rewind.push(vm);
+
+    // a vm roda numa thread so dela e a principal so trata eventos e desenha, assim um
+    // present travado no vsync nao atrasa a cpu. o que passa de uma pra outra:
+    TripleBuffer<VideoFrame> frames;         // telas prontas (emulacao -> principal)
+    std::atomic<bool> running{true};
+    std::atomic<uint16_t> key_mask{0};       // bit k = tecla k apertada (principal -> emulacao)
+    std::atomic<bool> rewinding{false};      // backspace segurado: cada frame volta um em vez de rodar
+    std::atomic<bool> want_save{false}, want_load{false}, want_perf{false}; // F5, F9, F10
+    std::atomic<bool> perf_ready{false};     // perf_snapshot preenchido pela emulacao
+    std::atomic<bool> frame_event{false};    // ja tem um FRAME_EVENT na fila do sdl
+    std::atomic<uint64_t> executed{0};       // instrucoes rodadas (titulo da janela)
+    PerfCounters perf_snapshot;              // copia dos contadores da vm pro F10
+    const Uint32 FRAME_EVENT = SDL_RegisterEvents(1); // acorda a principal quando tem tela nova
+
+    // thread da emulacao: roda os frames no horario e publica a tela quando ela muda
+    std::thread emulation([&] {
+        using clock = std::chrono::steady_clock;
+        const auto start = clock::now();
+        // horario em que o frame n devia comecar, calculado sempre a partir do inicio
+        // (nada de somar intervalos arredondados, que era o que fazia o clock escorregar)
+        auto frame_deadline = [&](uint64_t n) {
+            return start + std::chrono::nanoseconds((int64_t) (n * 1000000000ULL / 60));
+        };
+        std::vector<uint8_t> state_buf;
+        // estado das teclas que a vm ja recebeu, so as mudancas vao pro filme
+        bool vm_keys[16] = {};
+        // frames que a vm rodou de verdade: o tamanho de cada frame sai dele (e nao do
+        // relogio, que pula frames quando atrasa) pra bater com o replay no headless
+        uint64_t vm_frames = 0;
+        bool publish = true; // manda a tela mesmo sem mudanca (primeiro frame, estado carregado)
 
-    // define os intervalos de tempo (cpu, frame e timer)
-    const double cpu_dt_ms = 1000.0 / (double) cfg.clock_hz;
-    const double frame_dt_ms = 1000.0 / 60.0;
-    const double timer_dt_ms = 1000.0 / 60.0;
+        while (running.load(std::memory_order_relaxed)) {
+            PerfCounters &perf = vm.perf();
+            // pedidos das teclas de atalho, entre um frame e outro
+            if (want_save.exchange(false)) {
+                vm.saveState(state_buf);
+                if (writeStateFile(state_path, state_buf)) std::printf("Estado salvo em %s\n", state_path.c_str());
+                else std::fprintf(stderr, "Falha ao salvar estado: %s\n", state_path.c_str());
+            }
+            if (want_load.exchange(false)) {
+                if (readStateFile(state_path, state_buf) && vm.loadState(state_buf)) {
+                    std::printf("Estado carregado de %s\n", state_path.c_str());
+                    publish = true;
+                    // o historico era de outra linha do tempo
+                    rewind.clear();
+                    rewind.push(vm);
+                } else {
+                    std::fprintf(stderr, "Falha ao carregar estado: %s\n", state_path.c_str());
+                }
+            }
+            if (want_perf.exchange(false)) {
+                perf_snapshot = perf;
+                perf_ready.store(true, std::memory_order_release);
+            }
 
-    auto last_cpu = std::chrono::high_resolution_clock::now();
-    auto last_frame = last_cpu;
-    auto last_timer = last_cpu;
+            // passa o estado do teclado pra vm
+            uint16_t mask = key_mask.load(std::memory_order_acquire);
+            for (uint8_t k = 0; k < 16; ++k) {
+                bool down = (mask >> k) & 1;
+                if (down == vm_keys[k]) continue;
+                recorder.key(vm.cycles(), k, down);
+                vm.setKey(k, down);
+                vm_keys[k] = down;
+            }
 
-    bool running = true;
+            // roda os frames que ja venceram: ciclos do frame, depois os timers
+            auto now = clock::now();
+            int caught_up = 0;
+            uint64_t t0 = perf.begin();
+            while (now >= frame_deadline(sched.frames()) && caught_up < MAX_CATCHUP_FRAMES) {
+                if (rewinding.load(std::memory_order_relaxed) && rewind.enabled()) {
+                    // voltando no tempo: o frame vira um passo pra tras, no mesmo ritmo de 60 Hz
+                    sched.nextFrameCycles();
+                    rewind.stepBack(vm);
+                    audio.frame(false);
+                    capture.frame(vm);
+                } else {
+                    sched.nextFrameCycles();
+                    int n = vm.run(Scheduler::frameCycles(cfg.clock_hz, vm_frames++));
+                    meter.add(n);
+                    executed.fetch_add(n, std::memory_order_relaxed);
+                    audio.frame(vm.isBeeping()); // o som do frame sai do timer antes de descer
+                    capture.frame(vm);
+                    vm.tickTimers();
+                    rewind.push(vm);
+                }
+                ++caught_up;
+            }
+            perf.end(PERF_EMULATION, t0);
+            // ficou muito pra tras (maquina travou): descarta o atraso em vez de tentar
+            // recuperar tudo de uma vez
+            if (caught_up == MAX_CATCHUP_FRAMES && now >= frame_deadline(sched.frames())) {
+                uint64_t behind = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    now - start).count() * 60 / 1000000000ULL;
+                sched.skipTo(behind);
+            }
+
+            // so publica se a vm mexeu na tela, e so acorda a principal se ela ja nao
+            // tiver um aviso pendente (frames que ela nao pegou sao sobrescritos)
+            if (caught_up > 0 && (vm.takeDirty() || publish)) {
+                VideoFrame &f = frames.back();
+                f.width = vm.width();
+                f.height = vm.height();
+                std::memcpy(f.pixels, vm.video(), f.width * f.height);
+                frames.publish();
+                publish = false;
+                if (!frame_event.exchange(true)) {
+                    SDL_Event ev;
+                    std::memset(&ev, 0, sizeof(ev));
+                    ev.type = FRAME_EVENT;
+                    SDL_PushEvent(&ev);
+                }
+            } else if (caught_up > 0) {
+                perf.frame(false);
+            }
+
+            // a fila de som acompanha o dispositivo e nao os frames: acorda antes do proximo
+            // frame so pra completar ela
+            auto wake = frame_deadline(sched.frames());
+            if (audio.isOpen()) {
+                auto soon = clock::now() + std::chrono::milliseconds(AUDIO_PUMP_MS);
+                if (soon < wake) wake = soon;
+            }
+            std::this_thread::sleep_until(wake);
+            audio.pump();
+        }
+    });
+
+    // daqui pra baixo eh a thread principal: eventos, teclado e desenho
+    PerfCounters ui_perf;      // draw e eventos, juntados com os da vm na hora de gravar
+    bool perf_pending = false; // pediu os contadores da vm e ainda nao chegaram
+    bool force_draw = false;   // redesenha mesmo sem tela nova (janela exposta)
+    bool drawn = false;        // ja tem uma tela no front pra redesenhar
+    uint64_t title_executed = 0;
+    IpsMeter title_clock;      // so o relogio do titulo
     SDL_Event e;
 
-    // loop principal do programa
+    // trata um evento (teclado, sair, etc)
+    // o que mexe na vm vira pedido pra thread da emulacao atender entre dois frames
+    auto handle_event = [&](const SDL_Event &ev) {
+        if (ev.type == FRAME_EVENT) frame_event.store(false);
+        if (ev.type == SDL_QUIT) running = false;
+        if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_ESCAPE) running = false;
+        if (ev.type == SDL_WINDOWEVENT) force_draw = true;
+        if (ev.type == SDL_KEYDOWN && ev.key.repeat == 0 && ev.key.keysym.sym == SDLK_F5) want_save = true;
+        if (ev.type == SDL_KEYDOWN && ev.key.repeat == 0 && ev.key.keysym.sym == SDLK_F9 && !recorder.isOpen()) {
+            want_load = true;
+        }
+        if (ev.type == SDL_KEYDOWN && ev.key.repeat == 0 && ev.key.keysym.sym == SDLK_F10) {
+            if (!PerfCounters::enabled) std::printf("Contadores desligados, compile com make PERF=1\n");
+            else if (!perf_pending) {
+                perf_pending = true;
+                want_perf = true;
+            }
+        }
+        if ((ev.type == SDL_KEYDOWN || ev.type == SDL_KEYUP) && ev.key.keysym.sym == SDLK_BACKSPACE) {
+            rewinding = ev.type == SDL_KEYDOWN;
+        }
+        keyboard.handleEvent(ev);
+    };
+
+    // loop principal: dorme ate chegar um evento (tela nova tambem chega como evento)
     while (running && display.isOpen()) {
-        // trata os eventos (teclado, sair, etc)
-        while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_QUIT) running = false;
-            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE) running = false;
-            keyboard.handleEvent(e);
+        // acorda pelo menos a cada 250 ms pra atualizar o titulo
+        if (SDL_WaitEventTimeout(&e, 250)) {
+            uint64_t t0 = ui_perf.begin();
+            do {
+                handle_event(e);
+            } while (SDL_PollEvent(&e));
+            ui_perf.end(PERF_EVENTS, t0);
         }
 
-        // calcula quanto tempo passou pra saber se roda outro ciclo da cpu
-        auto now = std::chrono::high_resolution_clock::now();
-        double ms_since_cpu = std::chrono::duration<double, std::milli>(now - last_cpu).count();
-        while (ms_since_cpu >= cpu_dt_ms) {
-            vm.emulateCycle(keyboard, display);
-            last_cpu += std::chrono::milliseconds((int) cpu_dt_ms);
-            now = std::chrono::high_resolution_clock::now();
-            ms_since_cpu = std::chrono::duration<double, std::milli>(now - last_cpu).count();
+        // teclado pra emulacao, uma palavra so
+        uint16_t mask = 0;
+        for (uint8_t k = 0; k < 16; ++k) mask |= (uint16_t) keyboard.isPressed(k) << k;
+        key_mask.store(mask, std::memory_order_release);
+
+        // desenha a tela mais nova, ou a mesma de novo se a janela pediu
+        bool fresh = frames.update();
+        if (fresh || (force_draw && drawn)) {
+            const VideoFrame &f = frames.front();
+            uint64_t t0 = ui_perf.begin();
+            display.draw(f.pixels, f.width, f.height, cfg.color_r, cfg.color_g, cfg.color_b);
+            ui_perf.end(PERF_DRAW, t0);
+            ui_perf.frame(true);
+            drawn = true;
+            force_draw = false;
         }
 
-        // atualiza timers a cada 1/60s
-        double ms_since_timer = std::chrono::duration<double, std::milli>(now - last_timer).count();
-        if (ms_since_timer >= timer_dt_ms) {
-            vm.tickTimers();
-            last_timer = now;
+        if (perf_pending && perf_ready.exchange(false, std::memory_order_acquire)) {
+            PerfCounters all = perf_snapshot;
+            all.merge(ui_perf);
+            if (writePerfJson(PERF_JSON_PATH, all)) std::printf("Contadores gravados em %s\n", PERF_JSON_PATH);
+            perf_pending = false;
         }
 
-        // atualiza o frame da tela a cada 1/60s
-        double ms_since_frame = std::chrono::duration<double, std::milli>(now - last_frame).count();
-        if (ms_since_frame >= frame_dt_ms) {
-            // aqui passa a cor escolhida pro draw
-            // precisa ajustar a funcao draw no display pra aceitar rgb
-            display.draw(vm.video(), cfg.color_r, cfg.color_g, cfg.color_b);
-            last_frame = now;
+        // mostra o ips real x alvo no titulo uma vez por segundo
+        if (title_clock.seconds() >= 1.0) {
+            uint64_t now_executed = executed.load(std::memory_order_relaxed);
+            char title[96];
+            std::snprintf(title, sizeof(title), "CHIP-8 - %.0f / %d ips",
+                          (now_executed - title_executed) / title_clock.seconds(), cfg.clock_hz);
+            display.setTitle(title);
+            title_executed = now_executed;
+            title_clock.reset();
         }
+    }
+    running = false;
+    emulation.join();
 
-        // pequena pausa pra nao travar o sistema
-        SDL_Delay(1);
+    std::printf("ips alvo: %d, ips real: %.0f (%llu instrucoes em %.2f s)\n",
+                sched.clock(), meter.ips(), (unsigned long long) meter.executed(), meter.seconds());
+
+    if (PerfCounters::enabled) {
+        PerfCounters all = vm.perf();
+        all.merge(ui_perf);
+        if (writePerfJson(PERF_JSON_PATH, all)) std::printf("Contadores gravados em %s\n", PERF_JSON_PATH);
+    }
+    if (recorder.isOpen()) {
+        if (recorder.finish(vm.cycles(), vm.stateHash())) std::printf("Filme gravado em %s\n", cfg.record.c_str());
+        else std::fprintf(stderr, "Falha ao gravar filme: %s\n", cfg.record.c_str());
+    }
+    if (capture.isOpen()) {
+        uint64_t dropped = capture.dropped();
+        if (capture.close()) {
+            std::printf("Captura gravada em %s (%llu frames, %llu descartados)\n", cfg.capture.c_str(),
+                        (unsigned long long) capture.encoded(), (unsigned long long) dropped);
+        } else {
+            std::fprintf(stderr, "Falha ao gravar captura: %s\n", cfg.capture.c_str());
+        }
     }
+    if (audio.underruns() > 0) std::printf("audio: fila vazia %llu vezes\n", (unsigned long long) audio.underruns());
 
     // fecha tudo
+    audio.shutdown();
     display.shutdown();
     SDL_Quit();
     return 0;
@@ -0,0 +1,116 @@
+#include "../defs/movie.h"
+#include "../defs/romfile.h"
+#include <climits>
+#include <cstring>
+
+// escreve/le numeros em little endian direto no arquivo
+static void write8(std::ostream &o, uint8_t v) { o.put((char) v); }
+static void write32(std::ostream &o, uint32_t v) {
+    for (int i = 0; i < 4; ++i) o.put((char) ((v >> (8 * i)) & 0xFF));
+}
+static void write64(std::ostream &o, uint64_t v) {
+    for (int i = 0; i < 8; ++i) o.put((char) ((v >> (8 * i)) & 0xFF));
+}
+static bool read8(std::istream &in, uint8_t &v) {
+    char c;
+    if (!in.get(c)) return false;
+    v = (uint8_t) c;
+    return true;
+}
+static bool read32(std::istream &in, uint32_t &v) {
+    v = 0;
+    for (int i = 0; i < 4; ++i) {
+        uint8_t b;
+        if (!read8(in, b)) return false;
+        v |= (uint32_t) b << (8 * i);
+    }
+    return true;
+}
+static bool read64(std::istream &in, uint64_t &v) {
+    v = 0;
+    for (int i = 0; i < 8; ++i) {
+        uint8_t b;
+        if (!read8(in, b)) return false;
+        v |= (uint64_t) b << (8 * i);
+    }
+    return true;
+}
+
+bool MovieWriter::open(const std::string &path, uint32_t seed, int clock_hz, uint64_t rom_hash, QuirkProfile quirks) {
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+    out.write(MOVIE_MAGIC, 4);
+    write8(out, MOVIE_VERSION);
+    write32(out, seed);
+    write32(out, (uint32_t) clock_hz);
+    write64(out, rom_hash);
+    write8(out, (uint8_t) quirks);
+    return (bool) out;
+}
+
+void MovieWriter::key(uint64_t cycle, uint8_t key, bool pressed) {
+    if (!out.is_open()) return;
+    write8(out, MOVIE_KEY);
+    write64(out, cycle);
+    write8(out, key);
+    write8(out, pressed ? 1 : 0);
+}
+
+bool MovieWriter::finish(uint64_t cycle, uint64_t state_hash) {
+    if (!out.is_open()) return false;
+    write8(out, MOVIE_END);
+    write64(out, cycle);
+    write64(out, state_hash);
+    out.close();
+    return !out.fail();
+}
+
+bool loadMovie(const std::string &path, Movie &movie) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+
+    char magic[4];
+    uint8_t version;
+    uint32_t clock;
+    if (!in.read(magic, 4) || std::memcmp(magic, MOVIE_MAGIC, 4) != 0) return false;
+    if (!read8(in, version) || version < 1 || version > MOVIE_VERSION) return false;
+    if (!read32(in, movie.seed) || !read32(in, clock) || !read64(in, movie.rom_hash)) return false;
+    if (clock == 0 || clock > (uint32_t) INT_MAX) return false; // 0 nao roda nada (e vira divisor)
+    movie.clock_hz = (int) clock;
+    movie.quirks = QUIRKS_MODERN;
+    if (version >= 2) {
+        uint8_t q;
+        if (!read8(in, q) || q > QUIRKS_SCHIP) return false;
+        movie.quirks = (QuirkProfile) q;
+    }
+
+    movie.events.clear();
+    movie.finished = false;
+    uint8_t type;
+    while (read8(in, type)) {
+        if (type == MOVIE_KEY) {
+            MovieEvent ev;
+            uint8_t key, pressed;
+            if (!read64(in, ev.cycle) || !read8(in, key) || !read8(in, pressed)) return false;
+            if (key > 0xF) return false;
+            if (!movie.events.empty() && ev.cycle < movie.events.back().cycle) return false;
+            ev.key = key;
+            ev.pressed = pressed != 0;
+            movie.events.push_back(ev);
+        } else if (type == MOVIE_END) {
+            if (!read64(in, movie.end_cycle) || !read64(in, movie.end_hash)) return false;
+            movie.finished = true;
+            break;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool fileHash(const std::string &path, uint64_t &hash) {
+    RomFile rom;
+    if (!rom.open(path)) return false;
+    hash = romHash(rom.data(), rom.size());
+    return true;
+}
@@ -0,0 +1,46 @@
+#include "../defs/perf.h"
+#include "../defs/chip8.h"
+#include <cstdio>
+
+// nome de cada Op, na mesma ordem do enum
+static const char *const op_names[OP_COUNT] = {
+    "NONE", "00E0", "00EE", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+    "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE", "9XY0",
+    "ANNN", "BNNN", "CXNN", "DXYN", "EX9E", "EXA1", "FX07", "FX0A", "FX15", "FX18",
+    "FX1E", "FX29", "FX33", "FX55", "FX65", "00CN", "00FB", "00FC", "00FD", "00FE",
+    "00FF", "DXY0", "FX30", "FX75", "FX85", "UNKNOWN"
+};
+
+bool writePerfJson(const std::string &path, const PerfCountersT<true> &perf) {
+    FILE *f = std::fopen(path.c_str(), "w");
+    if (!f) return false;
+
+    uint64_t total = 0;
+    for (int i = 0; i < OP_COUNT; ++i) total += perf.ops[i];
+
+    std::fprintf(f, "{\n  \"enabled\": true,\n  \"instructions\": %llu,\n  \"ops\": {",
+                 (unsigned long long) total);
+    bool first = true;
+    for (int i = 0; i < OP_COUNT; ++i) {
+        if (perf.ops[i] == 0) continue;
+        std::fprintf(f, "%s\n    \"%s\": %llu", first ? "" : ",", op_names[i], (unsigned long long) perf.ops[i]);
+        first = false;
+    }
+    std::fprintf(f, "\n  },\n");
+    std::fprintf(f, "  \"sprites\": %llu,\n", (unsigned long long) perf.sprites);
+    std::fprintf(f, "  \"pixels\": %llu,\n", (unsigned long long) perf.pixels);
+    std::fprintf(f, "  \"collisions\": %llu,\n", (unsigned long long) perf.collisions);
+    std::fprintf(f, "  \"timer_ticks\": %llu,\n", (unsigned long long) perf.timer_ticks);
+    std::fprintf(f, "  \"frames_drawn\": %llu,\n", (unsigned long long) perf.frames_drawn);
+    std::fprintf(f, "  \"frames_skipped\": %llu,\n", (unsigned long long) perf.frames_skipped);
+    std::fprintf(f, "  \"time_ms\": {\n    \"emulation\": %.3f,\n    \"draw\": %.3f,\n    \"events\": %.3f\n  }\n}\n",
+                 perf.ns[PERF_EMULATION] / 1e6, perf.ns[PERF_DRAW] / 1e6, perf.ns[PERF_EVENTS] / 1e6);
+    return std::fclose(f) == 0;
+}
+
+bool writePerfJson(const std::string &path, const PerfCountersT<false> &) {
+    FILE *f = std::fopen(path.c_str(), "w");
+    if (!f) return false;
+    std::fprintf(f, "{\n  \"enabled\": false\n}\n");
+    return std::fclose(f) == 0;
+}
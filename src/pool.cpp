@@ -0,0 +1,165 @@
+#include "../defs/pool.h"
+#include "../defs/scheduler.h"
+#include "../defs/romfile.h"
+#include "../defs/lockstep.h"
+#include "../defs/analyzer.h"
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+VMPool::VMPool(size_t count) : vms(count), slots(count) {
+}
+
+bool VMPool::loadROM(const std::string &path) {
+    RomFile rom;
+    if (!rom.open(path) || rom.size() > 4096 - DEFAULT_PC_START) return false;
+    for (Chip8 &vm : vms) {
+        vm.initialize();
+        if (!vm.loadROM(rom.data(), rom.size())) return false;
+        vm.markPristine();
+    }
+    // a memoria eh a mesma em todas, entao a analise da rom roda uma vez so
+    if (!vms.empty()) {
+        RomAnalysis analysis = analyzeRom(vms[0].memoryData(), DEFAULT_PC_START);
+        for (Chip8 &vm : vms) vm.useAnalysis(analysis);
+    }
+    return true;
+}
+
+void VMPool::reset() {
+    for (Chip8 &vm : vms) vm.reset();
+}
+
+void VMPool::seed(uint32_t base) {
+    for (size_t i = 0; i < vms.size(); ++i) vms[i].seed(base + (uint32_t) i);
+}
+
+void VMPool::setEngine(Engine e) {
+    for (Chip8 &vm : vms) vm.setEngine(e);
+}
+
+void VMPool::setQuirks(QuirkProfile q) {
+    for (Chip8 &vm : vms) vm.setQuirks(q);
+}
+
+uint64_t VMPool::executed() const {
+    uint64_t total = 0;
+    for (const Slot &s : slots) total += s.executed;
+    return total;
+}
+
+void VMPool::worker(int self, std::vector<Queue> &queues, uint64_t frames, int clock_hz, int slice,
+                    std::atomic<size_t> &remaining) {
+    const int n = (int) queues.size();
+    Queue &mine = queues[self];
+
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        size_t i = 0;
+        bool got = false;
+        {
+            std::lock_guard<std::mutex> hold(mine.lock);
+            if (!mine.vms.empty()) {
+                i = mine.vms.front();
+                mine.vms.pop_front();
+                got = true;
+            }
+        }
+        // fila vazia: rouba do fim da fila de outra thread, comecando pela vizinha
+        for (int k = 1; !got && k < n; ++k) {
+            Queue &victim = queues[(self + k) % n];
+            std::lock_guard<std::mutex> hold(victim.lock);
+            if (!victim.vms.empty()) {
+                i = victim.vms.back();
+                victim.vms.pop_back();
+                got = true;
+            }
+        }
+        if (!got) {
+            // nada pra pegar: as vms que faltam tao rodando em outras threads
+            std::this_thread::yield();
+            continue;
+        }
+
+        // a vm eh nossa ate voltar pra uma fila: roda uma fatia de frames
+        Slot &s = slots[i];
+        Chip8 &vm = vms[i];
+        uint64_t end = s.frame + (uint64_t) slice;
+        if (end > frames) end = frames;
+        for (; s.frame < end; ++s.frame) {
+            s.executed += vm.run(Scheduler::frameCycles(clock_hz, s.frame));
+            vm.tickTimers();
+        }
+        if (s.frame == frames) {
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+        } else {
+            std::lock_guard<std::mutex> hold(mine.lock);
+            mine.vms.push_back(i);
+        }
+    }
+}
+
+void VMPool::run(uint64_t frames, int clock_hz, int threads, int slice) {
+    if (vms.empty()) return;
+    if (threads <= 0) threads = (int) std::thread::hardware_concurrency();
+    if (threads <= 0) threads = 1;
+    if ((size_t) threads > vms.size()) threads = (int) vms.size();
+    if (slice <= 0) slice = 1;
+
+    for (Slot &s : slots) {
+        s.frame = 0;
+        s.executed = 0;
+    }
+    vector_executed = 0;
+    simd_runs = 0;
+    solo_runs = 0;
+    if (lockstep) {
+        runLockstep(frames, clock_hz, threads, slice);
+        return;
+    }
+    std::atomic<size_t> remaining{frames > 0 ? vms.size() : 0};
+
+    // cada thread comeca com um pedaco seguido do vector na fila dela
+    std::vector<Queue> queues(threads);
+    for (int t = 0; t < threads && frames > 0; ++t) {
+        size_t first = vms.size() * (size_t) t / (size_t) threads;
+        size_t last = vms.size() * (size_t) (t + 1) / (size_t) threads;
+        for (size_t i = first; i < last; ++i) queues[t].vms.push_back(i);
+    }
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t) {
+        pool.emplace_back(&VMPool::worker, this, t, std::ref(queues), frames, clock_hz, slice, std::ref(remaining));
+    }
+    worker(0, queues, frames, clock_hz, slice, remaining);
+    for (std::thread &th : pool) th.join();
+}
+
+void VMPool::runLockstep(uint64_t frames, int clock_hz, int threads, int slice) {
+    const size_t groups = (vms.size() + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES;
+    if ((size_t) threads > groups) threads = (int) groups;
+    std::atomic<size_t> next{0};
+
+    auto work = [&]() {
+        for (size_t g; (g = next.fetch_add(1, std::memory_order_relaxed)) < groups;) {
+            size_t first = g * LOCKSTEP_LANES;
+            int count = (int) std::min<size_t>(LOCKSTEP_LANES, vms.size() - first);
+            // o batch tem a rom decodificada (32kb), fica no heap e nao na pilha da thread
+            auto batch = std::make_unique<LockstepBatch>(&vms[first], count);
+            uint64_t executed = 0;
+            for (uint64_t f = 0; f < frames; f += (uint64_t) slice) {
+                int n = (int) std::min<uint64_t>((uint64_t) slice, frames - f);
+                executed += batch->runFrames(f, n, clock_hz);
+            }
+            // o executed() so soma os slots, o grupo inteiro fica no slot da primeira
+            slots[first].frame = frames;
+            slots[first].executed = executed;
+            vector_executed += batch->vectorInstructions();
+            simd_runs += batch->simdRuns();
+            solo_runs += batch->soloRuns();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t) pool.emplace_back(work);
+    work();
+    for (std::thread &th : pool) th.join();
+}
@@ -0,0 +1,83 @@
+#include "../defs/rewind.h"
+#include "../defs/state.h"
+#include <cstring>
+
+RewindBuffer::RewindBuffer(size_t budget_bytes)
+    : ring(budget_bytes), tail(0), head(0), count(0), since_key(0) {
+    if (budget_bytes == 0) return;
+    entries.resize(REWIND_MAX_SECONDS * 60 + 1);
+    // reserva o maior snapshot possivel, assim o vector nunca mais cresce
+    scratch.reserve(STATE_MAX_SIZE);
+}
+
+void RewindBuffer::clear() {
+    tail = 0;
+    head = 0;
+    count = 0;
+    since_key = 0;
+}
+
+void RewindBuffer::dropOldest() {
+    head = (head + 1) % entries.size();
+    --count;
+    if (count == 0) tail = 0;
+}
+
+// copia o scratch pro anel, jogando fora os frames mais velhos que estiverem no caminho
+void RewindBuffer::store(bool key) {
+    size_t size = scratch.size();
+    if (size > ring.size()) return; // budget menor que um snapshot, nao tem o que fazer
+
+    size_t pos = tail;
+    bool wrapped = pos + size > ring.size();
+    if (wrapped) pos = 0; // nao cabe no fim, comeca do inicio (o resto do fim fica vazio)
+
+    if (count == entries.size()) dropOldest();
+    while (count > 0) {
+        const Entry &old = at(0);
+        bool overlaps = old.offset < pos + size && pos < old.offset + old.size;
+        // dando a volta, tudo que tava entre o tail e o fim tambem ja era
+        if (!overlaps && !(wrapped && old.offset >= tail)) break;
+        dropOldest();
+    }
+    // delta sem o snapshot completo de antes dele nao serve pra nada
+    while (count > 0 && !at(0).key) dropOldest();
+    if (count == 0 && !key) return;
+
+    std::memcpy(&ring[pos], scratch.data(), size);
+    entries[(head + count) % entries.size()] = {(uint32_t) pos, (uint32_t) size, key};
+    ++count;
+    tail = pos + size;
+}
+
+void RewindBuffer::push(Chip8 &vm) {
+    if (!enabled()) return;
+
+    // o delta sai sempre, mesmo quando vai snapshot completo, pra zerar as marcas da vm
+    vm.saveDelta(scratch);
+    if (count == 0 || since_key + 1 >= REWIND_KEYFRAME_INTERVAL) {
+        vm.saveState(scratch);
+        since_key = 0;
+        store(true);
+    } else {
+        ++since_key;
+        store(false);
+    }
+}
+
+bool RewindBuffer::stepBack(Chip8 &vm) {
+    if (count <= 1) return false;
+    --count;
+
+    // acha o snapshot completo mais novo e reaplica os deltas ate o frame de antes
+    size_t last = count - 1;
+    size_t k = last;
+    while (!at(k).key) --k;
+    for (size_t i = k; i <= last; ++i) {
+        const Entry &e = at(i);
+        vm.loadState(&ring[e.offset], e.size);
+    }
+    since_key = (int) (last - k);
+    tail = at(last).offset + at(last).size;
+    return true;
+}
@@ -0,0 +1,175 @@
+#include "../defs/romfile.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+bool MappedFile::open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+    len = (size_t) st.st_size;
+    if (len > 0) {
+        void *p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            len = 0;
+            return false;
+        }
+        ptr = static_cast<const uint8_t *>(p);
+        mapped = true;
+    }
+    // o mapeamento continua valido depois de fechar o descritor
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapped) munmap(const_cast<uint8_t *>(ptr), len);
+    ptr = nullptr;
+    len = 0;
+    mapped = false;
+}
+
+// numeros do zip sao little endian e nao tem alinhamento nenhum
+static uint16_t rd16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static uint32_t rd32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24); }
+
+static const uint32_t ZIP_END_SIG = 0x06054b50;     // fim do diretorio central
+static const uint32_t ZIP_CENTRAL_SIG = 0x02014b50; // entrada do diretorio central
+static const uint32_t ZIP_LOCAL_SIG = 0x04034b50;   // cabecalho local antes dos dados
+static const size_t ZIP_END_SIZE = 22;
+static const size_t ZIP_CENTRAL_SIZE = 46;
+static const size_t ZIP_LOCAL_SIZE = 30;
+
+bool ZipArchive::open(const std::string &path) {
+    list.clear();
+    if (!file.open(path)) return false;
+    const uint8_t *base = file.data();
+    size_t n = file.size();
+    if (n < ZIP_END_SIZE) return false;
+
+    // o fim do diretorio fica no final, antes de um comentario de ate 64 kb
+    size_t end = 0;
+    bool found = false;
+    size_t lowest = n > ZIP_END_SIZE + 0xFFFF ? n - ZIP_END_SIZE - 0xFFFF : 0;
+    for (size_t i = n - ZIP_END_SIZE + 1; i-- > lowest;) {
+        if (rd32(base + i) == ZIP_END_SIG) {
+            end = i;
+            found = true;
+            break;
+        }
+    }
+    if (!found) return false;
+
+    uint16_t count = rd16(base + end + 10);
+    uint32_t dir_size = rd32(base + end + 12);
+    uint32_t dir_offset = rd32(base + end + 16);
+    if ((size_t) dir_offset + dir_size > end) return false;
+
+    const uint8_t *p = base + dir_offset;
+    const uint8_t *dir_end = p + dir_size;
+    list.reserve(count);
+    for (uint16_t i = 0; i < count; ++i) {
+        if (p + ZIP_CENTRAL_SIZE > dir_end || rd32(p) != ZIP_CENTRAL_SIG) return false;
+        uint16_t flags = rd16(p + 8);
+        uint16_t name_len = rd16(p + 28);
+        size_t skip = ZIP_CENTRAL_SIZE + name_len + rd16(p + 30) + rd16(p + 32);
+        if (p + skip > dir_end) return false;
+
+        Entry e;
+        e.name.assign(reinterpret_cast<const char *>(p + ZIP_CENTRAL_SIZE), name_len);
+        e.method = rd16(p + 10);
+        e.crc = rd32(p + 16);
+        e.packed_size = rd32(p + 20);
+        e.size = rd32(p + 24);
+        e.local_offset = rd32(p + 42);
+        // pastas e entradas criptografadas ficam de fora
+        bool dir = !e.name.empty() && e.name.back() == '/';
+        if (!dir && !(flags & 1)) list.push_back(std::move(e));
+        p += skip;
+    }
+    return true;
+}
+
+const ZipArchive::Entry *ZipArchive::find(const std::string &name) const {
+    for (const Entry &e : list) {
+        if (e.name == name) return &e;
+    }
+    return nullptr;
+}
+
+bool ZipArchive::read(const Entry &e, std::vector<uint8_t> &out, const uint8_t *&data, size_t &size) const {
+    out.clear();
+    const uint8_t *base = file.data();
+    size_t n = file.size();
+    if ((size_t) e.local_offset + ZIP_LOCAL_SIZE > n || rd32(base + e.local_offset) != ZIP_LOCAL_SIG) return false;
+    size_t at = (size_t) e.local_offset + ZIP_LOCAL_SIZE + rd16(base + e.local_offset + 26)
+              + rd16(base + e.local_offset + 28);
+    if (at + e.packed_size > n || e.size > ROM_ZIP_MAX_ENTRY) return false;
+    const uint8_t *packed = base + at;
+
+    if (e.method == 0) {
+        if (e.packed_size != e.size) return false;
+        data = packed;
+    } else if (e.method == 8) {
+        // deflate cru (sem cabecalho zlib), o tamanho final ja vem no diretorio
+        out.resize(e.size);
+        z_stream zs;
+        std::memset(&zs, 0, sizeof(zs));
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) return false;
+        zs.next_in = const_cast<Bytef *>(packed);
+        zs.avail_in = e.packed_size;
+        zs.next_out = out.data();
+        zs.avail_out = e.size;
+        int r = inflate(&zs, Z_FINISH);
+        bool ok = r == Z_STREAM_END && zs.total_out == e.size;
+        inflateEnd(&zs);
+        if (!ok) return false;
+        data = out.data();
+    } else {
+        return false; // outros metodos nao aparecem em zip de rom
+    }
+    size = e.size;
+    return crc32(0L, data, (uInt) size) == e.crc;
+}
+
+bool splitZipPath(const std::string &path, std::string &zip, std::string &entry) {
+    size_t at = path.find(ROM_ZIP_SEPARATOR);
+    if (at == std::string::npos) return false;
+    zip = path.substr(0, at + 4);
+    entry = path.substr(at + std::strlen(ROM_ZIP_SEPARATOR));
+    return true;
+}
+
+bool RomFile::open(const std::string &path) {
+    ptr = nullptr;
+    len = 0;
+    unpacked.clear();
+    std::string zip_path, entry;
+    // arquivo solto com ".zip:" no nome ainda abre normal
+    if (splitZipPath(path, zip_path, entry) && zip.open(zip_path)) {
+        const ZipArchive::Entry *e = zip.find(entry);
+        return e && zip.read(*e, unpacked, ptr, len);
+    }
+    if (!file.open(path)) return false;
+    ptr = file.data();
+    len = file.size();
+    return true;
+}
+
+uint64_t romHash(const uint8_t *data, size_t size) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
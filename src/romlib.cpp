@@ -0,0 +1,177 @@
+#include "../defs/romlib.h"
+#include "../defs/romfile.h"
+#include "../defs/analyzer.h"
+#include "../defs/defs.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <sys/stat.h>
+
+std::string RomInfo::title() const {
+    size_t dot = name.rfind('.');
+    return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+// a analise estatica (analyzer.h) em cima de uma memoria so com a rom no lugar dela
+QuirkProfile detectQuirks(const uint8_t *data, size_t size) {
+    std::vector<uint8_t> memory(4096, 0);
+    std::memcpy(&memory[DEFAULT_PC_START], data, std::min(size, (size_t) 4096 - DEFAULT_PC_START));
+    return analyzeRom(memory.data(), DEFAULT_PC_START).quirks;
+}
+
+// escrita e leitura em little endian, o cursor anda junto
+static void put(std::vector<uint8_t> &out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) out.push_back((v >> (8 * i)) & 0xFF);
+}
+static bool get(const uint8_t *&p, const uint8_t *end, uint64_t &v, int bytes) {
+    if (end - p < bytes) return false;
+    v = 0;
+    for (int i = 0; i < bytes; ++i) v |= (uint64_t) p[i] << (8 * i);
+    p += bytes;
+    return true;
+}
+
+// o que diz se o indice ainda vale: mtime (em ns) e tamanho da pasta ou do zip
+// (pasta muda de mtime quando entra, sai ou eh renomeado arquivo dentro dela)
+static bool sourceStamp(const std::string &path, int64_t &mtime, uint64_t &size) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+#ifdef __APPLE__
+    mtime = (int64_t) st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    mtime = (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+    size = (uint64_t) st.st_size;
+    return true;
+}
+
+bool RomLibrary::open(const std::string &src, bool rescan) {
+    source = src;
+    while (source.size() > 1 && source.back() == '/') source.pop_back();
+    is_zip = source.size() >= 4 && source.compare(source.size() - 4, 4, ".zip") == 0;
+    cached = false;
+    list.clear();
+
+    int64_t mtime;
+    uint64_t size;
+    if (!sourceStamp(source, mtime, size)) return false;
+    const std::string index_path = source + ROM_INDEX_EXT;
+    if (!rescan && loadIndex(index_path, mtime, size)) {
+        cached = true;
+        return true;
+    }
+    if (!scan()) return false;
+    // sem permissao de escrita a biblioteca funciona igual, so nao fica em cache
+    if (!writeIndex(index_path, mtime, size)) {
+        std::fprintf(stderr, "Nao deu pra gravar o indice %s\n", index_path.c_str());
+    }
+    return true;
+}
+
+std::string RomLibrary::path(const RomInfo &rom) const {
+    return is_zip ? source + ":" + rom.name : source + "/" + rom.name;
+}
+
+const RomInfo *RomLibrary::find(const std::string &key) const {
+    for (const RomInfo &r : list) {
+        if (r.name == key || r.title() == key) return &r;
+    }
+    char hex[17];
+    for (const RomInfo &r : list) {
+        std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) r.hash);
+        if (key == hex) return &r;
+    }
+    return nullptr;
+}
+
+// le e hasheia todas as roms da fonte (so quando o indice nao serve)
+bool RomLibrary::scan() {
+    auto add = [&](const std::string &name, const uint8_t *data, size_t size) {
+        list.push_back({name, (uint32_t) size, romHash(data, size), detectQuirks(data, size)});
+    };
+
+    if (is_zip) {
+        ZipArchive zip;
+        if (!zip.open(source)) return false;
+        std::vector<uint8_t> buf;
+        for (const ZipArchive::Entry &e : zip.entries()) {
+            const uint8_t *data;
+            size_t size;
+            if (e.size <= 4096 - DEFAULT_PC_START && zip.read(e, buf, data, size)) add(e.name, data, size);
+        }
+    } else {
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(source, ec)) {
+            std::string name = entry.path().filename().string();
+            if (!entry.is_regular_file() || (name.size() > 6 && name.compare(name.size() - 6, 6, ROM_INDEX_EXT) == 0)) {
+                continue;
+            }
+            // o que nao cabe na memoria do chip8 nao eh rom (zip, imagem, etc)
+            RomFile rom;
+            if (rom.open(entry.path().string()) && rom.size() <= 4096 - DEFAULT_PC_START) {
+                add(name, rom.data(), rom.size());
+            }
+        }
+        if (ec) return false;
+    }
+    std::sort(list.begin(), list.end(), [](const RomInfo &a, const RomInfo &b) { return a.name < b.name; });
+    return true;
+}
+
+// formato do indice: "C8RL", versao, mtime e tamanho da fonte, quantidade de roms e pra cada
+// uma: tamanho (4), hash (8), quirks (1), tamanho do nome (2) e o nome
+bool RomLibrary::loadIndex(const std::string &index_path, int64_t mtime, uint64_t size) {
+    MappedFile f;
+    if (!f.open(index_path)) return false;
+    const uint8_t *p = f.data();
+    const uint8_t *end = p + f.size();
+    if (f.size() < 5 || std::memcmp(p, ROM_INDEX_MAGIC, 4) != 0 || p[4] != ROM_INDEX_VERSION) return false;
+    p += 5;
+
+    uint64_t stored_mtime, stored_size, count;
+    if (!get(p, end, stored_mtime, 8) || !get(p, end, stored_size, 8) || !get(p, end, count, 4)) return false;
+    if ((int64_t) stored_mtime != mtime || stored_size != size) return false; // fonte mudou
+
+    std::vector<RomInfo> roms;
+    roms.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t rom_size, hash, quirks, name_len;
+        if (!get(p, end, rom_size, 4) || !get(p, end, hash, 8) || !get(p, end, quirks, 1) || !get(p, end, name_len, 2)) {
+            return false;
+        }
+        if ((uint64_t) (end - p) < name_len || quirks > QUIRKS_SCHIP) return false;
+        roms.push_back({std::string(reinterpret_cast<const char *>(p), name_len), (uint32_t) rom_size, hash,
+                        (QuirkProfile) quirks});
+        p += name_len;
+    }
+    list = std::move(roms);
+    return true;
+}
+
+bool RomLibrary::writeIndex(const std::string &index_path, int64_t mtime, uint64_t size) const {
+    std::vector<uint8_t> out(ROM_INDEX_MAGIC, ROM_INDEX_MAGIC + 4);
+    out.push_back(ROM_INDEX_VERSION);
+    put(out, (uint64_t) mtime, 8);
+    put(out, size, 8);
+    put(out, list.size(), 4);
+    for (const RomInfo &r : list) {
+        put(out, r.size, 4);
+        put(out, r.hash, 8);
+        put(out, r.quirks, 1);
+        put(out, r.name.size(), 2);
+        out.insert(out.end(), r.name.begin(), r.name.end());
+    }
+
+    // grava num temporario e renomeia, assim ninguem le indice pela metade
+    std::string tmp = index_path + ".tmp";
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(out.data(), 1, out.size(), f) == out.size();
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok || std::rename(tmp.c_str(), index_path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,35 @@
+#include "../defs/scheduler.h"
+#include <chrono>
+
+Scheduler::Scheduler(int hz) : clock_hz(hz > 0 ? hz : 1), frame(0) {
+}
+
+int Scheduler::nextFrameCycles() {
+    // diferenca entre os totais acumulados, assim o resto da divisao nunca se perde
+    int n = frameCycles(clock_hz, frame);
+    ++frame;
+    return n;
+}
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+IpsMeter::IpsMeter() {
+    reset();
+}
+
+void IpsMeter::reset() {
+    count = 0;
+    start_ns = now_ns();
+}
+
+double IpsMeter::seconds() const {
+    return (double) (now_ns() - start_ns) / 1e9;
+}
+
+double IpsMeter::ips() const {
+    double s = seconds();
+    return s > 0.0 ? (double) count / s : 0.0;
+}
@@ -0,0 +1,229 @@
+#include "../defs/chip8.h"
+#include "../defs/state.h"
+#include <cstring>
+#include <fstream>
+
+// tamanhos fixos do formato (ver state.h)
+static const size_t HEADER_SIZE = 6;
+static const size_t WAIT_AT = 16 + 2 + 2 + 1 + 16 * 2 + 1 + 1; // onde fica o wait_reg
+static const size_t REGS_SIZE = WAIT_AT + 1 + 4 + 1 + 1 + 16;
+static const size_t ROW_SIZE = 16; // uma linha da tela sao duas palavras
+static const size_t SCREEN_SIZE = SCHIP_HEIGHT * ROW_SIZE;
+static const int PAGES = 4096 / STATE_PAGE_SIZE;
+
+// escrita e leitura em little endian, o cursor anda junto
+static void put8(uint8_t *&p, uint8_t v) { *p++ = v; }
+static void put16(uint8_t *&p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    p += 2;
+}
+static void put32(uint8_t *&p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = (v >> (8 * i)) & 0xFF;
+    p += 4;
+}
+static void put64(uint8_t *&p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) p[i] = (v >> (8 * i)) & 0xFF;
+    p += 8;
+}
+static void putRow(uint8_t *&p, const uint64_t *row) {
+    put64(p, row[0]);
+    put64(p, row[1]);
+}
+static uint8_t get8(const uint8_t *&p) { return *p++; }
+static uint16_t get16(const uint8_t *&p) {
+    uint16_t v = p[0] | (p[1] << 8);
+    p += 2;
+    return v;
+}
+static uint32_t get32(const uint8_t *&p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= (uint32_t) p[i] << (8 * i);
+    p += 4;
+    return v;
+}
+static uint64_t get64(const uint8_t *&p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= (uint64_t) p[i] << (8 * i);
+    p += 8;
+    return v;
+}
+
+// quantos bits ligados (quantas paginas/linhas vao no delta)
+static int countBits(uint64_t m) {
+    int n = 0;
+    for (; m; m &= m - 1) ++n;
+    return n;
+}
+
+static uint8_t *putHeader(std::vector<uint8_t> &out, size_t size, StateKind kind) {
+    out.resize(size);
+    uint8_t *p = out.data();
+    std::memcpy(p, STATE_MAGIC, 4);
+    p += 4;
+    put8(p, STATE_VERSION);
+    put8(p, kind);
+    return p;
+}
+
+uint8_t *Chip8::putRegs(uint8_t *p) const {
+    std::memcpy(p, V, 16);
+    p += 16;
+    put16(p, I);
+    put16(p, PC);
+    put8(p, SP);
+    for (int i = 0; i < 16; ++i) put16(p, stack[i]);
+    put8(p, delay_timer);
+    put8(p, sound_timer);
+    put8(p, (uint8_t) wait_reg);
+    put32(p, rng_state);
+    put8(p, hires);
+    put8(p, halted);
+    std::memcpy(p, rpl, 16);
+    p += 16;
+    return p;
+}
+
+void Chip8::saveState(std::vector<uint8_t> &out) const {
+    uint8_t *p = putHeader(out, HEADER_SIZE + REGS_SIZE + sizeof(memory) + SCREEN_SIZE, STATE_FULL);
+    p = putRegs(p);
+    std::memcpy(p, memory, sizeof(memory));
+    p += sizeof(memory);
+    for (int y = 0; y < SCHIP_HEIGHT; ++y) putRow(p, DISPLAY[y]);
+}
+
+void Chip8::saveDelta(std::vector<uint8_t> &out) {
+    size_t size = HEADER_SIZE + REGS_SIZE + 8 + countBits(pages_dirty) * STATE_PAGE_SIZE
+                + 8 + countBits(rows_dirty) * ROW_SIZE;
+    uint8_t *p = putHeader(out, size, STATE_DELTA);
+    p = putRegs(p);
+
+    put64(p, pages_dirty);
+    for (uint64_t m = pages_dirty; m; m &= m - 1) {
+        int page = __builtin_ctzll(m);
+        std::memcpy(p, &memory[page * STATE_PAGE_SIZE], STATE_PAGE_SIZE);
+        p += STATE_PAGE_SIZE;
+    }
+    put64(p, rows_dirty);
+    for (uint64_t m = rows_dirty; m; m &= m - 1) putRow(p, DISPLAY[__builtin_ctzll(m)]);
+
+    pages_dirty = 0;
+    rows_dirty = 0;
+}
+
+// copia uma pagina do snapshot pra memoria, invalidando o cache so se mudou algo
+void Chip8::restorePage(int page, const uint8_t *src) {
+    uint16_t base = page * STATE_PAGE_SIZE;
+    if (std::memcmp(&memory[base], src, STATE_PAGE_SIZE) == 0) return;
+    std::memcpy(&memory[base], src, STATE_PAGE_SIZE);
+    pages_touched |= 1ULL << page;
+
+    // a instrucao que comeca no byte antes da pagina tambem le o primeiro byte dela
+    for (int i = -1; i < STATE_PAGE_SIZE; ++i) decoded[(base + i) & 0x0FFF].op = OP_NONE;
+    if (!block_code.empty()) {
+        for (int i = 0; i < STATE_PAGE_SIZE; ++i) {
+            if (block_code[base + i]) {
+                blocks_dirty = true;
+                break;
+            }
+        }
+    }
+}
+
+bool Chip8::loadState(const uint8_t *data, size_t size) {
+    // valida tudo antes de mexer na vm, snapshot quebrado nao pode deixar ela pela metade
+    if (size < HEADER_SIZE + REGS_SIZE || std::memcmp(data, STATE_MAGIC, 4) != 0) return false;
+    if (data[4] != STATE_VERSION) return false;
+    StateKind kind = (StateKind) data[5];
+
+    const uint8_t *regs = data + HEADER_SIZE;
+    const uint8_t *p = regs + REGS_SIZE;
+    uint64_t pages = ~0ULL;
+    uint64_t rows = ~0ULL;
+    if (kind == STATE_FULL) {
+        if (size != HEADER_SIZE + REGS_SIZE + sizeof(memory) + SCREEN_SIZE) return false;
+    } else if (kind == STATE_DELTA) {
+        if (size < HEADER_SIZE + REGS_SIZE + 8) return false;
+        pages = get64(p);
+        size_t rows_at = HEADER_SIZE + REGS_SIZE + 8 + countBits(pages) * STATE_PAGE_SIZE;
+        if (size < rows_at + 8) return false;
+        const uint8_t *q = data + rows_at;
+        rows = get64(q);
+        if (size != rows_at + 8 + countBits(rows) * ROW_SIZE) return false;
+    } else {
+        return false;
+    }
+    if (regs[16 + 2 + 2] > 16) return false; // SP fora da pilha
+    int8_t wait = (int8_t) regs[WAIT_AT];
+    if (wait < -1 || wait > 0xF) return false;
+
+    // registradores
+    p = regs;
+    std::memcpy(V, p, 16);
+    p += 16;
+    I = get16(p);
+    PC = get16(p);
+    SP = get8(p);
+    for (int i = 0; i < 16; ++i) stack[i] = get16(p);
+    delay_timer = get8(p);
+    sound_timer = get8(p);
+    wait_reg = (int8_t) get8(p);
+    rng_state = get32(p);
+    hires = get8(p) != 0;
+    halted = get8(p) != 0;
+    std::memcpy(rpl, p, 16);
+    p += 16;
+    if (kind == STATE_DELTA) p += 8; // mapa de paginas, ja lido
+    code_readonly = false; // a memoria pode ser de outra rom, a analise nao vale mais
+
+    // memoria (no completo as paginas vem todas em sequencia)
+    for (int page = 0; page < PAGES; ++page) {
+        if (!(pages >> page & 1)) continue;
+        restorePage(page, p);
+        p += STATE_PAGE_SIZE;
+    }
+    if (blocks_dirty) flushBlocks();
+
+    // tela
+    if (kind == STATE_DELTA) p += 8;
+    for (int y = 0; y < SCHIP_HEIGHT; ++y) {
+        if (!(rows >> y & 1)) continue;
+        DISPLAY[y][0] = get64(p);
+        DISPLAY[y][1] = get64(p);
+    }
+    video_stale = true;
+    frame_dirty = true;
+
+    // o estado carregado vira a base do proximo delta
+    pages_dirty = 0;
+    rows_dirty = 0;
+    return true;
+}
+
+uint64_t Chip8::stateHash() const {
+    std::vector<uint8_t> buf;
+    saveState(buf);
+    uint64_t h = 1469598103934665603ULL;
+    for (uint8_t b : buf) {
+        h ^= b;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool writeStateFile(const std::string &path, const std::vector<uint8_t> &data) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) return false;
+    f.write(reinterpret_cast<const char *>(data.data()), data.size());
+    return (bool) f;
+}
+
+bool readStateFile(const std::string &path, std::vector<uint8_t> &data) {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f.is_open()) return false;
+    std::streamsize size = f.tellg();
+    if (size < 0 || size > STATE_MAX_SIZE) return false;
+    f.seekg(0, std::ios::beg);
+    data.resize((size_t) size);
+    return (bool) f.read(reinterpret_cast<char *>(data.data()), size);
+}